@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <execution>
+#include "CrowdAvoidance.h"
+
+CrowdAvoidance::CrowdAvoidance(float _agent_radius) :
+	spatial_hash(4.0f * _agent_radius), agent_radius(_agent_radius) {
+}
+
+const CrowdAgentAvoidance& CrowdAvoidance::GetAgent(unsigned int agent_indx) const {
+	return agents[agent_indx];
+}
+
+float CrowdAvoidance::GetAvoidanceVelocity(unsigned int agent_indx) const {
+	const float combined_radius = 2.0f * agent_radius;
+	//Stops the push blowing up when agents already overlap
+	const float min_time = 0.1f;
+
+	dx::XMVECTOR pos_i = dx::XMLoadFloat3(&positions[agent_indx]);
+	dx::XMVECTOR velo_i = dx::XMLoadFloat3(&velocities[agent_indx]);
+	dx::XMVECTOR right_i = dx::XMLoadFloat3(&right_dirs[agent_indx]);
+
+	//Far enough to see any neighbour that can reach the agent within the horizon
+	const float query_radius = combined_radius + 2.0f * max_agent_speed * time_horizon;
+
+	float push = 0.0f;
+	spatial_hash.ForEachNear(positions[agent_indx], query_radius, [&](unsigned int j) {
+		if (j == agent_indx)
+			return;
+
+		//Position and velocity of j relative to the agent, on the ground plane
+		dx::XMVECTOR rel_pos = dx::XMVectorSubtract(dx::XMLoadFloat3(&positions[j]), pos_i);
+		dx::XMVECTOR rel_velo = dx::XMVectorSubtract(velo_i, dx::XMLoadFloat3(&velocities[j]));
+		rel_pos = dx::XMVectorSetY(rel_pos, 0.0f);
+		rel_velo = dx::XMVectorSetY(rel_velo, 0.0f);
+		if (dx::XMVectorGetX(dx::XMVector3LengthSq(rel_pos)) > query_radius * query_radius)
+			return;
+
+		//Time of closest approach within the horizon
+		float rel_speed_sq = dx::XMVectorGetX(dx::XMVector3LengthSq(rel_velo));
+		float t = 0.0f;
+		if (rel_speed_sq > 0.0f) {
+			t = dx::XMVectorGetX(dx::XMVector3Dot(rel_pos, rel_velo)) / rel_speed_sq;
+			t = (std::max)(0.0f, (std::min)(time_horizon, t));
+		}
+		dx::XMVECTOR closest = dx::XMVectorSubtract(rel_pos, dx::XMVectorScale(rel_velo, t));
+		float distance = dx::XMVectorGetX(dx::XMVector3Length(closest));
+		if (distance >= combined_radius)
+			return;
+
+		//Step away from where j will be
+		float side = distance > 0.0f ?
+			-dx::XMVectorGetX(dx::XMVector3Dot(closest, right_i)) / distance : 0.0f;
+		if (abs(side) < 0.05f) {
+			//Head on, agents walking towards each other both keep right,
+			//agents walking together split by index
+			float facing = dx::XMVectorGetX(dx::XMVector3Dot(
+				dx::XMLoadFloat3(&forward_dirs[agent_indx]), dx::XMLoadFloat3(&forward_dirs[j])));
+			side = (facing < 0.0f || agent_indx < j) ? 1.0f : -1.0f;
+		}
+
+		//Take half of the sideways speed needed to clear the other agent by time t
+		float needed = (combined_radius - distance) / (std::max)(t, min_time);
+		push += 0.5f * needed * (side > 0.0f ? 1.0f : -1.0f);
+	});
+	return push;
+}
+
+void CrowdAvoidance::Update(const PathAgentSample* samples, unsigned int count, float dt,
+	dx::XMFLOAT3* out_positions) {
+	agents.resize(count);
+	positions.resize(count);
+	velocities.resize(count);
+	forward_dirs.resize(count);
+	right_dirs.resize(count);
+	new_lateral_velocities.resize(count);
+
+	//Current positions with last frame's offsets
+	max_agent_speed = 0.0f;
+	for (unsigned int i = 0; i < count; i++) {
+		const PathAgentSample& sample = samples[i];
+		dx::XMVECTOR path_pos = dx::XMLoadFloat3(&sample.position);
+		dx::XMVECTOR forward = dx::XMVectorSubtract(dx::XMLoadFloat3(&sample.look_position), path_pos);
+		forward = dx::XMVectorSetY(forward, 0.0f);
+		if (dx::XMVectorGetX(dx::XMVector3LengthSq(forward)) > 0.0f)
+			forward = dx::XMVector3Normalize(forward);
+		else
+			forward = dx::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		//right = up x forward
+		dx::XMVECTOR right = dx::XMVectorSet(
+			dx::XMVectorGetZ(forward), 0.0f, -dx::XMVectorGetX(forward), 0.0f);
+
+		dx::XMStoreFloat3(&forward_dirs[i], forward);
+		dx::XMStoreFloat3(&right_dirs[i], right);
+		dx::XMStoreFloat3(&positions[i],
+			dx::XMVectorAdd(path_pos, dx::XMVectorScale(right, agents[i].lateral_offset)));
+		dx::XMVECTOR velocity = dx::XMVectorAdd(
+			dx::XMVectorScale(forward, sample.velocity),
+			dx::XMVectorScale(right, agents[i].lateral_velocity));
+		dx::XMStoreFloat3(&velocities[i], velocity);
+		max_agent_speed = (std::max)(max_agent_speed, dx::XMVectorGetX(dx::XMVector3Length(velocity)));
+	}
+
+	spatial_hash.Update(positions.data(), count);
+
+	//Every agent only reads the shared data and writes its own result
+	std::vector<unsigned int> agent_indices(count);
+	for (unsigned int i = 0; i < count; i++) {
+		agent_indices[i] = i;
+	}
+	std::for_each(std::execution::par, agent_indices.begin(), agent_indices.end(),
+		[&](unsigned int i) {
+			new_lateral_velocities[i] = GetAvoidanceVelocity(i);
+		});
+
+	for (unsigned int i = 0; i < count; i++) {
+		CrowdAgentAvoidance& agent = agents[i];
+		float lateral_velocity = new_lateral_velocities[i];
+		//Head back to the path when nothing is in the way
+		if (lateral_velocity == 0.0f)
+			lateral_velocity = -return_rate * agent.lateral_offset;
+
+		agent.lateral_velocity = (std::max)(-max_lateral_speed, (std::min)(max_lateral_speed, lateral_velocity));
+		agent.lateral_offset = (std::max)(-max_lateral_offset,
+			(std::min)(max_lateral_offset, agent.lateral_offset + agent.lateral_velocity * dt));
+
+		dx::XMStoreFloat3(&out_positions[i], dx::XMVectorAdd(dx::XMLoadFloat3(&samples[i].position),
+			dx::XMVectorScale(dx::XMLoadFloat3(&right_dirs[i]), agent.lateral_offset)));
+	}
+}
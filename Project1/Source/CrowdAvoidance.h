@@ -0,0 +1,60 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "SharedPath.h"
+#include "SpatialHash.h"
+
+namespace dx = DirectX;
+
+//Avoidance state of an agent, a sideways offset from its path position
+struct CrowdAgentAvoidance {
+	float lateral_offset = 0.0f;
+	float lateral_velocity = 0.0f;
+};
+
+/*
+* Local avoidance for agents following paths.
+* Agents keep to their path position but step sideways to avoid
+* each other. Each agent looks for neighbours it would collide with
+* within time_horizon, velocity obstacle style, and takes half of the
+* sideways velocity needed to pass, expecting the other agent to take the rest.
+* Neighbours are found with a spatial hash.
+*/
+class CrowdAvoidance
+{
+private:
+	SpatialHash spatial_hash;
+	std::vector<CrowdAgentAvoidance> agents;
+
+	//Per frame working data
+	std::vector<dx::XMFLOAT3> positions;
+	std::vector<dx::XMFLOAT3> velocities;
+	std::vector<dx::XMFLOAT3> forward_dirs;
+	std::vector<dx::XMFLOAT3> right_dirs;
+	std::vector<float> new_lateral_velocities;
+	//Fastest agent this frame, two agents close at no more than twice this speed
+	float max_agent_speed = 0.0f;
+
+	//Sideways velocity agent_indx wants to avoid its neighbours
+	float GetAvoidanceVelocity(unsigned int agent_indx) const;
+public:
+	float agent_radius = 20.0f;
+	//How far ahead collisions are predicted, in seconds
+	float time_horizon = 1.0f;
+	float max_lateral_offset = 60.0f;
+	float max_lateral_speed = 150.0f;
+	//How quickly an agent steers back to its path when the way is clear
+	float return_rate = 1.5f;
+
+	CrowdAvoidance(float _agent_radius = 20.0f);
+
+	/*
+	* Offsets the path positions of count agents so they avoid each other.
+	* samples are the results of SharedPath::Evaluate for the same agents.
+	* Returns: void - the avoiding positions are written to out_positions
+	*/
+	void Update(const PathAgentSample* samples, unsigned int count, float dt,
+		dx::XMFLOAT3* out_positions);
+
+	const CrowdAgentAvoidance& GetAgent(unsigned int agent_indx) const;
+};
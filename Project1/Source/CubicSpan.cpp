@@ -0,0 +1,251 @@
+#include <algorithm>
+#include "CubicSpan.h"
+
+//Distance from the point to the chord between a and b
+static float ChordHeight(dx::FXMVECTOR point, dx::FXMVECTOR a, dx::FXMVECTOR b) {
+	dx::XMVECTOR chord = dx::XMVectorSubtract(b, a);
+	dx::XMVECTOR to_point = dx::XMVectorSubtract(point, a);
+	float chord_len_sq = dx::XMVectorGetX(dx::XMVector3LengthSq(chord));
+	if (chord_len_sq <= 0.0f)
+		return dx::XMVectorGetX(dx::XMVector3Length(to_point));
+
+	float t = dx::XMVectorGetX(dx::XMVector3Dot(to_point, chord)) / chord_len_sq;
+	t = (std::max)(0.0f, (std::min)(1.0f, t));
+	return dx::XMVectorGetX(dx::XMVector3Length(
+		dx::XMVectorSubtract(to_point, dx::XMVectorScale(chord, t))));
+}
+
+/*
+* Recursively splits [ua, ub] until the error of the chord is within max_error.
+* chord_error gets the points at ua, the quarters, the middle and ub.
+*/
+template<class ChordErrorFunc>
+static void FlattenInterval(const CubicSpan& span, float ua, float ub,
+	dx::FXMVECTOR pa, dx::FXMVECTOR pb, float max_error, unsigned int depth,
+	const ChordErrorFunc& chord_error, std::vector<dx::XMFLOAT3>& out_points) {
+	float um = (ua + ub) * 0.5f;
+	dx::XMVECTOR pm = span.Evaluate(um);
+	if (depth < CubicSpan::max_flatten_depth) {
+		//Test the quarters too so an S bend through the chord is not missed
+		dx::XMVECTOR points[5] = {
+			pa, span.Evaluate((ua + um) * 0.5f), pm, span.Evaluate((um + ub) * 0.5f), pb };
+		if (chord_error(points) > max_error) {
+			FlattenInterval(span, ua, um, pa, pm, max_error, depth + 1, chord_error, out_points);
+			FlattenInterval(span, um, ub, pm, pb, max_error, depth + 1, chord_error, out_points);
+			return;
+		}
+	}
+	dx::XMFLOAT3 point;
+	dx::XMStoreFloat3(&point, pa);
+	out_points.push_back(point);
+}
+
+CubicSpan CubicSpan::FromBezier(dx::FXMVECTOR p0, dx::FXMVECTOR p1,
+	dx::FXMVECTOR p2, dx::GXMVECTOR p3) {
+	CubicSpan span;
+	//Rows of the bezier matrix applied to the control points
+	//c3 = -p0 + 3p1 - 3p2 + p3
+	dx::XMVECTOR c3 = dx::XMVectorAdd(
+		dx::XMVectorSubtract(p3, p0),
+		dx::XMVectorScale(dx::XMVectorSubtract(p1, p2), 3.0f));
+	//c2 = 3p0 - 6p1 + 3p2
+	dx::XMVECTOR c2 = dx::XMVectorScale(
+		dx::XMVectorAdd(dx::XMVectorSubtract(p0, dx::XMVectorScale(p1, 2.0f)), p2), 3.0f);
+	//c1 = -3p0 + 3p1
+	dx::XMVECTOR c1 = dx::XMVectorScale(dx::XMVectorSubtract(p1, p0), 3.0f);
+	//c0 = p0
+	dx::XMVECTOR c0 = p0;
+
+	dx::XMStoreFloat4A(&span.c3, dx::XMVectorSetW(c3, 0.0f));
+	dx::XMStoreFloat4A(&span.c2, dx::XMVectorSetW(c2, 0.0f));
+	dx::XMStoreFloat4A(&span.c1, dx::XMVectorSetW(c1, 0.0f));
+	dx::XMStoreFloat4A(&span.c0, dx::XMVectorSetW(c0, 1.0f));
+	return span;
+}
+
+dx::XMVECTOR CubicSpan::Evaluate(float u) const {
+	dx::XMVECTOR u_v = dx::XMVectorReplicate(u);
+	//Horner's method ((c3*u + c2)*u + c1)*u + c0
+	dx::XMVECTOR res = dx::XMVectorMultiplyAdd(dx::XMLoadFloat4A(&c3), u_v, dx::XMLoadFloat4A(&c2));
+	res = dx::XMVectorMultiplyAdd(res, u_v, dx::XMLoadFloat4A(&c1));
+	return dx::XMVectorMultiplyAdd(res, u_v, dx::XMLoadFloat4A(&c0));
+}
+
+dx::XMVECTOR CubicSpan::EvaluateDerivative(float u) const {
+	dx::XMVECTOR u_v = dx::XMVectorReplicate(u);
+	//P'(u) = (3*c3*u + 2*c2)*u + c1
+	dx::XMVECTOR res = dx::XMVectorMultiplyAdd(
+		dx::XMVectorScale(dx::XMLoadFloat4A(&c3), 3.0f), u_v,
+		dx::XMVectorScale(dx::XMLoadFloat4A(&c2), 2.0f));
+	return dx::XMVectorMultiplyAdd(res, u_v, dx::XMLoadFloat4A(&c1));
+}
+
+dx::XMVECTOR CubicSpan::EvaluateSecondDerivative(float u) const {
+	//P''(u) = 6*c3*u + 2*c2
+	return dx::XMVectorMultiplyAdd(
+		dx::XMVectorScale(dx::XMLoadFloat4A(&c3), 6.0f), dx::XMVectorReplicate(u),
+		dx::XMVectorScale(dx::XMLoadFloat4A(&c2), 2.0f));
+}
+
+float CubicSpan::GetArcLength(float ua, float ub) const {
+	//Gauss-Legendre nodes and weights on [-1, 1]
+	static const float nodes[5] = {
+		0.0f, -0.5384693101f, 0.5384693101f, -0.9061798459f, 0.9061798459f };
+	static const float weights[5] = {
+		0.5688888889f, 0.4786286705f, 0.4786286705f, 0.2369268851f, 0.2369268851f };
+
+	//Map the nodes from [-1, 1] to [ua, ub]
+	float half_range = (ub - ua) * 0.5f;
+	float mid = (ua + ub) * 0.5f;
+	float length = 0.0f;
+	for (unsigned int i = 0; i < 5; ++i) {
+		float speed = dx::XMVectorGetX(dx::XMVector3Length(
+			EvaluateDerivative(mid + half_range * nodes[i])));
+		length += weights[i] * speed;
+	}
+	return length * half_range;
+}
+
+void CubicSpan::Evaluate(const float* u, unsigned int count, dx::XMFLOAT3* out_points) const {
+	//Splat every coefficient once so each lane holds the same span
+	const dx::XMVECTOR c3_x = dx::XMVectorReplicate(c3.x);
+	const dx::XMVECTOR c3_y = dx::XMVectorReplicate(c3.y);
+	const dx::XMVECTOR c3_z = dx::XMVectorReplicate(c3.z);
+	const dx::XMVECTOR c2_x = dx::XMVectorReplicate(c2.x);
+	const dx::XMVECTOR c2_y = dx::XMVectorReplicate(c2.y);
+	const dx::XMVECTOR c2_z = dx::XMVectorReplicate(c2.z);
+	const dx::XMVECTOR c1_x = dx::XMVectorReplicate(c1.x);
+	const dx::XMVECTOR c1_y = dx::XMVectorReplicate(c1.y);
+	const dx::XMVECTOR c1_z = dx::XMVectorReplicate(c1.z);
+	const dx::XMVECTOR c0_x = dx::XMVectorReplicate(c0.x);
+	const dx::XMVECTOR c0_y = dx::XMVectorReplicate(c0.y);
+	const dx::XMVECTOR c0_z = dx::XMVectorReplicate(c0.z);
+
+	dx::XMFLOAT4A u_lanes, x_lanes, y_lanes, z_lanes;
+	for (unsigned int i = 0; i < count; i += 4) {
+		unsigned int lane_count = count - i < 4 ? count - i : 4;
+		//Pad the last group with the final u value
+		u_lanes.x = u[i];
+		u_lanes.y = u[i + (lane_count > 1 ? 1 : 0)];
+		u_lanes.z = u[i + (lane_count > 2 ? 2 : 0)];
+		u_lanes.w = u[i + (lane_count > 3 ? 3 : 0)];
+		dx::XMVECTOR u_v = dx::XMLoadFloat4A(&u_lanes);
+
+		dx::XMVECTOR x = dx::XMVectorMultiplyAdd(c3_x, u_v, c2_x);
+		dx::XMVECTOR y = dx::XMVectorMultiplyAdd(c3_y, u_v, c2_y);
+		dx::XMVECTOR z = dx::XMVectorMultiplyAdd(c3_z, u_v, c2_z);
+		x = dx::XMVectorMultiplyAdd(x, u_v, c1_x);
+		y = dx::XMVectorMultiplyAdd(y, u_v, c1_y);
+		z = dx::XMVectorMultiplyAdd(z, u_v, c1_z);
+		x = dx::XMVectorMultiplyAdd(x, u_v, c0_x);
+		y = dx::XMVectorMultiplyAdd(y, u_v, c0_y);
+		z = dx::XMVectorMultiplyAdd(z, u_v, c0_z);
+
+		dx::XMStoreFloat4A(&x_lanes, x);
+		dx::XMStoreFloat4A(&y_lanes, y);
+		dx::XMStoreFloat4A(&z_lanes, z);
+		const float* xs = &x_lanes.x;
+		const float* ys = &y_lanes.x;
+		const float* zs = &z_lanes.x;
+		for (unsigned int lane = 0; lane < lane_count; ++lane) {
+			out_points[i + lane] = dx::XMFLOAT3(xs[lane], ys[lane], zs[lane]);
+		}
+	}
+}
+
+void CubicSpan::EvaluateSpans(const CubicSpan* const* spans, const float* u,
+	unsigned int count, dx::XMFLOAT3* out_points) {
+	dx::XMFLOAT4A u_lanes, x_lanes, y_lanes, z_lanes;
+	for (unsigned int i = 0; i < count; i += 4) {
+		unsigned int lane_count = count - i < 4 ? count - i : 4;
+		//Pad the last group by repeating the first span of the group
+		const CubicSpan* s0 = spans[i];
+		const CubicSpan* s1 = spans[i + (lane_count > 1 ? 1 : 0)];
+		const CubicSpan* s2 = spans[i + (lane_count > 2 ? 2 : 0)];
+		const CubicSpan* s3 = spans[i + (lane_count > 3 ? 3 : 0)];
+		u_lanes.x = u[i];
+		u_lanes.y = u[i + (lane_count > 1 ? 1 : 0)];
+		u_lanes.z = u[i + (lane_count > 2 ? 2 : 0)];
+		u_lanes.w = u[i + (lane_count > 3 ? 3 : 0)];
+		dx::XMVECTOR u_v = dx::XMLoadFloat4A(&u_lanes);
+
+		//Transpose so that row 0 holds the x of all four spans, row 1 the y...
+		dx::XMMATRIX c3_t = dx::XMMatrixTranspose(dx::XMMATRIX(
+			dx::XMLoadFloat4A(&s0->c3), dx::XMLoadFloat4A(&s1->c3),
+			dx::XMLoadFloat4A(&s2->c3), dx::XMLoadFloat4A(&s3->c3)));
+		dx::XMMATRIX c2_t = dx::XMMatrixTranspose(dx::XMMATRIX(
+			dx::XMLoadFloat4A(&s0->c2), dx::XMLoadFloat4A(&s1->c2),
+			dx::XMLoadFloat4A(&s2->c2), dx::XMLoadFloat4A(&s3->c2)));
+		dx::XMMATRIX c1_t = dx::XMMatrixTranspose(dx::XMMATRIX(
+			dx::XMLoadFloat4A(&s0->c1), dx::XMLoadFloat4A(&s1->c1),
+			dx::XMLoadFloat4A(&s2->c1), dx::XMLoadFloat4A(&s3->c1)));
+		dx::XMMATRIX c0_t = dx::XMMatrixTranspose(dx::XMMATRIX(
+			dx::XMLoadFloat4A(&s0->c0), dx::XMLoadFloat4A(&s1->c0),
+			dx::XMLoadFloat4A(&s2->c0), dx::XMLoadFloat4A(&s3->c0)));
+
+		dx::XMVECTOR x = dx::XMVectorMultiplyAdd(c3_t.r[0], u_v, c2_t.r[0]);
+		dx::XMVECTOR y = dx::XMVectorMultiplyAdd(c3_t.r[1], u_v, c2_t.r[1]);
+		dx::XMVECTOR z = dx::XMVectorMultiplyAdd(c3_t.r[2], u_v, c2_t.r[2]);
+		x = dx::XMVectorMultiplyAdd(x, u_v, c1_t.r[0]);
+		y = dx::XMVectorMultiplyAdd(y, u_v, c1_t.r[1]);
+		z = dx::XMVectorMultiplyAdd(z, u_v, c1_t.r[2]);
+		x = dx::XMVectorMultiplyAdd(x, u_v, c0_t.r[0]);
+		y = dx::XMVectorMultiplyAdd(y, u_v, c0_t.r[1]);
+		z = dx::XMVectorMultiplyAdd(z, u_v, c0_t.r[2]);
+
+		dx::XMStoreFloat4A(&x_lanes, x);
+		dx::XMStoreFloat4A(&y_lanes, y);
+		dx::XMStoreFloat4A(&z_lanes, z);
+		const float* xs = &x_lanes.x;
+		const float* ys = &y_lanes.x;
+		const float* zs = &z_lanes.x;
+		for (unsigned int lane = 0; lane < lane_count; ++lane) {
+			out_points[i + lane] = dx::XMFLOAT3(xs[lane], ys[lane], zs[lane]);
+		}
+	}
+}
+
+void CubicSpan::Flatten(float max_error, std::vector<dx::XMFLOAT3>& out_points) const {
+	auto chord_error = [](const dx::XMVECTOR* points) {
+		return (std::max)(ChordHeight(points[2], points[0], points[4]),
+			(std::max)(ChordHeight(points[1], points[0], points[4]),
+				ChordHeight(points[3], points[0], points[4])));
+	};
+	FlattenInterval(*this, 0.0f, 1.0f, Evaluate(0.0f), Evaluate(1.0f),
+		max_error, 0, chord_error, out_points);
+}
+
+void CubicSpan::FlattenProjected(float max_pixel_error, float max_world_error, dx::FXMMATRIX view_proj,
+	float screen_width, float screen_height, std::vector<dx::XMFLOAT3>& out_points) const {
+	const dx::XMVECTOR half_screen = dx::XMVectorSet(
+		screen_width * 0.5f, screen_height * 0.5f, 0.0f, 0.0f);
+	//Errors are returned relative to their tolerance, so the interval is split above 1
+	auto chord_error = [&](const dx::XMVECTOR* points) {
+		dx::XMVECTOR screen_points[5];
+		unsigned int behind_count = 0;
+		for (unsigned int i = 0; i < 5; i++) {
+			dx::XMVECTOR clip = dx::XMVector3Transform(points[i], view_proj);
+			float w = dx::XMVectorGetW(clip);
+			if (w <= 0.0f) {
+				behind_count++;
+				continue;
+			}
+			//Perspective divide and scale to pixels, depth is ignored
+			screen_points[i] = dx::XMVectorMultiply(
+				dx::XMVectorScale(clip, 1.0f / w), half_screen);
+		}
+		//Behind the camera, nothing of the interval is visible
+		if (behind_count == 5)
+			return 0.0f;
+		//Crossing the camera plane, the projection is meaningless so use the world error
+		if (behind_count > 0)
+			return (std::max)(ChordHeight(points[2], points[0], points[4]),
+				(std::max)(ChordHeight(points[1], points[0], points[4]),
+					ChordHeight(points[3], points[0], points[4]))) / max_world_error;
+		return (std::max)(ChordHeight(screen_points[2], screen_points[0], screen_points[4]),
+			(std::max)(ChordHeight(screen_points[1], screen_points[0], screen_points[4]),
+				ChordHeight(screen_points[3], screen_points[0], screen_points[4]))) / max_pixel_error;
+	};
+	FlattenInterval(*this, 0.0f, 1.0f, Evaluate(0.0f), Evaluate(1.0f),
+		1.0f, 0, chord_error, out_points);
+}
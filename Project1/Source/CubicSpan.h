@@ -0,0 +1,91 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+namespace dx = DirectX;
+
+/*
+* Polynomial form of a single cubic bezier span of a path.
+* P(u) = c3*u^3 + c2*u^2 + c1*u + c0
+* The coefficients are computed once from the control points,
+* so evaluating a point is a chain of three multiply-adds.
+*/
+struct CubicSpan
+{
+	//Constant term, w is 1 so evaluated points are positions
+	dx::XMFLOAT4A c0;
+	dx::XMFLOAT4A c1;
+	dx::XMFLOAT4A c2;
+	dx::XMFLOAT4A c3;
+
+	//Limits a flattened span to 2^10 segments
+	static const unsigned int max_flatten_depth = 10;
+
+	/*
+	* Builds the polynomial coefficients for the bezier curve
+	* with the control points p0, p1, p2, p3
+	* Returns: CubicSpan
+	*/
+	static CubicSpan FromBezier(dx::FXMVECTOR p0, dx::FXMVECTOR p1,
+		dx::FXMVECTOR p2, dx::GXMVECTOR p3);
+
+	/*
+	* Evaluates the span at u
+	* Returns: VECTOR - position in world space
+	*/
+	dx::XMVECTOR Evaluate(float u) const;
+
+	/*
+	* Evaluates the first derivative P'(u) of the span at u
+	* Returns: VECTOR - tangent, not normalized
+	*/
+	dx::XMVECTOR EvaluateDerivative(float u) const;
+
+	/*
+	* Evaluates the second derivative P''(u) of the span at u
+	* Returns: VECTOR
+	*/
+	dx::XMVECTOR EvaluateSecondDerivative(float u) const;
+
+	/*
+	* Integrates the speed |P'(u)| between ua and ub with
+	* 5 point Gauss-Legendre quadrature.
+	* Exact for the length of straight spans, very close for gentle curves.
+	* Returns: float - arc length between ua and ub
+	*/
+	float GetArcLength(float ua, float ub) const;
+
+	/*
+	* Evaluates the span at count different u values.
+	* Processes four u values per iteration with the lanes of a vector.
+	* Returns: void - the points are written to out_points
+	*/
+	void Evaluate(const float* u, unsigned int count, dx::XMFLOAT3* out_points) const;
+
+	/*
+	* Evaluates count different spans, spans[i] at u[i].
+	* The coefficients of four spans are transposed into the lanes of a vector
+	* and evaluated together.
+	* Returns: void - the points are written to out_points
+	*/
+	static void EvaluateSpans(const CubicSpan* const* spans, const float* u,
+		unsigned int count, dx::XMFLOAT3* out_points);
+
+	/*
+	* Approximates the span with line segments, halving an interval while the
+	* curve strays more than max_error from its chord.
+	* Straight spans produce a single segment, tight bends many.
+	* Returns: void - the start of every segment is appended to out_points,
+	* the end point of the span is not
+	*/
+	void Flatten(float max_error, std::vector<dx::XMFLOAT3>& out_points) const;
+
+	/*
+	* Same as Flatten but the chord error is measured in pixels after
+	* projecting with view_proj to a screen of the given size.
+	* Intervals entirely behind the camera are not split, intervals crossing
+	* the camera plane can't be projected and are held to max_world_error instead.
+	*/
+	void FlattenProjected(float max_pixel_error, float max_world_error, dx::FXMMATRIX view_proj,
+		float screen_width, float screen_height, std::vector<dx::XMFLOAT3>& out_points) const;
+};
@@ -10,7 +10,8 @@
 #include "IndexBuffer.h"
 #include "Curve.h"
 
-Curve::Curve(Graphics& gfx, const std::vector<dx::XMFLOAT3>& curve_points) {
+Curve::Curve(Graphics& gfx, const std::vector<dx::XMFLOAT3>& curve_points, bool partial_updates,
+	Connectivity connectivity) : connectivity(connectivity), vertex_capacity((unsigned int)curve_points.size()) {
 	if (!IsStaticInitialized()) {
 		auto pvs = std::make_unique<VertexShader>(gfx, L"CurveVS.cso");
 		auto pvsbc = pvs->GetBytecode();
@@ -29,13 +30,22 @@ Curve::Curve(Graphics& gfx, const std::vector<dx::XMFLOAT3>& curve_points) {
 
 	std::vector<int> vertex_indices;
 	
-	for (unsigned int indx = 0; indx < curve_points.size()-1; indx++) {
-		vertex_indices.push_back(indx);
-		vertex_indices.push_back(indx + 1);
+	if (connectivity == Connectivity::SEGMENTS) {
+		for (unsigned int indx = 0; indx + 1 < curve_points.size(); indx += 2) {
+			vertex_indices.push_back(indx);
+			vertex_indices.push_back(indx + 1);
+		}
+	}
+	else {
+		for (unsigned int indx = 0; indx < curve_points.size()-1; indx++) {
+			vertex_indices.push_back(indx);
+			vertex_indices.push_back(indx + 1);
+		}
 	}
 
-	AddBind(std::make_unique<DynamicVertexBuffer>(gfx, curve_points));
+	AddBind(std::make_unique<DynamicVertexBuffer>(gfx, curve_points, partial_updates));
 	AddIndexBuffer(std::make_unique<IndexBuffer>(gfx, vertex_indices));
+	draw_index_count = GetIndexCount(vertex_capacity);
 
 	AddBind(std::make_unique<TransformCBuf>(gfx, *this));
 	SetPosition(dx::XMFLOAT3(0.0f, 0.0f, 0.0f));
@@ -51,10 +61,33 @@ void Curve::Update(float dt) noexcept {
 	SetModelTransform();
 }
 
+unsigned int Curve::GetVertexCapacity() const noexcept {
+	return vertex_capacity;
+}
+
 void Curve::UpdateVertices(Graphics& gfx, const std::vector<dx::XMFLOAT3>& curve_points) {
+	assert(curve_points.size() <= vertex_capacity);
 	auto pConstVB = QueryBindable<DynamicVertexBuffer>();
 	assert(pConstVB != nullptr);
 	pConstVB->Update(gfx, curve_points);
+	draw_index_count = GetIndexCount((unsigned int)curve_points.size());
+}
+
+void Curve::UpdateVertices(Graphics& gfx, const std::vector<dx::XMFLOAT3>& curve_points,
+	unsigned int first_vertex, unsigned int vertex_count) {
+	auto pConstVB = QueryBindable<DynamicVertexBuffer>();
+	assert(pConstVB != nullptr);
+	pConstVB->UpdateRange(gfx, curve_points, first_vertex, vertex_count);
+}
+
+UINT Curve::GetDrawIndexCount() const noexcept {
+	return draw_index_count;
+}
+
+UINT Curve::GetIndexCount(unsigned int point_count) const noexcept {
+	if (connectivity == Connectivity::SEGMENTS)
+		return (point_count / 2) * 2;
+	return point_count > 1 ? (point_count - 1) * 2 : 0;
 }
 
 void Curve::SetPosition(DirectX::XMFLOAT3 _pos) {
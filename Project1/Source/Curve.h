@@ -1,15 +1,36 @@
 #pragma once
 class Curve : public DrawableBase<Curve> {
 public:
-	Curve(Graphics& gfx, const std::vector<DirectX::XMFLOAT3>& curve_points);
+	//STRIP joins every point to the next, SEGMENTS draws each pair of points (2i, 2i+1) as its own line
+	enum class Connectivity {
+		STRIP,
+		SEGMENTS
+	};
+
+	//partial_updates lets UpdateVertices upload a range of the points without rewriting the rest
+	Curve(Graphics& gfx, const std::vector<DirectX::XMFLOAT3>& curve_points, bool partial_updates = false,
+		Connectivity connectivity = Connectivity::STRIP);
 	DirectX::XMMATRIX GetTransformXM() const noexcept override;
 	void Update(float dt) noexcept override;
+	//Points the curve was created with, UpdateVertices can upload up to this many
+	unsigned int GetVertexCapacity() const noexcept;
+	//Uploads the points and only draws those, there may be fewer than the capacity
 	void UpdateVertices(Graphics& gfx, const std::vector<DirectX::XMFLOAT3>& curve_points);
+	//Uploads only vertex_count points starting at first_vertex when created with partial_updates
+	void UpdateVertices(Graphics& gfx, const std::vector<DirectX::XMFLOAT3>& curve_points,
+		unsigned int first_vertex, unsigned int vertex_count);
 	void SetPosition(DirectX::XMFLOAT3 _pos);
 	void SetModelTransform();
 private:
+	UINT GetDrawIndexCount() const noexcept override;
+	//Indices that join point_count points
+	UINT GetIndexCount(unsigned int point_count) const noexcept;
+
 	// model transform
 	DirectX::XMFLOAT4X4 mt;
 	DirectX::XMFLOAT3 position;
+	Connectivity connectivity;
+	unsigned int vertex_capacity;
+	UINT draw_index_count;
 };
 
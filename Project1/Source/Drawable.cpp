@@ -19,7 +19,11 @@ void Drawable::Draw(Graphics& gfx) const {
 	if (pIndexBuffer == nullptr)
 		gfx.DrawAuto();
 	else
-		gfx.DrawIndexed(pIndexBuffer->GetCount());
+		gfx.DrawIndexed(GetDrawIndexCount());
+}
+
+UINT Drawable::GetDrawIndexCount() const noexcept {
+	return pIndexBuffer->GetCount();
 }
 
 /*
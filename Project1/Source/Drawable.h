@@ -29,6 +29,8 @@ protected:
 	}
 	void AddBind(std::unique_ptr<Bindable> bind);
 	void AddIndexBuffer(std::unique_ptr<class IndexBuffer> ibuf);
+	//Indices drawn by Draw, all of the index buffer unless overridden
+	virtual UINT GetDrawIndexCount() const noexcept;
 private:
 	virtual const std::vector<std::unique_ptr<Bindable>>& GetStaticBinds() const noexcept = 0;
 private:
@@ -3,13 +3,18 @@
 
 class DynamicVertexBuffer : public Bindable {
 public:
+	/*
+	* partial_updates creates a default usage buffer that is written with UpdateSubresource,
+	* so UpdateRange only copies the changed vertices.
+	* Otherwise the buffer is dynamic and every update discards and rewrites all of it.
+	*/
 	template<class V>
-	DynamicVertexBuffer(Graphics& gfx, const std::vector<V>& vertices) :
-		stride(sizeof(V)) {
+	DynamicVertexBuffer(Graphics& gfx, const std::vector<V>& vertices, bool _partial_updates = false) :
+		stride(sizeof(V)), partial_updates(_partial_updates) {
 		D3D11_BUFFER_DESC bd = {};
 		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		bd.Usage = D3D11_USAGE_DYNAMIC;
-		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bd.Usage = partial_updates ? D3D11_USAGE_DEFAULT : D3D11_USAGE_DYNAMIC;
+		bd.CPUAccessFlags = partial_updates ? 0u : D3D11_CPU_ACCESS_WRITE;
 		bd.MiscFlags = 0u;
 		bd.ByteWidth = UINT(sizeof(V) * vertices.size());
 		bd.StructureByteStride = sizeof(V);
@@ -22,19 +27,35 @@ public:
 	
 	/*
 	* Maps the dynamic vertex buffer.
-	* Writes vertex data to it.
+	* Writes vertex data to it, which may be fewer vertices than the buffer holds.
 	* Unmaps the buffer
 	*/
 	template<class V>
 	void Update(Graphics& gfx, const std::vector<V>& vertices);
+
+	/*
+	* Writes only vertex_count vertices starting at first_vertex
+	* if the buffer was created for partial updates.
+	* A dynamic buffer is discarded on map, so all of the vertices are rewritten.
+	*/
+	template<class V>
+	void UpdateRange(Graphics& gfx, const std::vector<V>& vertices,
+		unsigned int first_vertex, unsigned int vertex_count);
 	
 protected:
 	UINT stride;
+	bool partial_updates;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> pVertexBuffer;
 };
 
 template<class V>
 inline void DynamicVertexBuffer::Update(Graphics& gfx, const std::vector<V>& vertices) {
+	//The buffer may hold more vertices than are written
+	if (partial_updates) {
+		UpdateRange(gfx, vertices, 0u, (unsigned int)vertices.size());
+		return;
+	}
+
 	D3D11_MAPPED_SUBRESOURCE msr;
 	ZeroMemory(&msr, sizeof(D3D11_MAPPED_SUBRESOURCE));
 
@@ -46,3 +67,23 @@ inline void DynamicVertexBuffer::Update(Graphics& gfx, const std::vector<V>& ver
 	memcpy(msr.pData, vertices.data(), vertices.size() * stride);
 	GetContext(gfx)->Unmap(pVertexBuffer.Get(), 0u);
 }
+
+template<class V>
+inline void DynamicVertexBuffer::UpdateRange(Graphics& gfx, const std::vector<V>& vertices,
+	unsigned int first_vertex, unsigned int vertex_count) {
+	//The contents of a dynamic buffer are undefined after a discard
+	if (!partial_updates) {
+		Update(gfx, vertices);
+		return;
+	}
+
+	D3D11_BOX box = {};
+	box.left = first_vertex * stride;
+	box.right = (first_vertex + vertex_count) * stride;
+	box.top = 0u;
+	box.bottom = 1u;
+	box.front = 0u;
+	box.back = 1u;
+	GetContext(gfx)->UpdateSubresource(pVertexBuffer.Get(), 0u, &box,
+		vertices.data() + first_vertex, 0u, 0u);
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <DirectXMath.h>
+#include <array>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace dx = DirectX;
+
+/*
+* Jacobian IK step for a chain of N joints using fixed size matrices on the stack.
+* J is 3xN, so J*J^T is always 3x3 and is inverted in closed form.
+* Nothing is allocated, the armadillo path in IKController is only
+* used for chains longer than the fixed sizes it dispatches to.
+* JointType needs position, curr_rot_axis, world_rot_axis, rot_angle, final_angle and flexibility,
+* like IKController::Joint.
+*/
+template<unsigned int N>
+class FixedJacobianSolver
+{
+public:
+	typedef std::array<double, N> JointVector;
+	//Stored row by row, 3 rows of N
+	typedef std::array<std::array<double, N>, 3> Jacobian;
+	typedef std::array<std::array<double, 3>, 3> Matrix3;
+
+	/*
+	* Column i is the change in the EE position for a rotation of joint i
+	* i.e axis_i x (EE - position_i)
+	* world_axes uses world_rot_axis, which follows the rotation of the parent bones,
+	* otherwise curr_rot_axis as the original Jacobian step did
+	*/
+	template<class JointType>
+	static void GetJacobian(const JointType* joints, dx::FXMVECTOR ee_position, bool world_axes, Jacobian& J);
+
+	/*
+	* Inverts a 3x3 matrix with its cofactors
+	* Returns: bool - false if the matrix is singular, inverse is left untouched
+	*/
+	static bool Invert(const Matrix3& m, Matrix3& inverse);
+
+	//J J^T, symmetric
+	static void MultiplyTranspose(const Jacobian& J, Matrix3& J_J_T);
+
+	/*
+	* Same weights as IKController::GenerateConstrainedWeights
+	*/
+	template<class JointType>
+	static void GetConstrainedWeights(const JointType* joints, float weight_factor, JointVector& w);
+
+	/*
+	* Calculates the joint angle change dQ that moves the EE by dP
+	* dQ = J^T (J J^T)^-1 dP
+	* Returns: bool - false if J J^T is singular and no step could be taken
+	*/
+	template<class JointType>
+	static bool Solve(const JointType* joints, dx::FXMVECTOR ee_position, dx::FXMVECTOR dP,
+		bool apply_constraints, float weight_factor, JointVector& dQ);
+
+	/*
+	* Damped least squares step that stays bounded near singularities
+	* dQ = J^T (J J^T + damping^2 I)^-1 dP, J is built from the world axes of the joints
+	* Returns: bool - false if the damped matrix is still singular
+	*/
+	template<class JointType>
+	static bool SolveDamped(const JointType* joints, dx::FXMVECTOR ee_position, dx::FXMVECTOR dP,
+		float damping, JointVector& dQ);
+};
+
+template<unsigned int N>
+template<class JointType>
+inline void FixedJacobianSolver<N>::GetJacobian(const JointType* joints, dx::FXMVECTOR ee_position, bool world_axes,
+	Jacobian& J) {
+	for (unsigned int i = 0; i < N; ++i) {
+		dx::XMFLOAT3 column;
+		dx::XMStoreFloat3(&column, dx::XMVector3Cross(
+			world_axes ? joints[i].world_rot_axis : joints[i].curr_rot_axis,
+			dx::XMVectorSubtract(ee_position, joints[i].position)));
+		J[0][i] = column.x;
+		J[1][i] = column.y;
+		J[2][i] = column.z;
+	}
+}
+
+template<unsigned int N>
+inline bool FixedJacobianSolver<N>::Invert(const Matrix3& m, Matrix3& inverse) {
+	double cofactor_00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	double cofactor_01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	double cofactor_02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	double det = m[0][0] * cofactor_00 + m[0][1] * cofactor_01 + m[0][2] * cofactor_02;
+
+	//Singular relative to the size of the entries
+	double scale = 0.0;
+	for (unsigned int row = 0; row < 3; ++row) {
+		for (unsigned int col = 0; col < 3; ++col) {
+			scale = (std::max)(scale, std::abs(m[row][col]));
+		}
+	}
+	if (std::abs(det) <= DBL_EPSILON * scale * scale * scale)
+		return false;
+
+	double inv_det = 1.0 / det;
+	inverse[0][0] = cofactor_00 * inv_det;
+	inverse[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+	inverse[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+	inverse[1][0] = cofactor_01 * inv_det;
+	inverse[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+	inverse[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+	inverse[2][0] = cofactor_02 * inv_det;
+	inverse[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+	inverse[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+	return true;
+}
+
+template<unsigned int N>
+inline void FixedJacobianSolver<N>::MultiplyTranspose(const Jacobian& J, Matrix3& J_J_T) {
+	for (unsigned int row = 0; row < 3; ++row) {
+		for (unsigned int col = row; col < 3; ++col) {
+			double sum = 0.0;
+			for (unsigned int i = 0; i < N; ++i) {
+				sum += J[row][i] * J[col][i];
+			}
+			J_J_T[row][col] = sum;
+			J_J_T[col][row] = sum;
+		}
+	}
+}
+
+template<unsigned int N>
+template<class JointType>
+inline void FixedJacobianSolver<N>::GetConstrainedWeights(const JointType* joints, float weight_factor, JointVector& w) {
+	double max_weight = 0;
+	for (unsigned int i = 0; i < N; ++i) {
+		w[i] = joints[i].flexibility * (joints[i].final_angle - joints[i].rot_angle);
+		if (w[i] > max_weight)
+			max_weight = w[i];
+	}
+
+	//No joint wants to move, dividing would give NaN angles
+	if (max_weight <= 0) {
+		w.fill(0.0);
+		return;
+	}
+
+	//Convert all weights into the range 0 - 1 and apply the weight factor
+	for (unsigned int i = 0; i < N; ++i) {
+		w[i] = (w[i] / max_weight) * weight_factor;
+	}
+}
+
+template<unsigned int N>
+template<class JointType>
+inline bool FixedJacobianSolver<N>::Solve(const JointType* joints, dx::FXMVECTOR ee_position, dx::FXMVECTOR dP,
+	bool apply_constraints, float weight_factor, JointVector& dQ) {
+	Jacobian J;
+	GetJacobian(joints, ee_position, false, J);
+
+	Matrix3 J_J_T;
+	MultiplyTranspose(J, J_J_T);
+
+	Matrix3 J_J_T_inv;
+	if (!Invert(J_J_T, J_J_T_inv))
+		return false;
+
+	dx::XMFLOAT3 dP_f;
+	dx::XMStoreFloat3(&dP_f, dP);
+	std::array<double, 3> target = { dP_f.x, dP_f.y, dP_f.z };
+	std::array<double, 3> Jw = { 0.0, 0.0, 0.0 };
+	if (apply_constraints) {
+		JointVector w;
+		GetConstrainedWeights(joints, weight_factor, w);
+		for (unsigned int row = 0; row < 3; ++row) {
+			for (unsigned int i = 0; i < N; ++i) {
+				Jw[row] += J[row][i] * w[i];
+			}
+		}
+	}
+
+	//pseudo_J * (dP + Jw) - pseudo_J * Jw, as the armadillo path does
+	std::array<double, 3> y;
+	for (unsigned int row = 0; row < 3; ++row) {
+		double with_weights = 0.0;
+		double weights_only = 0.0;
+		for (unsigned int col = 0; col < 3; ++col) {
+			with_weights += J_J_T_inv[row][col] * (target[col] + Jw[col]);
+			weights_only += J_J_T_inv[row][col] * Jw[col];
+		}
+		y[row] = with_weights - weights_only;
+	}
+
+	for (unsigned int i = 0; i < N; ++i) {
+		dQ[i] = J[0][i] * y[0] + J[1][i] * y[1] + J[2][i] * y[2];
+	}
+	return true;
+}
+
+template<unsigned int N>
+template<class JointType>
+inline bool FixedJacobianSolver<N>::SolveDamped(const JointType* joints, dx::FXMVECTOR ee_position, dx::FXMVECTOR dP,
+	float damping, JointVector& dQ) {
+	Jacobian J;
+	GetJacobian(joints, ee_position, true, J);
+
+	Matrix3 damped;
+	MultiplyTranspose(J, damped);
+	for (unsigned int i = 0; i < 3; ++i) {
+		damped[i][i] += (double)damping * damping;
+	}
+
+	Matrix3 damped_inv;
+	if (!Invert(damped, damped_inv))
+		return false;
+
+	dx::XMFLOAT3 dP_f;
+	dx::XMStoreFloat3(&dP_f, dP);
+	std::array<double, 3> y;
+	for (unsigned int row = 0; row < 3; ++row) {
+		y[row] = damped_inv[row][0] * dP_f.x + damped_inv[row][1] * dP_f.y + damped_inv[row][2] * dP_f.z;
+	}
+
+	for (unsigned int i = 0; i < N; ++i) {
+		dQ[i] = J[0][i] * y[0] + J[1][i] * y[1] + J[2][i] * y[2];
+	}
+	return true;
+}
@@ -5,7 +5,7 @@
 namespace wrl = Microsoft::WRL;
 namespace dx = DirectX;
 
-Graphics::Graphics(HWND hWnd, int width, int height)
+Graphics::Graphics(HWND hWnd, int width, int height) : width(width), height(height)
 {
 	DXGI_SWAP_CHAIN_DESC sd = {};
 	sd.BufferDesc.Width = 0;
@@ -170,6 +170,14 @@ DirectX::XMMATRIX Graphics::GetCamera() const noexcept{
 	return camera;
 }
 
+int Graphics::GetWidth() const noexcept {
+	return width;
+}
+
+int Graphics::GetHeight() const noexcept {
+	return height;
+}
+
 void Graphics::EnableImgui() noexcept {
 	imguiEnabled = true;
 }
@@ -25,6 +25,8 @@ public:
 	DirectX::XMMATRIX GetProjection() const noexcept;
 	void SetCamera(DirectX::FXMMATRIX _camera) noexcept;
 	DirectX::XMMATRIX GetCamera() const noexcept;
+	int GetWidth() const noexcept;
+	int GetHeight() const noexcept;
 	void EnableImgui() noexcept;
 	void DisableImgui() noexcept;
 	bool IsImguiEnabled() const noexcept;
@@ -46,5 +48,7 @@ private:
 	
 	DirectX::XMMATRIX projection;
 	DirectX::XMMATRIX camera;
+	int width;
+	int height;
 	bool imguiEnabled = true;
 };
\ No newline at end of file
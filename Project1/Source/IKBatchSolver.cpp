@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <array>
+#include <execution>
+#include "IKBatchSolver.h"
+
+namespace {
+	//One 3D vector per lane, x, y and z of every lane in their own register
+	struct LaneVector3 {
+		dx::XMVECTOR x, y, z;
+	};
+
+	//One quaternion per lane
+	struct LaneQuaternion {
+		dx::XMVECTOR x, y, z, w;
+	};
+
+	//Affine transform per lane, rows 0 - 2 are the linear part and row 3 the translation
+	struct LaneMatrix {
+		dx::XMVECTOR m[4][3];
+	};
+
+	LaneVector3 Replicate(const dx::XMFLOAT3& v) {
+		return { dx::XMVectorReplicate(v.x), dx::XMVectorReplicate(v.y), dx::XMVectorReplicate(v.z) };
+	}
+
+	LaneVector3 Add(const LaneVector3& a, const LaneVector3& b) {
+		return { dx::XMVectorAdd(a.x, b.x), dx::XMVectorAdd(a.y, b.y), dx::XMVectorAdd(a.z, b.z) };
+	}
+
+	LaneVector3 Subtract(const LaneVector3& a, const LaneVector3& b) {
+		return { dx::XMVectorSubtract(a.x, b.x), dx::XMVectorSubtract(a.y, b.y), dx::XMVectorSubtract(a.z, b.z) };
+	}
+
+	LaneVector3 Scale(const LaneVector3& a, dx::FXMVECTOR s) {
+		return { dx::XMVectorMultiply(a.x, s), dx::XMVectorMultiply(a.y, s), dx::XMVectorMultiply(a.z, s) };
+	}
+
+	dx::XMVECTOR Dot(const LaneVector3& a, const LaneVector3& b) {
+		return dx::XMVectorMultiplyAdd(a.x, b.x,
+			dx::XMVectorMultiplyAdd(a.y, b.y, dx::XMVectorMultiply(a.z, b.z)));
+	}
+
+	LaneVector3 Cross(const LaneVector3& a, const LaneVector3& b) {
+		return {
+			dx::XMVectorSubtract(dx::XMVectorMultiply(a.y, b.z), dx::XMVectorMultiply(a.z, b.y)),
+			dx::XMVectorSubtract(dx::XMVectorMultiply(a.z, b.x), dx::XMVectorMultiply(a.x, b.z)),
+			dx::XMVectorSubtract(dx::XMVectorMultiply(a.x, b.y), dx::XMVectorMultiply(a.y, b.x)) };
+	}
+
+	LaneVector3 Normalize(const LaneVector3& a) {
+		return Scale(a, dx::XMVectorReciprocalSqrt(Dot(a, a)));
+	}
+
+	//Rotates v by the unit quaternion, v + w t + q x t with t = 2 q x v
+	LaneVector3 Rotate(const LaneQuaternion& q, const LaneVector3& v) {
+		LaneVector3 q_v = { q.x, q.y, q.z };
+		LaneVector3 t = Cross(q_v, v);
+		t = Add(t, t);
+		return Add(Add(v, Scale(t, q.w)), Cross(q_v, t));
+	}
+
+	//a * b, rotating by b first and then by a
+	LaneQuaternion Multiply(const LaneQuaternion& a, const LaneQuaternion& b) {
+		using namespace dx;
+		return {
+			XMVectorAdd(XMVectorMultiplyAdd(a.w, b.x, XMVectorMultiply(a.x, b.w)),
+				XMVectorSubtract(XMVectorMultiply(a.y, b.z), XMVectorMultiply(a.z, b.y))),
+			XMVectorAdd(XMVectorMultiplyAdd(a.w, b.y, XMVectorMultiply(a.y, b.w)),
+				XMVectorSubtract(XMVectorMultiply(a.z, b.x), XMVectorMultiply(a.x, b.z))),
+			XMVectorAdd(XMVectorMultiplyAdd(a.w, b.z, XMVectorMultiply(a.z, b.w)),
+				XMVectorSubtract(XMVectorMultiply(a.x, b.y), XMVectorMultiply(a.y, b.x))),
+			XMVectorSubtract(XMVectorMultiply(a.w, b.w),
+				XMVectorMultiplyAdd(a.x, b.x, XMVectorMultiplyAdd(a.y, b.y, XMVectorMultiply(a.z, b.z)))) };
+	}
+
+	LaneVector3 TransformNormal(const LaneMatrix& m, const LaneVector3& v) {
+		LaneVector3 result;
+		dx::XMVECTOR* out[3] = { &result.x, &result.y, &result.z };
+		for (unsigned int col = 0; col < 3; ++col) {
+			*out[col] = dx::XMVectorMultiplyAdd(v.x, m.m[0][col],
+				dx::XMVectorMultiplyAdd(v.y, m.m[1][col], dx::XMVectorMultiply(v.z, m.m[2][col])));
+		}
+		return result;
+	}
+
+	LaneVector3 TransformPoint(const LaneMatrix& m, const LaneVector3& v) {
+		LaneVector3 result = TransformNormal(m, v);
+		return { dx::XMVectorAdd(result.x, m.m[3][0]), dx::XMVectorAdd(result.y, m.m[3][1]),
+			dx::XMVectorAdd(result.z, m.m[3][2]) };
+	}
+
+	//One value per lane from each controller
+	template<class Func>
+	dx::XMVECTOR LoadLanes(IKController* const* controllers, Func get) {
+		return dx::XMVectorSet(get(*controllers[0]), get(*controllers[1]),
+			get(*controllers[2]), get(*controllers[3]));
+	}
+
+	//Per lane data of a chain, joints are indexed root to EE
+	struct LaneChain {
+		unsigned int joint_count;
+		//Shared by every lane
+		std::array<dx::XMFLOAT3, IKBatchSolver::max_chain_length> rot_axes;
+		std::array<dx::XMFLOAT3, IKBatchSolver::max_chain_length> offsets;
+		std::array<float, IKBatchSolver::max_chain_length> scales;
+		//One value per lane
+		std::array<dx::XMVECTOR, IKBatchSolver::max_chain_length> angles;
+		std::array<dx::XMVECTOR, IKBatchSolver::max_chain_length> min_angles;
+		std::array<dx::XMVECTOR, IKBatchSolver::max_chain_length> max_angles;
+		//Chain root's parent bone in world space
+		LaneMatrix parent_world;
+
+		//Evaluated by Evaluate
+		std::array<LaneVector3, IKBatchSolver::max_chain_length> positions;
+		std::array<LaneVector3, IKBatchSolver::max_chain_length> world_rot_axes;
+
+		/*
+		* Forward kinematics of the chain in every lane, as IKController::EvaluateChain
+		* Updates the joint positions and world rotation axes.
+		* Returns: LaneVector3 - EE position
+		*/
+		const LaneVector3& Evaluate() {
+			dx::XMVECTOR accumulated_scale = dx::XMVectorSplatOne();
+			LaneQuaternion accumulated_rotation = { dx::XMVectorZero(), dx::XMVectorZero(),
+				dx::XMVectorZero(), dx::XMVectorSplatOne() };
+			LaneVector3 accumulated_translation = { dx::XMVectorZero(), dx::XMVectorZero(), dx::XMVectorZero() };
+			for (unsigned int j = 0; j < joint_count; ++j) {
+				LaneVector3 axis = Replicate(rot_axes[j]);
+				//The joint rotates in its parent's frame
+				world_rot_axes[j] = Normalize(TransformNormal(parent_world, Rotate(accumulated_rotation, axis)));
+
+				//Concatenate the bone's scale, rotation about its axis and offset onto its parent
+				accumulated_translation = Add(accumulated_translation,
+					Scale(Rotate(accumulated_rotation, Replicate(offsets[j])), accumulated_scale));
+				positions[j] = TransformPoint(parent_world, accumulated_translation);
+
+				dx::XMVECTOR sin_half, cos_half;
+				dx::XMVectorSinCos(&sin_half, &cos_half, dx::XMVectorScale(angles[j], 0.5f));
+				LaneQuaternion local_rotation = { dx::XMVectorMultiply(axis.x, sin_half),
+					dx::XMVectorMultiply(axis.y, sin_half), dx::XMVectorMultiply(axis.z, sin_half), cos_half };
+				accumulated_rotation = Multiply(accumulated_rotation, local_rotation);
+				accumulated_scale = dx::XMVectorScale(accumulated_scale, scales[j]);
+			}
+			return positions[joint_count - 1];
+		}
+	};
+}
+
+bool IKBatchSolver::HasSameChain(const IKController& a, const IKController& b) {
+	if (a.p_base_animation != b.p_base_animation || a.p_skeleton != b.p_skeleton)
+		return false;
+	const IKController::manipulator& chain_a = a.manipulators[0];
+	const IKController::manipulator& chain_b = b.manipulators[0];
+	if (chain_a.size() != chain_b.size())
+		return false;
+	for (unsigned int j = 0; j < chain_a.size(); ++j) {
+		if (chain_a[j].bone_index != chain_b[j].bone_index)
+			return false;
+	}
+	return true;
+}
+
+void IKBatchSolver::Solve(const std::vector<IKController*>& controllers, float dt) {
+	lane_sets.clear();
+	separate_controllers.clear();
+
+	for (IKController* controller : controllers) {
+		bool lanes_possible = !controller->stop_animation &&
+			controller->manipulators.size() == 1 &&
+			controller->manipulators[0].size() <= max_chain_length &&
+			controller->solver_method == IKController::SolverMethod::DLS;
+		if (!lanes_possible) {
+			separate_controllers.push_back(controller);
+			continue;
+		}
+
+		//Fill up the last set with the same chain, there are only a few kinds of chains
+		auto set_iter = std::find_if(lane_sets.rbegin(), lane_sets.rend(), [&](const LaneSet& lane_set) {
+			return HasSameChain(*lane_set.controllers[0], *controller);
+		});
+		if (set_iter == lane_sets.rend() || set_iter->count == lane_count) {
+			LaneSet lane_set = {};
+			lane_set.controllers[0] = controller;
+			lane_set.count = 1;
+			lane_sets.push_back(lane_set);
+			continue;
+		}
+		set_iter->controllers[set_iter->count++] = controller;
+	}
+
+	//Characters don't share any data, every set and character is solved on its own thread
+	std::for_each(std::execution::par, lane_sets.begin(), lane_sets.end(),
+		[](const LaneSet& lane_set) {
+			SolveLanes(lane_set);
+		});
+	std::for_each(std::execution::par, separate_controllers.begin(), separate_controllers.end(),
+		[dt](IKController* controller) {
+			controller->Process(dt);
+		});
+}
+
+void IKBatchSolver::SolveLanes(const LaneSet& lane_set) {
+	auto start = std::chrono::steady_clock::now();
+
+	//Empty lanes repeat the first character and are never written back
+	IKController* lane_controllers[lane_count];
+	for (unsigned int lane = 0; lane < lane_count; ++lane) {
+		lane_controllers[lane] = lane_set.controllers[lane < lane_set.count ? lane : 0];
+	}
+
+	//The set is solved in one loop, it may take as long as the slowest character allows
+	float budget_us = 0.0f;
+	unsigned int max_iterations = 0;
+	for (unsigned int lane = 0; lane < lane_set.count; ++lane) {
+		budget_us = (std::max)(budget_us, lane_set.controllers[lane]->solve_budget_us);
+		max_iterations = (std::max)(max_iterations, lane_set.controllers[lane]->max_dls_iterations);
+	}
+	auto deadline = start + std::chrono::microseconds((long long)budget_us);
+
+	LaneChain lane_chain;
+	const IKController& first = *lane_set.controllers[0];
+	const IKController::manipulator& chain = first.manipulators[0];
+	lane_chain.joint_count = (unsigned int)chain.size();
+	for (unsigned int j = 0; j < lane_chain.joint_count; ++j) {
+		const VQS& animation_transform = first.p_base_animation->GetBaseTransform(chain[j].bone_index);
+		//XMQuaternionRotationAxis normalizes the axis as well
+		dx::XMStoreFloat3(&lane_chain.rot_axes[j], dx::XMVector3Normalize(chain[j].rot_axis));
+		lane_chain.offsets[j] = animation_transform.GetV();
+		lane_chain.scales[j] = animation_transform.GetS();
+
+		lane_chain.angles[j] = LoadLanes(lane_controllers, [j](const IKController& controller) {
+			return controller.manipulators[0][j].rot_angle; });
+		lane_chain.min_angles[j] = LoadLanes(lane_controllers, [j](const IKController& controller) {
+			return controller.manipulators[0][j].min_angle; });
+		lane_chain.max_angles[j] = LoadLanes(lane_controllers, [j](const IKController& controller) {
+			return controller.manipulators[0][j].max_angle; });
+	}
+
+	//Bones above the chain are not changed by IK
+	int parent_indx = first.p_skeleton->hierarchy[chain[0].bone_index]->parent_indx;
+	dx::XMFLOAT4X4 parent_worlds[lane_count];
+	for (unsigned int lane = 0; lane < lane_count; ++lane) {
+		const IKController& controller = *lane_controllers[lane];
+		dx::XMStoreFloat4x4(&parent_worlds[lane],
+			controller.bone_matrix_buffer[parent_indx] * controller.world_transform);
+	}
+	for (unsigned int row = 0; row < 4; ++row) {
+		for (unsigned int col = 0; col < 3; ++col) {
+			lane_chain.parent_world.m[row][col] = dx::XMVectorSet(parent_worlds[0].m[row][col],
+				parent_worlds[1].m[row][col], parent_worlds[2].m[row][col], parent_worlds[3].m[row][col]);
+		}
+	}
+
+	LaneVector3 target = {
+		LoadLanes(lane_controllers, [](const IKController& controller) {
+			return dx::XMVectorGetX(controller.target_position); }),
+		LoadLanes(lane_controllers, [](const IKController& controller) {
+			return dx::XMVectorGetY(controller.target_position); }),
+		LoadLanes(lane_controllers, [](const IKController& controller) {
+			return dx::XMVectorGetZ(controller.target_position); }) };
+	const dx::XMVECTOR threshold = LoadLanes(lane_controllers, [](const IKController& controller) {
+		return controller.distance_threshold; });
+	const dx::XMVECTOR damping_sq = LoadLanes(lane_controllers, [](const IKController& controller) {
+		return controller.dls_damping * controller.dls_damping; });
+	const dx::XMVECTOR max_step = LoadLanes(lane_controllers, [](const IKController& controller) {
+		return (float)controller.max_dls_step; });
+	const dx::XMVECTOR lane_max_iterations = LoadLanes(lane_controllers, [](const IKController& controller) {
+		return (float)controller.max_dls_iterations; });
+	const dx::XMVECTOR constrained = dx::XMVectorGreater(
+		LoadLanes(lane_controllers, [](const IKController& controller) {
+			return controller.apply_constraints ? 1.0f : 0.0f; }), dx::XMVectorZero());
+	const dx::XMVECTOR real_lanes = dx::XMVectorLess(dx::XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f),
+		dx::XMVectorReplicate((float)lane_set.count));
+
+	//Starts from the angles the previous frame converged to
+	LaneVector3 dP = Subtract(target, lane_chain.Evaluate());
+	dx::XMVECTOR residual = dx::XMVectorSqrt(Dot(dP, dP));
+	dx::XMVECTOR start_residual = residual;
+	dx::XMVECTOR iterations = dx::XMVectorZero();
+	std::array<dx::XMVECTOR, max_chain_length> dQ;
+	for (unsigned int iteration = 0; iteration < max_iterations; ++iteration) {
+		//Lanes still away from their targets with iterations left
+		dx::XMVECTOR active = dx::XMVectorAndInt(real_lanes, dx::XMVectorAndInt(
+			dx::XMVectorGreaterOrEqual(residual, threshold), dx::XMVectorLess(iterations, lane_max_iterations)));
+		if (dx::XMVector4EqualInt(active, dx::XMVectorZero()))
+			break;
+		//At least one iteration is always taken so every character makes progress
+		if (iteration > 0 && std::chrono::steady_clock::now() >= deadline)
+			break;
+
+		//Columns of the Jacobian and J J^T + damping^2 I, symmetric
+		dx::XMVECTOR a00 = damping_sq, a11 = damping_sq, a22 = damping_sq;
+		dx::XMVECTOR a01 = dx::XMVectorZero(), a02 = dx::XMVectorZero(), a12 = dx::XMVectorZero();
+		std::array<LaneVector3, max_chain_length> columns;
+		const LaneVector3& ee_position = lane_chain.positions[lane_chain.joint_count - 1];
+		for (unsigned int j = 0; j < lane_chain.joint_count; ++j) {
+			LaneVector3& c = columns[j];
+			c = Cross(lane_chain.world_rot_axes[j], Subtract(ee_position, lane_chain.positions[j]));
+			a00 = dx::XMVectorMultiplyAdd(c.x, c.x, a00);
+			a11 = dx::XMVectorMultiplyAdd(c.y, c.y, a11);
+			a22 = dx::XMVectorMultiplyAdd(c.z, c.z, a22);
+			a01 = dx::XMVectorMultiplyAdd(c.x, c.y, a01);
+			a02 = dx::XMVectorMultiplyAdd(c.x, c.z, a02);
+			a12 = dx::XMVectorMultiplyAdd(c.y, c.z, a12);
+		}
+
+		//y = (J J^T + damping^2 I)^-1 dP with the cofactors, the damping keeps it invertible
+		dx::XMVECTOR cofactor_00 = dx::XMVectorSubtract(dx::XMVectorMultiply(a11, a22), dx::XMVectorMultiply(a12, a12));
+		dx::XMVECTOR cofactor_01 = dx::XMVectorSubtract(dx::XMVectorMultiply(a12, a02), dx::XMVectorMultiply(a01, a22));
+		dx::XMVECTOR cofactor_02 = dx::XMVectorSubtract(dx::XMVectorMultiply(a01, a12), dx::XMVectorMultiply(a11, a02));
+		dx::XMVECTOR cofactor_11 = dx::XMVectorSubtract(dx::XMVectorMultiply(a00, a22), dx::XMVectorMultiply(a02, a02));
+		dx::XMVECTOR cofactor_12 = dx::XMVectorSubtract(dx::XMVectorMultiply(a02, a01), dx::XMVectorMultiply(a00, a12));
+		dx::XMVECTOR cofactor_22 = dx::XMVectorSubtract(dx::XMVectorMultiply(a00, a11), dx::XMVectorMultiply(a01, a01));
+		dx::XMVECTOR det = dx::XMVectorMultiplyAdd(a00, cofactor_00,
+			dx::XMVectorMultiplyAdd(a01, cofactor_01, dx::XMVectorMultiply(a02, cofactor_02)));
+		dx::XMVECTOR inv_det = dx::XMVectorReciprocal(det);
+		LaneVector3 y = {
+			dx::XMVectorMultiplyAdd(cofactor_00, dP.x, dx::XMVectorMultiplyAdd(cofactor_01, dP.y, dx::XMVectorMultiply(cofactor_02, dP.z))),
+			dx::XMVectorMultiplyAdd(cofactor_01, dP.x, dx::XMVectorMultiplyAdd(cofactor_11, dP.y, dx::XMVectorMultiply(cofactor_12, dP.z))),
+			dx::XMVectorMultiplyAdd(cofactor_02, dP.x, dx::XMVectorMultiplyAdd(cofactor_12, dP.y, dx::XMVectorMultiply(cofactor_22, dP.z))) };
+		y = Scale(y, inv_det);
+
+		//dQ = J^T y, limited so the linear approximation holds
+		dx::XMVECTOR largest_step = dx::XMVectorZero();
+		for (unsigned int j = 0; j < lane_chain.joint_count; ++j) {
+			dQ[j] = Dot(columns[j], y);
+			largest_step = dx::XMVectorMax(largest_step, dx::XMVectorAbs(dQ[j]));
+		}
+		dx::XMVECTOR step_scale = dx::XMVectorSelect(dx::XMVectorSplatOne(),
+			dx::XMVectorDivide(max_step, largest_step), dx::XMVectorGreater(largest_step, max_step));
+		//Lanes that are done keep their angles
+		step_scale = dx::XMVectorSelect(dx::XMVectorZero(), step_scale, active);
+		for (unsigned int j = 0; j < lane_chain.joint_count; ++j) {
+			dx::XMVECTOR angle = dx::XMVectorMultiplyAdd(dQ[j], step_scale, lane_chain.angles[j]);
+			lane_chain.angles[j] = dx::XMVectorSelect(angle,
+				dx::XMVectorClamp(angle, lane_chain.min_angles[j], lane_chain.max_angles[j]), constrained);
+		}
+
+		dP = Subtract(target, lane_chain.Evaluate());
+		residual = dx::XMVectorSelect(residual, dx::XMVectorSqrt(Dot(dP, dP)), active);
+		iterations = dx::XMVectorAdd(iterations, dx::XMVectorSelect(dx::XMVectorZero(), dx::XMVectorSplatOne(), active));
+	}
+
+	float time_us = std::chrono::duration<float, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+	for (unsigned int lane = 0; lane < lane_set.count; ++lane) {
+		IKController& controller = *lane_set.controllers[lane];
+		IKController::manipulator& lane_joints = controller.manipulators[0];
+		for (unsigned int j = 0; j < lane_chain.joint_count; ++j) {
+			lane_joints[j].rot_angle = dx::XMVectorGetByIndex(lane_chain.angles[j], lane);
+		}
+
+		IKController::SolveStats& stats = controller.solve_stats[0];
+		stats.iterations = (unsigned int)dx::XMVectorGetByIndex(iterations, lane);
+		stats.start_residual = dx::XMVectorGetByIndex(start_residual, lane);
+		stats.end_residual = dx::XMVectorGetByIndex(residual, lane);
+		stats.converged = stats.end_residual < controller.distance_threshold;
+		stats.time_us = time_us;
+
+		controller.current_frame--;
+		controller.ProcessAnimation();
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include "IKinematics.h"
+
+/*
+* Solves the IK of many characters together.
+* Characters with a single manipulator over the same bones of the same base
+* animation are solved lane_count at a time, one character per SIMD lane,
+* with damped least squares. Everything else is solved by its own
+* IKController. Both run in parallel across threads.
+* A set of lanes iterates until its slowest character converges or the
+* largest time budget in the set runs out, the other settings are per character.
+*/
+class IKBatchSolver
+{
+public:
+	//Characters per SIMD solve, the width of an XMVECTOR
+	static const unsigned int lane_count = 4;
+	//Longer chains are solved separately
+	static const unsigned int max_chain_length = 32;
+private:
+	//Characters sharing a chain, in sets of up to lane_count
+	struct LaneSet {
+		IKController* controllers[lane_count];
+		unsigned int count;
+	};
+	std::vector<LaneSet> lane_sets;
+	std::vector<IKController*> separate_controllers;
+
+	//True if both controllers have one manipulator over the same bones of the same animation
+	static bool HasSameChain(const IKController& a, const IKController& b);
+
+	//Solves up to lane_count characters with the same chain in the SIMD lanes
+	static void SolveLanes(const LaneSet& lane_set);
+public:
+	/*
+	* Solves the manipulators of every controller and updates their bone buffers.
+	* The controllers' Update has to be called first for the model transforms.
+	*/
+	void Solve(const std::vector<IKController*>& controllers, float dt);
+};
@@ -0,0 +1,384 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include "IKBenchmark.h"
+#include "FBXLoader.h"
+
+#ifdef IK_BENCHMARK_COUNT_ALLOCATIONS
+/*
+* Allocations made by the thread, counted by the replaced operator new.
+* The replacement applies to the whole program, so it is only
+* compiled into builds that define IK_BENCHMARK_COUNT_ALLOCATIONS.
+*/
+static thread_local unsigned long long allocation_count = 0;
+
+void* operator new(std::size_t size) {
+	allocation_count++;
+	if (void* p = std::malloc(size != 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+static unsigned long long GetAllocationCount() {
+	return allocation_count;
+}
+#else
+static unsigned long long GetAllocationCount() {
+	return 0;
+}
+#endif
+
+IKBenchmark::IKBenchmark(Skeleton* _p_skeleton, Animation* _p_animation, int _end_effector_index) :
+	p_skeleton(_p_skeleton), p_animation(_p_animation), end_effector_indices(1, _end_effector_index) {
+}
+
+void IKBenchmark::AddEndEffector(int end_effector_index) {
+	end_effector_indices.push_back(end_effector_index);
+}
+
+//Adds a bone with a single key frame of the given transform
+//Returns: int - index of the bone
+static int AddSyntheticBone(Skeleton& skeleton, Animation& animation, int parent_index,
+	const dx::XMFLOAT3& translation, dx::FXMVECTOR rotation) {
+	int bone_index = (int)skeleton.hierarchy.size();
+	skeleton.hierarchy.push_back(new Bone(bone_index, parent_index, VQS(), VQS()));
+
+	KeyFrame key_frame;
+	key_frame.time = 0.0;
+	key_frame.transform = VQS(translation, Quaternion(rotation), 1.0f);
+	Track track;
+	track.key_frames.push_back(key_frame);
+	animation.tracks.push_back(track);
+	return bone_index;
+}
+
+//Slight bend of the i'th bone about alternating axes so its rotation axis is defined
+static dx::XMVECTOR GetSyntheticBend(unsigned int i, float side) {
+	dx::XMVECTOR axis = dx::XMVectorSet(i % 2 ? 0.3f : 0.0f, 0.2f, 1.0f, 0.0f);
+	return dx::XMQuaternionRotationAxis(dx::XMVector3Normalize(axis), side * 0.3f);
+}
+
+void IKBenchmark::BuildSyntheticChain(unsigned int bone_count, float bone_length,
+	Skeleton& skeleton, Animation& animation) {
+	//The root stays at the origin
+	AddSyntheticBone(skeleton, animation, -1, dx::XMFLOAT3(0.0f, 0.0f, 0.0f), dx::XMQuaternionIdentity());
+	for (unsigned int i = 1; i <= bone_count; ++i) {
+		AddSyntheticBone(skeleton, animation, (int)i - 1,
+			dx::XMFLOAT3(0.0f, bone_length, 0.0f), GetSyntheticBend(i, 1.0f));
+	}
+	skeleton.Initialize();
+}
+
+void IKBenchmark::BuildSyntheticBranches(unsigned int shared_bone_count, unsigned int branch_bone_count,
+	float bone_length, Skeleton& skeleton, Animation& animation,
+	int& first_end_effector, int& second_end_effector) {
+	AddSyntheticBone(skeleton, animation, -1, dx::XMFLOAT3(0.0f, 0.0f, 0.0f), dx::XMQuaternionIdentity());
+	for (unsigned int i = 1; i <= shared_bone_count; ++i) {
+		AddSyntheticBone(skeleton, animation, (int)i - 1,
+			dx::XMFLOAT3(0.0f, bone_length, 0.0f), GetSyntheticBend(i, 1.0f));
+	}
+
+	//The arms start on either side of the top of the spine and bend away from each other
+	int* end_effectors[2] = { &first_end_effector, &second_end_effector };
+	for (unsigned int arm = 0; arm < 2; ++arm) {
+		float side = arm == 0 ? 1.0f : -1.0f;
+		int parent_index = (int)shared_bone_count;
+		for (unsigned int i = 1; i <= branch_bone_count; ++i) {
+			dx::XMFLOAT3 translation = i == 1 ?
+				dx::XMFLOAT3(side * bone_length, 0.0f, 0.0f) : dx::XMFLOAT3(0.0f, bone_length, 0.0f);
+			parent_index = AddSyntheticBone(skeleton, animation, parent_index,
+				translation, GetSyntheticBend(i, side));
+		}
+		*end_effectors[arm] = parent_index;
+	}
+	skeleton.Initialize();
+}
+
+std::vector<IKBenchmark::Mode> IKBenchmark::GetDefaultModes() {
+	return {
+		{ "Jacobian", IKController::SolverMethod::JACOBIAN, false, false },
+		{ "Jacobian constrained", IKController::SolverMethod::JACOBIAN, true, false },
+		{ "DLS", IKController::SolverMethod::DLS, true, false },
+		{ "DLS two bone", IKController::SolverMethod::DLS, true, true },
+		{ "CCD", IKController::SolverMethod::CCD, true, false },
+		{ "FABRIK", IKController::SolverMethod::FABRIK, true, false }
+	};
+}
+
+std::vector<IKBenchmark::Mode> IKBenchmark::GetMultiEffectorModes() {
+	return {
+		{ "Stacked DLS", IKController::SolverMethod::DLS, true, false, true },
+		{ "DLS per chain", IKController::SolverMethod::DLS, true, false, false },
+		{ "FABRIK per chain", IKController::SolverMethod::FABRIK, true, false, false }
+	};
+}
+
+void IKBenchmark::SetupController(IKController& controller, const Mode& mode) const {
+	controller.SetSkel(p_skeleton);
+	controller.SetBaseAnimation(p_animation);
+	controller.SetModelTransform(dx::XMVectorZero(), dx::XMMatrixIdentity());
+	for (int end_effector_index : end_effector_indices) {
+		controller.AddEndEffector(end_effector_index);
+	}
+	if (right_arm_constraints) {
+		controller.GenerateDefaultRightArmConstraints(0);
+	}
+	else {
+		for (unsigned int i = 0; i < controller.manipulators.size(); ++i) {
+			for (auto& joint : controller.manipulators[i]) {
+				joint.min_angle = joint.rot_angle - joint_limit;
+				joint.max_angle = joint.rot_angle + joint_limit;
+			}
+			//The chains end in two hinges like an arm
+			controller.two_bone_limbs[i] = true;
+		}
+	}
+	controller.solver_method = mode.method;
+	controller.apply_constraints = mode.apply_constraints;
+	controller.use_two_bone = mode.use_two_bone;
+	controller.solve_effectors_together = mode.solve_effectors_together;
+}
+
+void IKBenchmark::GenerateTargets(std::vector<dx::XMFLOAT3>& reachable,
+	std::vector<dx::XMFLOAT3>& unreachable) const {
+	IKController controller;
+	SetupController(controller, GetDefaultModes()[0]);
+
+	//Reach is the length of each chain from its first joint
+	std::vector<dx::XMVECTOR> root_positions;
+	std::vector<float> reaches;
+	for (const auto& chain : controller.manipulators) {
+		root_positions.push_back(chain[0].position);
+		float reach = 0.0f;
+		for (unsigned int j = 1; j < chain.size(); ++j) {
+			reach += dx::XMVectorGetX(dx::XMVector3Length(
+				dx::XMVectorSubtract(chain[j].position, chain[j - 1].position)));
+		}
+		reaches.push_back(reach);
+	}
+
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	for (unsigned int i = 0; i < target_count; ++i) {
+		for (auto& chain : controller.manipulators) {
+			for (auto& joint : chain) {
+				joint.rot_angle = joint.min_angle + unit(generator) * (joint.max_angle - joint.min_angle);
+			}
+		}
+		//Bones shared by several chains take one of the angles
+		controller.SyncStackedJoints();
+
+		dx::XMFLOAT3 target;
+		for (unsigned int m = 0; m < controller.manipulators.size(); ++m) {
+			dx::XMStoreFloat3(&target, controller.EvaluateChain(m));
+			reachable.push_back(target);
+		}
+		for (unsigned int m = 0; m < controller.manipulators.size(); ++m) {
+			dx::XMVECTOR direction = dx::XMVector3Normalize(
+				dx::XMVectorSet(normal(generator), normal(generator), normal(generator), 0.0f));
+			dx::XMStoreFloat3(&target, dx::XMVectorAdd(root_positions[m],
+				dx::XMVectorScale(direction, reaches[m] * (1.2f + unit(generator)))));
+			unreachable.push_back(target);
+		}
+	}
+}
+
+//Returns: float - distance from the furthest EE to its target
+static float GetEffectorError(IKController& controller) {
+	float error = 0.0f;
+	for (unsigned int m = 0; m < controller.manipulators.size(); ++m) {
+		error = (std::max)(error, dx::XMVectorGetX(dx::XMVector3Length(
+			dx::XMVectorSubtract(controller.GetEffectorTarget(m), controller.EvaluateChain(m)))));
+	}
+	return error;
+}
+
+IKBenchmark::Result IKBenchmark::RunTargets(const Mode& mode, const std::vector<dx::XMFLOAT3>& targets,
+	bool reachable) const {
+	unsigned int effector_count = (unsigned int)end_effector_indices.size();
+	Result result;
+	result.mode_name = mode.name;
+	result.reachable = reachable;
+	result.target_count = (unsigned int)targets.size() / effector_count;
+
+	IKController controller;
+	SetupController(controller, mode);
+	std::vector<float> base_angles;
+	for (const auto& chain : controller.manipulators) {
+		for (const auto& joint : chain) {
+			base_angles.push_back(joint.rot_angle);
+		}
+	}
+	bool solved_together = effector_count > 1 && mode.solve_effectors_together;
+
+	unsigned long long total_solves = 0;
+	unsigned long long total_iterations = 0;
+	unsigned long long total_allocations = 0;
+	unsigned long long converged_solves = 0;
+	double total_time_us = 0.0;
+	double total_error = 0.0;
+	for (unsigned int t = 0; t < result.target_count; ++t) {
+		//Every target starts from the base pose
+		unsigned int angle_indx = 0;
+		for (auto& chain : controller.manipulators) {
+			for (auto& joint : chain) {
+				joint.rot_angle = base_angles[angle_indx++];
+			}
+		}
+		controller.InvalidateChains();
+		for (unsigned int m = 0; m < effector_count; ++m) {
+			const dx::XMFLOAT3& target = targets[t * effector_count + m];
+			controller.SetEffectorTarget(m, dx::XMVectorSet(target.x, target.y, target.z, 1.0f));
+		}
+
+		float error = GetEffectorError(controller);
+		unsigned int solves = 0;
+		unsigned int stalled = 0;
+		while (error >= controller.distance_threshold && solves < max_solves && stalled < stall_solves) {
+			unsigned long long allocations_before = GetAllocationCount();
+			auto start = std::chrono::steady_clock::now();
+			controller.Process(dt);
+			float time_us = std::chrono::duration<float, std::micro>(
+				std::chrono::steady_clock::now() - start).count();
+			total_allocations += GetAllocationCount() - allocations_before;
+			total_time_us += time_us;
+			result.max_time_per_solve_us = (std::max)(result.max_time_per_solve_us, time_us);
+			solves++;
+
+			bool has_stats = mode.method == IKController::SolverMethod::DLS ||
+				mode.method == IKController::SolverMethod::FABRIK || solved_together;
+			if (!has_stats)
+				total_iterations += 1;
+			else if (solved_together)
+				total_iterations += controller.solve_stats[0].iterations;
+			else {
+				for (const auto& stats : controller.solve_stats) {
+					total_iterations += stats.iterations;
+				}
+			}
+
+			float new_error = GetEffectorError(controller);
+			stalled = error - new_error < stall_tolerance * error ? stalled + 1 : 0;
+			error = new_error;
+		}
+
+		total_solves += solves;
+		total_error += error;
+		result.max_final_error = (std::max)(result.max_final_error, error);
+		if (error < controller.distance_threshold) {
+			result.converged_count++;
+			converged_solves += solves;
+			result.max_solves = (std::max)(result.max_solves, solves);
+		}
+	}
+
+	if (result.converged_count > 0)
+		result.mean_solves = (float)converged_solves / result.converged_count;
+	if (result.target_count > 0) {
+		result.mean_iterations = (float)total_iterations / result.target_count;
+		result.mean_final_error = (float)(total_error / result.target_count);
+	}
+	if (total_solves > 0) {
+		result.mean_time_per_solve_us = (float)(total_time_us / total_solves);
+	}
+#ifdef IK_BENCHMARK_COUNT_ALLOCATIONS
+	result.allocations_per_solve = total_solves > 0 ? (float)total_allocations / total_solves : 0.0f;
+#endif
+	return result;
+}
+
+std::vector<IKBenchmark::Result> IKBenchmark::Run(const std::vector<Mode>& modes) {
+	std::vector<dx::XMFLOAT3> reachable, unreachable;
+	GenerateTargets(reachable, unreachable);
+
+	std::vector<Result> results;
+	for (const auto& mode : modes) {
+		results.push_back(RunTargets(mode, reachable, true));
+		results.push_back(RunTargets(mode, unreachable, false));
+	}
+	return results;
+}
+
+void IKBenchmark::PrintResults(const std::vector<Result>& results) {
+	printf("%-22s %-11s %9s %11s %9s %11s %11s %11s %11s %11s\n", "Mode", "Targets", "Converged",
+		"Mean Solves", "Max Solves", "Mean Iters", "Mean Error", "Max Error", "Mean us", "Allocs");
+	for (const auto& result : results) {
+		printf("%-22s %-11s %4u/%-4u %11.1f %9u %11.1f %11.3f %11.3f %11.2f %11.2f\n",
+			result.mode_name, result.reachable ? "reachable" : "unreachable",
+			result.converged_count, result.target_count, result.mean_solves, result.max_solves,
+			result.mean_iterations, result.mean_final_error, result.max_final_error,
+			result.mean_time_per_solve_us, result.allocations_per_solve);
+	}
+}
+
+bool IKBenchmark::WriteResults(const std::vector<Result>& results, const char* file_name) {
+	FILE* file = nullptr;
+	if (fopen_s(&file, file_name, "w") != 0 || file == nullptr)
+		return false;
+
+	fprintf(file, "mode,reachable,targets,converged,mean_solves,max_solves,mean_iterations,"
+		"mean_final_error,max_final_error,mean_time_per_solve_us,max_time_per_solve_us,allocations_per_solve\n");
+	for (const auto& result : results) {
+		fprintf(file, "%s,%d,%u,%u,%f,%u,%f,%f,%f,%f,%f,%f\n",
+			result.mode_name, result.reachable ? 1 : 0, result.target_count, result.converged_count,
+			result.mean_solves, result.max_solves, result.mean_iterations,
+			result.mean_final_error, result.max_final_error,
+			result.mean_time_per_solve_us, result.max_time_per_solve_us, result.allocations_per_solve);
+	}
+	fclose(file);
+	return true;
+}
+
+int IKBenchmark::RunFromCommandLine(const char* command_line) {
+	std::vector<Result> results;
+	if (strstr(command_line, "--ik-benchmark-fbx")) {
+		//The right arm of the model used by Project_IK
+		FBXLoader fbx_loader;
+		if (!fbx_loader.ExtractSceneData() || fbx_loader.animations.empty())
+			return 1;
+		Skeleton skeleton;
+		skeleton.ConvertFromFbx(&fbx_loader.skele);
+		skeleton.Initialize();
+		Animation animation;
+		animation.ConvertFromFbx(fbx_loader.animations[0]);
+
+		int right_hand_index = 17;
+		IKBenchmark benchmark(&skeleton, &animation, right_hand_index);
+		benchmark.right_arm_constraints = true;
+		results = benchmark.Run(GetDefaultModes());
+	}
+	else {
+		Skeleton skeleton;
+		Animation animation;
+		unsigned int bone_count = 6;
+		BuildSyntheticChain(bone_count, 30.0f, skeleton, animation);
+		IKBenchmark benchmark(&skeleton, &animation, bone_count);
+		results = benchmark.Run(GetDefaultModes());
+
+		//Two arms sharing the spine, solved at the same time
+		Skeleton branched_skeleton;
+		Animation branched_animation;
+		int first_end_effector, second_end_effector;
+		BuildSyntheticBranches(2, 4, 30.0f, branched_skeleton, branched_animation,
+			first_end_effector, second_end_effector);
+		IKBenchmark multi_benchmark(&branched_skeleton, &branched_animation, first_end_effector);
+		multi_benchmark.AddEndEffector(second_end_effector);
+		std::vector<Result> multi_results = multi_benchmark.Run(GetMultiEffectorModes());
+		results.insert(results.end(), multi_results.begin(), multi_results.end());
+	}
+
+	PrintResults(results);
+	WriteResults(results, "ik_benchmark.csv");
+	return 0;
+}
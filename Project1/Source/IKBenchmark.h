@@ -0,0 +1,119 @@
+#pragma once
+#include <vector>
+#include "IKinematics.h"
+
+/*
+* Headless benchmark of IKController convergence and cost.
+* Every solver mode is run on the same randomized targets, ones sampled from
+* poses within the joint limits and ones beyond the reach of the chain.
+* For every target the controller starts from the base pose and Process is
+* called until the EE is within distance_threshold, stops improving or
+* max_solves is reached.
+* With more than one end effector every target sets all of them at once,
+* and the error is that of the furthest EE.
+*/
+class IKBenchmark
+{
+public:
+	struct Mode {
+		const char* name;
+		IKController::SolverMethod method;
+		bool apply_constraints;
+		bool use_two_bone;
+		//Only used with more than one end effector
+		bool solve_effectors_together = true;
+	};
+
+	//Results of one mode over one set of targets
+	struct Result {
+		const char* mode_name;
+		bool reachable;
+		unsigned int target_count = 0;
+		unsigned int converged_count = 0;
+		//Process calls until the EE was within distance_threshold, of the converged targets
+		float mean_solves = 0.0f;
+		unsigned int max_solves = 0;
+		//Solver iterations of all the Process calls, Process calls for the Jacobian and CCD
+		float mean_iterations = 0.0f;
+		float mean_final_error = 0.0f;
+		float max_final_error = 0.0f;
+		float mean_time_per_solve_us = 0.0f;
+		float max_time_per_solve_us = 0.0f;
+		//Only counted in builds that define IK_BENCHMARK_COUNT_ALLOCATIONS, -1 otherwise
+		float allocations_per_solve = -1.0f;
+	};
+
+	//Targets of each kind per mode
+	unsigned int target_count = 100;
+	//Process calls per target before giving up
+	unsigned int max_solves = 600;
+	//Improvement per Process call, relative to the error, below which the solve has stalled
+	float stall_tolerance = 1e-4f;
+	//Consecutive stalled Process calls before moving on to the next target
+	unsigned int stall_solves = 10;
+	//Frame time passed to Process, the Jacobian steps are scaled by it
+	float dt = 1.0f / 60.0f;
+	unsigned int seed = 1;
+	//Joint limits around the base angle when no limits are set up
+	float joint_limit = dx::XM_PIDIV2;
+	//Use IKController::GenerateDefaultRightArmConstraints instead of joint_limit
+	bool right_arm_constraints = false;
+
+	IKBenchmark(Skeleton* _p_skeleton, Animation* _p_animation, int _end_effector_index);
+
+	//Adds another end effector solved together with the first one
+	void AddEndEffector(int end_effector_index);
+
+	/*
+	* Builds a chain of bone_count bones of bone_length, each bent slightly
+	* about alternating axes so every joint has a rotation axis.
+	*/
+	static void BuildSyntheticChain(unsigned int bone_count, float bone_length,
+		Skeleton& skeleton, Animation& animation);
+
+	/*
+	* Builds a spine of shared_bone_count bones that splits into two arms of
+	* branch_bone_count bones, bending to either side.
+	* The end effector of each arm is written to first_end_effector and second_end_effector.
+	*/
+	static void BuildSyntheticBranches(unsigned int shared_bone_count, unsigned int branch_bone_count,
+		float bone_length, Skeleton& skeleton, Animation& animation,
+		int& first_end_effector, int& second_end_effector);
+
+	//Jacobian with and without constraints, DLS with and without the two bone solve, CCD and FABRIK
+	static std::vector<Mode> GetDefaultModes();
+
+	//Stacked damped least squares against DLS and FABRIK solving chain by chain
+	static std::vector<Mode> GetMultiEffectorModes();
+
+	//Returns: vector<Result> - a reachable and an unreachable result per mode
+	std::vector<Result> Run(const std::vector<Mode>& modes);
+
+	static void PrintResults(const std::vector<Result>& results);
+
+	//Writes the results as comma separated values
+	static bool WriteResults(const std::vector<Result>& results, const char* file_name);
+
+	/*
+	* Runs the benchmark with the default modes and prints the results.
+	* "--ik-benchmark-fbx" in the command line uses the right arm of the
+	* cooked model instead of a synthetic chain.
+	* The synthetic benchmark also runs the multi effector modes on two arms.
+	* Returns: int - exit code
+	*/
+	static int RunFromCommandLine(const char* command_line);
+private:
+	Skeleton* p_skeleton;
+	Animation* p_animation;
+	std::vector<int> end_effector_indices;
+
+	void SetupController(IKController& controller, const Mode& mode) const;
+
+	/*
+	* Reachable targets from random poses within the limits, unreachable ones beyond the chain's reach.
+	* The targets of all end effectors are stored one after the other for every pose.
+	*/
+	void GenerateTargets(std::vector<dx::XMFLOAT3>& reachable, std::vector<dx::XMFLOAT3>& unreachable) const;
+
+	Result RunTargets(const Mode& mode, const std::vector<dx::XMFLOAT3>& targets, bool reachable) const;
+};
@@ -1,4 +1,7 @@
+#include <cfloat>
+#include <limits>
 #include "IKinematics.h"
+#include "FixedJacobianSolver.h"
 #include "imgui/imgui.h"
 
 IKController::Joint* IKController::GetJoint(int manipulator_index, int bone_index) {
@@ -9,7 +12,31 @@ IKController::Joint* IKController::GetJoint(int manipulator_index, int bone_inde
     return nullptr;
 }
 
-IKController::IKController() : animation_time(0.0f), animation_speed(1.0f),
+IKController::Joint* IKController::FindJoint(int bone_index) {
+    int column = bone_columns[bone_index];
+    if (column == -1)
+        return nullptr;
+    return &manipulators[stacked_joints[column].first][stacked_joints[column].second];
+}
+
+dx::XMVECTOR IKController::GetEffectorTarget(unsigned int manipulator_indx) const {
+    if (manipulator_indx == 0 || manipulator_indx >= effector_targets.size())
+        return target_position;
+    return effector_targets[manipulator_indx];
+}
+
+bool IKController::SetEffectorTarget(unsigned int manipulator_indx, dx::XMVECTOR target) {
+    if (manipulator_indx >= effector_targets.size())
+        return false;
+    if (manipulator_indx == 0)
+        target_position = target;
+    effector_targets[manipulator_indx] = target;
+    return true;
+}
+
+IKController::IKController() : base_model_position(dx::XMVectorZero()),
+    base_model_rotation(dx::XMMatrixIdentity()), world_transform(dx::XMMatrixIdentity()),
+    animation_time(0.0f), animation_speed(1.0f),
     p_skeleton(nullptr), p_base_animation(nullptr), target_position() {
 }
 
@@ -19,19 +46,37 @@ IKController::~IKController() {
 
 void IKController::Update(float dt, dx::XMVECTOR _model_pos, dx::XMMATRIX _model_rot) {
     animation_time += dt * animation_speed;
+    SetModelTransform(_model_pos, _model_rot);
+    if (show_controls)
+        ShowIKControls();
+}
+
+void IKController::SetModelTransform(dx::XMVECTOR _model_pos, dx::XMMATRIX _model_rot) {
     base_model_position = _model_pos;
     base_model_rotation = _model_rot;
-    ShowIKControls();
+    world_transform = dx::XMMatrixMultiply(base_model_rotation,
+        dx::XMMatrixTranslationFromVector(base_model_position));
+    InvalidateChains();
+}
+
+void IKController::InvalidateChains() {
+    for (auto& chain : manipulators) {
+        for (auto& joint : chain) {
+            joint.evaluated_angle = std::numeric_limits<float>::quiet_NaN();
+        }
+    }
 }
 
 void IKController::Process(float dt) {
-    ProcessAnimation();
+    //Bones above the chains don't depend on the solve, last frame's transforms are used
     ProcessManipulators(dt);
+    ProcessAnimation();
 }
 
 void IKController::SetSkel(Skeleton* skel) {
     p_skeleton = skel;
     bone_matrix_buffer.resize(p_skeleton->hierarchy.size());
+    bone_columns.assign(p_skeleton->hierarchy.size(), -1);
 }
 
 void IKController::SetBaseAnimation(Animation* p_anim) {
@@ -74,38 +119,83 @@ void IKController::AddManipulatorForEE(Bone* _end_effector) {
         dx::XMMATRIX modelTransform = local_transform * parent_transform;
 
         //Get the position by applying the transform
-        curr_joint.position = dx::XMVector3Transform(origin,
-            modelTransform *
-            dx::XMMatrixMultiply(base_model_rotation,
-                dx::XMMatrixTranslationFromVector(base_model_position)));
+        curr_joint.position = dx::XMVector3Transform(origin, modelTransform * world_transform);
         //Get the rotation axis
         dx::XMQuaternionToAxisAngle(
             &curr_joint.rot_axis, &curr_joint.rot_angle, curr_vqs.GetQ().toVector());
+        curr_joint.evaluated_angle = std::numeric_limits<float>::quiet_NaN();
 
         //The parent_transform for the next iteration is the current model_transform
         parent_transform = modelTransform;
 
         //Add the joint to the manipulator
         curr_joint.bone_index = curr_bone->bone_indx;
+        curr_joint.min_angle = -dx::XM_2PI;
+        curr_joint.max_angle = dx::XM_2PI;
+        curr_joint.final_angle = curr_joint.rot_angle;
+        curr_joint.flexibility = 1.0f;
+        //A bone already in another chain keeps its angle and limits
+        Joint* shared_joint = FindJoint(curr_joint.bone_index);
+        if (shared_joint) {
+            curr_joint.rot_angle = shared_joint->rot_angle;
+            curr_joint.min_angle = shared_joint->min_angle;
+            curr_joint.max_angle = shared_joint->max_angle;
+            curr_joint.final_angle = shared_joint->final_angle;
+            curr_joint.flexibility = shared_joint->flexibility;
+        }
         new_manipulator.push_back(curr_joint);
     }
 
     manipulators.push_back(new_manipulator);
+    solve_stats.push_back(SolveStats());
+    effector_targets.push_back(target_position);
+    two_bone_limbs.push_back(false);
+    BuildStackedColumns();
 }
 
 void IKController::ProcessManipulators(float dt) {
     if (stop_animation)
         return;
 
+    //The budget is shared by all the manipulators of the character
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::microseconds((long long)solve_budget_us);
+    if (solve_effectors_together && manipulators.size() > 1) {
+        ProcessStacked(deadline);
+        current_frame--;
+        return;
+    }
+
     for (unsigned int i = 0; i < manipulators.size(); ++i) {
-        dx::XMVECTOR Pc = EvalulateManipulator(i);
-        dx::XMVECTOR diff_vector = dx::XMVectorSubtract(target_position, Pc);
+        //The limb alone is often enough, otherwise the general solvers take over
+        if (use_two_bone && two_bone_limbs[i] && ProcessTwoBone(i))
+            continue;
+
+        if (solver_method == SolverMethod::DLS) {
+            ProcessDLS(i, deadline);
+            continue;
+        }
+        if (solver_method == SolverMethod::FABRIK) {
+            ProcessFABRIK(i);
+            continue;
+        }
+
+        dx::XMVECTOR Pc = EvaluateChain(i);
+        dx::XMVECTOR diff_vector = dx::XMVectorSubtract(GetEffectorTarget(i), Pc);
         float distance_check = dx::XMVectorGetX(dx::XMVector3Length(diff_vector));
         if (distance_check < distance_threshold)
             continue;
 
-        if (jacobian) {
+        if (solver_method == SolverMethod::JACOBIAN) {
             dx::XMVECTOR dP = diff_vector;
+            double fixed_dQ[max_fixed_chain_length];
+            if (GetFixedJacobianStep(i, Pc, dP, 0.0f, fixed_dQ)) {
+                for (unsigned int j = 0; j < manipulators[i].size() - 1; ++j) {
+                    manipulators[i][j].rot_angle += (fixed_dQ[j] * dt);
+                }
+                continue;
+            }
+
             arma::mat J = GetJacobian(i);
             arma::mat pseudo_J = GetPesudoJacobian(J);
             arma::mat dP_mat(3, 1);
@@ -137,13 +227,487 @@ void IKController::ProcessManipulators(float dt) {
     current_frame--;
 }
 
+template<unsigned int N>
+static void GetFixedStep(const IKController::manipulator& chain, dx::XMVECTOR ee_position, dx::XMVECTOR dP,
+    bool apply_constraints, float weight_factor, float damping, double* dQ) {
+    typename FixedJacobianSolver<N>::JointVector step;
+    bool solved = damping > 0.0f ?
+        FixedJacobianSolver<N>::SolveDamped(chain.data(), ee_position, dP, damping, step) :
+        FixedJacobianSolver<N>::Solve(chain.data(), ee_position, dP, apply_constraints, weight_factor, step);
+
+    //Singular chains don't move this step
+    for (unsigned int j = 0; j < N; ++j) {
+        dQ[j] = solved ? step[j] : 0.0;
+    }
+}
+
+bool IKController::GetFixedJacobianStep(unsigned int manipulator_indx, dx::XMVECTOR ee_position,
+    dx::XMVECTOR dP, float damping, double* dQ) {
+    const manipulator& chain = manipulators[manipulator_indx];
+    //The EE joint itself is not rotated
+    switch (chain.size() - 1) {
+    case 1: GetFixedStep<1>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 2: GetFixedStep<2>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 3: GetFixedStep<3>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 4: GetFixedStep<4>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 5: GetFixedStep<5>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 6: GetFixedStep<6>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 7: GetFixedStep<7>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    case 8: GetFixedStep<8>(chain, ee_position, dP, apply_constraints, weight_factor, damping, dQ); return true;
+    default: return false;
+    }
+}
+
+void IKController::GetDLSStep(unsigned int manipulator_indx, dx::XMVECTOR ee_position, dx::XMVECTOR dP) {
+    unsigned int joint_n = manipulators[manipulator_indx].size() - 1;
+    dls_step.resize(joint_n);
+    if (GetFixedJacobianStep(manipulator_indx, ee_position, dP, dls_damping, dls_step.data()))
+        return;
+
+    //Long chains use armadillo
+    arma::mat J = GetJacobian(manipulator_indx, true);
+    arma::mat dP_mat(3, 1);
+    dP_mat(0) = dx::XMVectorGetX(dP);
+    dP_mat(1) = dx::XMVectorGetY(dP);
+    dP_mat(2) = dx::XMVectorGetZ(dP);
+    arma::mat damped = J * J.t() + arma::eye(3, 3) * (dls_damping * dls_damping);
+    arma::mat dQ = J.t() * arma::solve(damped, dP_mat);
+    for (unsigned int j = 0; j < joint_n; ++j) {
+        dls_step[j] = dQ(j, 0);
+    }
+}
+
+dx::XMVECTOR IKController::EvaluateChain(unsigned int manipulator_indx) {
+    manipulator& chain = manipulators[manipulator_indx];
+    //Joints above the first changed one keep their cached transforms
+    unsigned int first_changed = 0;
+    while (first_changed < chain.size() &&
+        chain[first_changed].evaluated_angle == chain[first_changed].rot_angle)
+        first_changed++;
+    if (first_changed == chain.size())
+        return chain.back().position;
+
+    dx::XMVECTOR origin = dx::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+    //Bones above the chain are not changed by IK
+    dx::XMMATRIX parent_transform = first_changed > 0 ?
+        chain[first_changed - 1].model_transform :
+        bone_matrix_buffer[p_skeleton->hierarchy[chain[0].bone_index]->parent_indx];
+    for (unsigned int j = first_changed; j < chain.size(); ++j) {
+        Joint& joint = chain[j];
+        const VQS& animation_transform = p_base_animation->GetBaseTransform(joint.bone_index);
+        Quaternion modified_q(dx::XMQuaternionRotationAxis(joint.rot_axis, joint.rot_angle));
+        VQS modified_transform(animation_transform.GetV(), modified_q, animation_transform.GetS());
+        joint.model_transform = modified_transform.toMatrix() * parent_transform;
+        joint.evaluated_angle = joint.rot_angle;
+
+        joint.position = dx::XMVector3Transform(origin, joint.model_transform * world_transform);
+        joint.curr_rot_axis = dx::XMVector3Normalize(
+            dx::XMVector3Transform(joint.rot_axis, base_model_rotation));
+        joint.world_rot_axis = dx::XMVector3Normalize(
+            dx::XMVector3TransformNormal(joint.rot_axis, parent_transform * world_transform));
+        parent_transform = joint.model_transform;
+    }
+    return chain.back().position;
+}
+
+//Rotates v about the unit axis by angle
+static dx::XMVECTOR RotateAboutAxis(dx::XMVECTOR v, dx::XMVECTOR axis, float angle) {
+    return dx::XMVector3Rotate(v, dx::XMQuaternionRotationAxis(axis, angle));
+}
+
+//Signed angle about the unit axis that turns from towards to, on the plane of the axis
+static float GetAngleAboutAxis(dx::XMVECTOR from, dx::XMVECTOR to, dx::XMVECTOR axis) {
+    from = dx::XMVectorSubtract(from,
+        dx::XMVectorScale(axis, dx::XMVectorGetX(dx::XMVector3Dot(from, axis))));
+    to = dx::XMVectorSubtract(to,
+        dx::XMVectorScale(axis, dx::XMVectorGetX(dx::XMVector3Dot(to, axis))));
+    return atan2f(dx::XMVectorGetX(dx::XMVector3Dot(axis, dx::XMVector3Cross(from, to))),
+        dx::XMVectorGetX(dx::XMVector3Dot(from, to)));
+}
+
+bool IKController::ProcessTwoBone(unsigned int manipulator_indx) {
+    auto start = std::chrono::steady_clock::now();
+    dx::XMVECTOR target = GetEffectorTarget(manipulator_indx);
+    manipulator& chain = manipulators[manipulator_indx];
+    if (chain.size() < 3)
+        return false;
+    Joint& upper = chain[chain.size() - 3];
+    Joint& lower = chain[chain.size() - 2];
+
+    dx::XMVECTOR ee_position = EvaluateChain(manipulator_indx);
+    SolveStats& stats = solve_stats[manipulator_indx];
+    stats = SolveStats();
+    stats.start_residual = dx::XMVectorGetX(dx::XMVector3Length(
+        dx::XMVectorSubtract(target, ee_position)));
+    stats.end_residual = stats.start_residual;
+    auto finish = [&](bool converged) {
+        stats.converged = converged;
+        stats.time_us = std::chrono::duration<float, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        return converged;
+    };
+    if (stats.start_residual < distance_threshold)
+        return finish(true);
+    dx::XMVECTOR upper_axis = upper.world_rot_axis;
+    dx::XMVECTOR lower_axis = lower.world_rot_axis;
+    dx::XMVECTOR upper_bone = dx::XMVectorSubtract(lower.position, upper.position);
+    dx::XMVECTOR lower_bone = dx::XMVectorSubtract(ee_position, lower.position);
+    dx::XMVECTOR to_target = dx::XMVectorSubtract(target, upper.position);
+
+    /*
+    * Turning the lower joint by d moves the lower bone to
+    * b(d) = b_axial + b_radial cos(d) + (axis x b_radial) sin(d)
+    * The limb length |a + b(d)| has to match the target distance, so
+    * A cos(d) + B sin(d) = K
+    */
+    float lower_axial_length = dx::XMVectorGetX(dx::XMVector3Dot(lower_bone, lower_axis));
+    dx::XMVECTOR lower_axial = dx::XMVectorScale(lower_axis, lower_axial_length);
+    dx::XMVECTOR lower_radial = dx::XMVectorSubtract(lower_bone, lower_axial);
+    dx::XMVECTOR lower_tangent = dx::XMVector3Cross(lower_axis, lower_radial);
+    float A = dx::XMVectorGetX(dx::XMVector3Dot(upper_bone, lower_radial));
+    float B = dx::XMVectorGetX(dx::XMVector3Dot(upper_bone, lower_tangent));
+    float C = dx::XMVectorGetX(dx::XMVector3Dot(upper_bone, lower_axial));
+    float K = 0.5f * (dx::XMVectorGetX(dx::XMVector3LengthSq(to_target)) -
+        dx::XMVectorGetX(dx::XMVector3LengthSq(upper_bone)) -
+        dx::XMVectorGetX(dx::XMVector3LengthSq(lower_bone))) - C;
+    float R = sqrtf(A * A + B * B);
+    //No bend of the lower joint reaches the target distance, leave it to the general solver
+    if (R < 1e-6f || std::abs(K) > R)
+        return finish(false);
+
+    float base_angle = atan2f(B, A);
+    float offset_angle = acosf((std::max)(-1.0f, (std::min)(1.0f, K / R)));
+
+    //Two bends reach the distance, one on each side
+    float best_score = -FLT_MAX;
+    float lower_change = 0.0f;
+    float upper_change = 0.0f;
+    for (float side : { 1.0f, -1.0f }) {
+        float lower_angle = base_angle + side * offset_angle;
+        lower_angle = atan2f(sinf(lower_angle), cosf(lower_angle));
+
+        dx::XMVECTOR new_ee = dx::XMVectorAdd(lower.position,
+            RotateAboutAxis(lower_bone, lower_axis, lower_angle));
+        float upper_angle = GetAngleAboutAxis(
+            dx::XMVectorSubtract(new_ee, upper.position), to_target, upper_axis);
+
+        float score = -std::abs(lower_angle);
+        if (dx::XMVectorGetX(dx::XMVector3LengthSq(pole_vector)) > 0.0f) {
+            dx::XMVECTOR new_middle = RotateAboutAxis(upper_bone, upper_axis, upper_angle);
+            score = dx::XMVectorGetX(dx::XMVector3Dot(new_middle, pole_vector));
+        }
+        if (score > best_score) {
+            best_score = score;
+            lower_change = lower_angle;
+            upper_change = upper_angle;
+        }
+    }
+
+    float prev_lower_angle = lower.rot_angle;
+    float prev_upper_angle = upper.rot_angle;
+    lower.rot_angle += lower_change;
+    upper.rot_angle += upper_change;
+    if (apply_constraints) {
+        lower.rot_angle = (std::max)(lower.min_angle, (std::min)(lower.max_angle, lower.rot_angle));
+        upper.rot_angle = (std::max)(upper.min_angle, (std::min)(upper.max_angle, upper.rot_angle));
+    }
+
+    ee_position = EvaluateChain(manipulator_indx);
+    stats.iterations = 1;
+    stats.end_residual = dx::XMVectorGetX(dx::XMVector3Length(
+        dx::XMVectorSubtract(target, ee_position)));
+    if (stats.end_residual >= distance_threshold) {
+        //Leave the pose to the general solver instead of fighting it every frame
+        lower.rot_angle = prev_lower_angle;
+        upper.rot_angle = prev_upper_angle;
+        EvaluateChain(manipulator_indx);
+        return finish(false);
+    }
+    return finish(true);
+}
+
+void IKController::ProcessDLS(unsigned int manipulator_indx,
+    std::chrono::steady_clock::time_point deadline) {
+    auto start = std::chrono::steady_clock::now();
+    dx::XMVECTOR target = GetEffectorTarget(manipulator_indx);
+    manipulator& chain = manipulators[manipulator_indx];
+    SolveStats& stats = solve_stats[manipulator_indx];
+    stats = SolveStats();
+
+    //Starts from the angles the previous frame converged to
+    dx::XMVECTOR ee_position = EvaluateChain(manipulator_indx);
+    float residual = dx::XMVectorGetX(
+        dx::XMVector3Length(dx::XMVectorSubtract(target, ee_position)));
+    stats.start_residual = residual;
+
+    while (residual >= distance_threshold && stats.iterations < max_dls_iterations) {
+        //At least one iteration is always taken so every character makes progress
+        if (stats.iterations > 0 && std::chrono::steady_clock::now() >= deadline)
+            break;
+
+        GetDLSStep(manipulator_indx, ee_position, dx::XMVectorSubtract(target, ee_position));
+
+        //Limit the step so the linear approximation holds
+        double max_step = 0.0;
+        for (double step : dls_step) {
+            max_step = (std::max)(max_step, std::abs(step));
+        }
+        double step_scale = max_step > max_dls_step ? max_dls_step / max_step : 1.0;
+        for (unsigned int j = 0; j < dls_step.size(); ++j) {
+            chain[j].rot_angle += (float)(dls_step[j] * step_scale);
+        }
+        if (apply_constraints)
+            SetManipulatorConstraits(manipulator_indx);
+
+        ee_position = EvaluateChain(manipulator_indx);
+        residual = dx::XMVectorGetX(
+            dx::XMVector3Length(dx::XMVectorSubtract(target, ee_position)));
+        stats.iterations++;
+    }
+
+    stats.end_residual = residual;
+    stats.converged = residual < distance_threshold;
+    stats.time_us = std::chrono::duration<float, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+dx::XMVECTOR IKController::ApplyFABRIKPositions(unsigned int manipulator_indx) {
+    manipulator& chain = manipulators[manipulator_indx];
+
+    int parent_indx = p_skeleton->hierarchy[chain[0].bone_index]->parent_indx;
+    dx::XMMATRIX parent_transform = bone_matrix_buffer[parent_indx];
+    for (unsigned int j = 0; j < chain.size(); ++j) {
+        Joint& joint = chain[j];
+        const VQS& animation_transform = p_base_animation->GetBaseTransform(joint.bone_index);
+        dx::XMMATRIX parent_world = parent_transform * world_transform;
+        joint.position = dx::XMVector3Transform(
+            dx::XMLoadFloat3(&animation_transform.GetV()), parent_world);
+        joint.curr_rot_axis = dx::XMVector3Normalize(
+            dx::XMVector3Transform(joint.rot_axis, base_model_rotation));
+
+        if (j + 1 < chain.size()) {
+            //The rotation axis in world space, the joint rotates in its parent's frame
+            dx::XMVECTOR axis = dx::XMVector3Normalize(
+                dx::XMVector3TransformNormal(joint.rot_axis, parent_world));
+            joint.world_rot_axis = axis;
+
+            //Where the next joint is with the current angle
+            Quaternion curr_q(dx::XMQuaternionRotationAxis(joint.rot_axis, joint.rot_angle));
+            VQS curr_transform(animation_transform.GetV(), curr_q, animation_transform.GetS());
+            const VQS& child_transform = p_base_animation->GetBaseTransform(chain[j + 1].bone_index);
+            dx::XMVECTOR child_position = dx::XMVector3Transform(
+                dx::XMLoadFloat3(&child_transform.GetV()), curr_transform.toMatrix() * parent_world);
+
+            //Signed angle between the current and wanted bone about the axis
+            dx::XMVECTOR curr_dir = dx::XMVectorSubtract(child_position, joint.position);
+            dx::XMVECTOR wanted_dir = dx::XMVectorSubtract(fabrik_positions[j + 1], joint.position);
+            curr_dir = dx::XMVectorSubtract(curr_dir,
+                dx::XMVectorScale(axis, dx::XMVectorGetX(dx::XMVector3Dot(curr_dir, axis))));
+            wanted_dir = dx::XMVectorSubtract(wanted_dir,
+                dx::XMVectorScale(axis, dx::XMVectorGetX(dx::XMVector3Dot(wanted_dir, axis))));
+            float angle = atan2f(
+                dx::XMVectorGetX(dx::XMVector3Dot(axis, dx::XMVector3Cross(curr_dir, wanted_dir))),
+                dx::XMVectorGetX(dx::XMVector3Dot(curr_dir, wanted_dir)));
+            joint.rot_angle += angle;
+            if (apply_constraints)
+                joint.rot_angle = (std::max)(joint.min_angle, (std::min)(joint.max_angle, joint.rot_angle));
+        }
+
+        Quaternion modified_q(dx::XMQuaternionRotationAxis(joint.rot_axis, joint.rot_angle));
+        VQS modified_transform(animation_transform.GetV(), modified_q, animation_transform.GetS());
+        joint.model_transform = modified_transform.toMatrix() * parent_transform;
+        joint.evaluated_angle = joint.rot_angle;
+        parent_transform = joint.model_transform;
+    }
+    return chain.back().position;
+}
+
+void IKController::ProcessFABRIK(unsigned int manipulator_indx) {
+    auto start = std::chrono::steady_clock::now();
+    dx::XMVECTOR target = GetEffectorTarget(manipulator_indx);
+    manipulator& chain = manipulators[manipulator_indx];
+    SolveStats& stats = solve_stats[manipulator_indx];
+    stats = SolveStats();
+    unsigned int joint_count = chain.size();
+
+    dx::XMVECTOR ee_position = EvaluateChain(manipulator_indx);
+    float residual = dx::XMVectorGetX(
+        dx::XMVector3Length(dx::XMVectorSubtract(target, ee_position)));
+    stats.start_residual = residual;
+
+    fabrik_positions.resize(joint_count);
+    fabrik_lengths.resize(joint_count - 1);
+    for (unsigned int j = 0; j + 1 < joint_count; ++j) {
+        fabrik_lengths[j] = dx::XMVectorGetX(dx::XMVector3Length(
+            dx::XMVectorSubtract(chain[j + 1].position, chain[j].position)));
+    }
+
+    /*
+    * A hinge keeps the part of its bone along the axis fixed, so the bone
+    * can only turn within a cone around the axis.
+    * Returns the bone of joint j pointing as close to dir as the hinge allows.
+    */
+    auto get_hinge_bone = [&](unsigned int j, dx::XMVECTOR dir) {
+        dx::XMVECTOR axis = chain[j].world_rot_axis;
+        float axis_length = dx::XMVectorGetX(dx::XMVector3Dot(
+            dx::XMVectorSubtract(chain[j + 1].position, chain[j].position), axis));
+        float radius = sqrtf((std::max)(0.0f,
+            fabrik_lengths[j] * fabrik_lengths[j] - axis_length * axis_length));
+        dx::XMVECTOR radial = dx::XMVectorSubtract(dir,
+            dx::XMVectorScale(axis, dx::XMVectorGetX(dx::XMVector3Dot(dir, axis))));
+        if (dx::XMVectorGetX(dx::XMVector3LengthSq(radial)) < 1e-8f)
+            return dx::XMVectorSubtract(chain[j + 1].position, chain[j].position);
+        return dx::XMVectorAdd(dx::XMVectorScale(axis, axis_length),
+            dx::XMVectorScale(dx::XMVector3Normalize(radial), radius));
+    };
+
+    for (unsigned int j = 0; j < joint_count; ++j) {
+        fabrik_positions[j] = chain[j].position;
+    }
+
+    while (residual >= distance_threshold && stats.iterations < max_fabrik_iterations) {
+        //Backward pass, from the target to the root
+        fabrik_positions[joint_count - 1] = target;
+        for (int j = joint_count - 2; j >= 0; --j) {
+            dx::XMVECTOR bone = get_hinge_bone(j,
+                dx::XMVectorSubtract(fabrik_positions[j + 1], fabrik_positions[j]));
+            fabrik_positions[j] = dx::XMVectorSubtract(fabrik_positions[j + 1], bone);
+        }
+
+        //Forward pass, from the fixed root to the EE
+        fabrik_positions[0] = chain[0].position;
+        for (unsigned int j = 0; j + 1 < joint_count; ++j) {
+            dx::XMVECTOR bone = get_hinge_bone(j,
+                dx::XMVectorSubtract(fabrik_positions[j + 1], fabrik_positions[j]));
+            fabrik_positions[j + 1] = dx::XMVectorAdd(fabrik_positions[j], bone);
+        }
+
+        //The hinges can't always reach the positions, so iterate from where they ended up
+        ee_position = ApplyFABRIKPositions(manipulator_indx);
+        residual = dx::XMVectorGetX(
+            dx::XMVector3Length(dx::XMVectorSubtract(target, ee_position)));
+        stats.iterations++;
+
+        for (unsigned int j = 0; j < joint_count; ++j) {
+            fabrik_positions[j] = chain[j].position;
+        }
+    }
+
+    stats.end_residual = residual;
+    stats.converged = residual < distance_threshold;
+    stats.time_us = std::chrono::duration<float, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void IKController::BuildStackedColumns() {
+    stacked_joints.clear();
+    bone_columns.assign(p_skeleton->hierarchy.size(), -1);
+    for (unsigned int i = 0; i < manipulators.size(); ++i) {
+        for (unsigned int j = 0; j < manipulators[i].size(); ++j) {
+            Joint& joint = manipulators[i][j];
+            //The first joint of each bone holds the column
+            if (bone_columns[joint.bone_index] == -1) {
+                bone_columns[joint.bone_index] = stacked_joints.size();
+                stacked_joints.push_back({ i, j });
+            }
+            joint.stacked_column = bone_columns[joint.bone_index];
+        }
+    }
+}
+
+void IKController::SyncStackedJoints() {
+    for (auto& chain : manipulators) {
+        for (auto& joint : chain) {
+            const std::pair<unsigned int, unsigned int>& column_joint = stacked_joints[joint.stacked_column];
+            joint.rot_angle = manipulators[column_joint.first][column_joint.second].rot_angle;
+        }
+    }
+}
+
+void IKController::ProcessStacked(std::chrono::steady_clock::time_point deadline) {
+    auto start = std::chrono::steady_clock::now();
+    unsigned int effector_count = manipulators.size();
+    unsigned int joint_count = stacked_joints.size();
+    stacked_step.resize(joint_count);
+
+    //Evaluates every chain, returns true if every EE is close enough
+    auto update_residuals = [&](bool first) {
+        bool reached = true;
+        for (unsigned int i = 0; i < effector_count; ++i) {
+            dx::XMVECTOR ee_position = EvaluateChain(i);
+            float residual = dx::XMVectorGetX(dx::XMVector3Length(
+                dx::XMVectorSubtract(GetEffectorTarget(i), ee_position)));
+            if (first)
+                solve_stats[i].start_residual = residual;
+            solve_stats[i].end_residual = residual;
+            reached = reached && residual < distance_threshold;
+        }
+        return reached;
+    };
+
+    for (auto& stats : solve_stats) {
+        stats = SolveStats();
+    }
+    bool reached = update_residuals(true);
+    unsigned int iterations = 0;
+    while (!reached && iterations < max_dls_iterations) {
+        if (iterations > 0 && std::chrono::steady_clock::now() >= deadline)
+            break;
+
+        stacked_solver.Reset(effector_count, joint_count);
+        for (unsigned int i = 0; i < effector_count; ++i) {
+            const manipulator& chain = manipulators[i];
+            dx::XMVECTOR ee_position = chain.back().position;
+            stacked_solver.SetTarget(i, dx::XMVectorSubtract(GetEffectorTarget(i), ee_position));
+            //The EE joint itself is not rotated
+            for (unsigned int j = 0; j < chain.size() - 1; ++j) {
+                stacked_solver.SetColumn(i, chain[j].stacked_column, dx::XMVector3Cross(
+                    chain[j].world_rot_axis, dx::XMVectorSubtract(ee_position, chain[j].position)));
+            }
+        }
+        if (!stacked_solver.SolveDamped(dls_damping, stacked_step.data()))
+            break;
+
+        //Limit the step so the linear approximation holds
+        double max_step = 0.0;
+        for (double step : stacked_step) {
+            max_step = (std::max)(max_step, std::abs(step));
+        }
+        double step_scale = max_step > max_dls_step ? max_dls_step / max_step : 1.0;
+        for (unsigned int c = 0; c < joint_count; ++c) {
+            Joint& joint = manipulators[stacked_joints[c].first][stacked_joints[c].second];
+            joint.rot_angle += (float)(stacked_step[c] * step_scale);
+            if (apply_constraints)
+                joint.rot_angle = (std::max)(joint.min_angle, (std::min)(joint.max_angle, joint.rot_angle));
+        }
+        SyncStackedJoints();
+
+        reached = update_residuals(false);
+        iterations++;
+    }
+
+    float time_us = std::chrono::duration<float, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+    for (auto& stats : solve_stats) {
+        stats.iterations = iterations;
+        stats.converged = stats.end_residual < distance_threshold;
+        stats.time_us = time_us;
+    }
+}
+
 void IKController::ProcessAnimation() {
     dx::XMVECTOR origin = dx::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
     for (unsigned int boneIndex = 0; boneIndex < p_skeleton->hierarchy.size(); ++boneIndex)
     {
         Bone* bone = p_skeleton->hierarchy[boneIndex];
         const VQS& animation_transform = p_base_animation->GetBaseTransform(boneIndex);
-        Joint* joint_p = GetJoint(0, boneIndex);
+        Joint* joint_p = FindJoint(boneIndex);
+        //The solve already evaluated the bone
+        if (joint_p && joint_p->evaluated_angle == joint_p->rot_angle) {
+            bone_matrix_buffer[boneIndex] = joint_p->model_transform;
+            continue;
+        }
+
         dx::XMMATRIX local_transform = animation_transform.toMatrix();
         if (joint_p) {
             Quaternion modified_q(dx::XMQuaternionRotationAxis(joint_p->rot_axis, joint_p->rot_angle));
@@ -157,10 +721,7 @@ void IKController::ProcessAnimation() {
 
         //Update the manipulator joint positions
         if (joint_p) {
-            joint_p->position = dx::XMVector3Transform(origin,
-                modelTransform *
-                dx::XMMatrixMultiply(base_model_rotation,
-                dx::XMMatrixTranslationFromVector(base_model_position)));
+            joint_p->position = dx::XMVector3Transform(origin, modelTransform * world_transform);
             joint_p->curr_rot_axis = dx::XMVector3Normalize(
                 dx::XMVector3Transform(joint_p->rot_axis,
                     base_model_rotation));
@@ -172,6 +733,14 @@ void IKController::ShowIKControls() {
     int bone_index;
     if (ImGui::Begin("IK Controller")) 
     {
+        if (ImGui::BeginMenu("Solver Method")) {
+            if (ImGui::MenuItem("Jacobian", "", solver_method == SolverMethod::JACOBIAN)) solver_method = SolverMethod::JACOBIAN;
+            if (ImGui::MenuItem("Damped least squares", "", solver_method == SolverMethod::DLS)) solver_method = SolverMethod::DLS;
+            if (ImGui::MenuItem("CCD", "", solver_method == SolverMethod::CCD)) solver_method = SolverMethod::CCD;
+            if (ImGui::MenuItem("FABRIK", "", solver_method == SolverMethod::FABRIK)) solver_method = SolverMethod::FABRIK;
+            ImGui::EndMenu();
+        }
+        ImGui::Checkbox("Two bone limbs", &use_two_bone);
         ImGui::Checkbox("Stop animation", &stop_animation);
         ImGui::Checkbox("Apply constraints", &apply_constraints);
 
@@ -190,6 +759,19 @@ void IKController::ShowIKControls() {
         float distance = dx::XMVectorGetX(
             dx::XMVector3Length(dx::XMVectorSubtract(target_position, Pc)));
         ImGui::Text("Current distance : %f", distance);
+
+        if (solver_method == SolverMethod::DLS) {
+            ImGui::SliderFloat("DLS damping", &dls_damping, 0.0f, 100.0f);
+            ImGui::SliderFloat("Solve budget (us)", &solve_budget_us, 10.0f, 2000.0f);
+        }
+        if (use_two_bone || solver_method == SolverMethod::DLS || solver_method == SolverMethod::FABRIK) {
+            for (unsigned int i = 0; i < solve_stats.size(); ++i) {
+                const SolveStats& stats = solve_stats[i];
+                ImGui::Text("Manipulator %u : %u iterations, residual %f -> %f, %.1f us%s", i,
+                    stats.iterations, stats.start_residual, stats.end_residual, stats.time_us,
+                    stats.converged ? "" : " (not converged)");
+            }
+        }
         
         ImGui::Text("EE Position : X-%f Y-%f Z-%f",
             dx::XMVectorGetX(Pc), dx::XMVectorGetY(Pc), dx::XMVectorGetZ(Pc));
@@ -205,20 +787,19 @@ dx::XMVECTOR IKController::EvalulateManipulator(unsigned int manipulator_indx) {
     dx::XMMATRIX modelTransform = bone_matrix_buffer[end_effectors[manipulator_indx]->bone_indx];
     dx::XMVECTOR origin = dx::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
     //return manipulators[manipulator_indx].back().position;
-    return dx::XMVector3Transform(origin, 
-        modelTransform * 
-        dx::XMMatrixMultiply(base_model_rotation,
-            dx::XMMatrixTranslationFromVector(base_model_position)));
+    return dx::XMVector3Transform(origin, modelTransform * world_transform);
 }
 
-arma::mat IKController::GetJacobian(unsigned int manipulator_indx) {
+arma::mat IKController::GetJacobian(unsigned int manipulator_indx, bool world_axes) {
     int joint_n = manipulators[manipulator_indx].size();
     joint_n -= 1;
     arma::mat J(3, joint_n);
 
-    dx::XMVECTOR ee_position = EvalulateManipulator(manipulator_indx);
+    dx::XMVECTOR ee_position = manipulators[manipulator_indx].back().position;
     for (unsigned int i = 0; i < joint_n; ++i) {
-        dx::XMVECTOR curr_rot_axis = manipulators[manipulator_indx][i].curr_rot_axis;
+        dx::XMVECTOR curr_rot_axis = world_axes ?
+            manipulators[manipulator_indx][i].world_rot_axis :
+            manipulators[manipulator_indx][i].curr_rot_axis;
         dx::XMVECTOR curr_position = manipulators[manipulator_indx][i].position;
         dx::XMVECTOR mat_val = dx::XMVector3Cross(curr_rot_axis,
             dx::XMVectorSubtract(ee_position, curr_position));
@@ -273,6 +854,9 @@ void IKController::GenerateDefaultRightArmConstraints(unsigned int manipulator_i
     manipulators[manipulator_indx][4].max_angle = dx::XMConvertToRadians(150);
     manipulators[manipulator_indx][4].final_angle = dx::XMConvertToRadians(0);
     manipulators[manipulator_indx][4].flexibility = 1.0;
+
+    //Shoulder and elbow
+    two_bone_limbs[manipulator_indx] = true;
 }
 
 void IKController::SetManipulatorConstraits(unsigned int manipulator_indx) {
@@ -283,12 +867,13 @@ void IKController::SetManipulatorConstraits(unsigned int manipulator_indx) {
 }
 
 void IKController::ProcessCCD(unsigned int manipulator_indx) {
-    dx::XMVECTOR Pc = EvalulateManipulator(manipulator_indx);
+    dx::XMVECTOR target = GetEffectorTarget(manipulator_indx);
+    dx::XMVECTOR Pc = EvaluateChain(manipulator_indx);
     for (int k = manipulators[manipulator_indx].size() - 2; k >= 0; --k) {
         dx::XMVECTOR Vck =  
             dx::XMVectorSubtract(Pc, manipulators[manipulator_indx][k].position);
         dx::XMVECTOR Vdk =
-            dx::XMVectorSubtract(target_position, manipulators[manipulator_indx][k].position);
+            dx::XMVectorSubtract(target, manipulators[manipulator_indx][k].position);
         float alpha_k = dx::XMScalarACos(
             dx::XMVectorGetX(dx::XMVector3Dot(Vck, Vdk)) /
             (dx::XMVectorGetX(dx::XMVector3Length(Vck)) * dx::XMVectorGetX(dx::XMVector3Length(Vdk)))
@@ -313,10 +898,7 @@ void IKController::Reset() {
             dx::XMMATRIX modelTransform = local_transform * parent_transform;
 
             //Get the position by applying the transform
-            curr_joint.position = dx::XMVector3Transform(origin,
-                modelTransform *
-                dx::XMMatrixMultiply(base_model_rotation,
-                    dx::XMMatrixTranslationFromVector(base_model_position)));
+            curr_joint.position = dx::XMVector3Transform(origin, modelTransform * world_transform);
             //Get the rotation axis
             dx::XMQuaternionToAxisAngle(
                 &curr_joint.rot_axis, &curr_joint.rot_angle, curr_vqs.GetQ().toVector());
@@ -339,6 +921,12 @@ arma::mat IKController::GenerateConstrainedWeights(unsigned int manipulator_indx
             max_weight = w(i, 0);
     }
 
+    //No joint wants to move, dividing would give NaN angles
+    if (max_weight <= 0) {
+        w.zeros();
+        return w;
+    }
+
     //Convert all weights into the range 0 - 1 and apply the weight factor
     for (unsigned int i = 0; i < joint_n; ++i) {
         w(i, 0) = (w(i, 0) / max_weight) * weight_factor;
@@ -2,8 +2,10 @@
 #undef snprintf
 
 #include <armadillo>
+#include <chrono>
 #include "Quaternion.h"
 #include "Animation.h"
+#include "StackedJacobianSolver.h"
 
 class IKController 
 {
@@ -12,23 +14,51 @@ public:
 		dx::XMVECTOR position;
 		dx::XMVECTOR rot_axis;
 		dx::XMVECTOR curr_rot_axis;
+		//rot_axis in world space with the current pose of the parent bones
+		dx::XMVECTOR world_rot_axis;
 		int bone_index;
 		float rot_angle;
 		float max_angle;
 		float min_angle;
 		float final_angle;
 		float flexibility;
+		//Column of the joint's bone in the stacked Jacobian, shared by all chains with the bone
+		unsigned int stacked_column;
+		//Model space transform of the bone, as of the last EvaluateChain
+		dx::XMMATRIX model_transform;
+		//The rot_angle model_transform was evaluated with, NaN when it is out of date
+		float evaluated_angle;
 	};
 
 	Joint* GetJoint(int manipulator_index, int bone_index);
 
+	/*
+	* Finds the joint for the bone in any manipulator.
+	* Joints of bones shared by several manipulators always have the same angle.
+	* Returns: Joint* - nullptr if no manipulator has the bone
+	*/
+	Joint* FindJoint(int bone_index);
+
+	//Stacked column of every bone, -1 for bones in no manipulator
+	std::vector<int> bone_columns;
+
 	IKController();
 	~IKController();
 	//Update the Controller
 	void Update(float dt, dx::XMVECTOR _model_pos, dx::XMMATRIX _model_rot);
 	
-	//Method to use for IK
-	bool jacobian = true;
+	/*
+	* Method to use for IK on each chain.
+	* With more than one end effector and solve_effectors_together set,
+	* the stacked solve is used instead and solver_method and use_two_bone are ignored.
+	*/
+	enum class SolverMethod {
+		JACOBIAN,
+		DLS,
+		CCD,
+		FABRIK
+	};
+	SolverMethod solver_method = SolverMethod::JACOBIAN;
 	//Variable to apply constraints to the transformations
 	bool apply_constraints = true;
 	//Variable to scale the weights
@@ -36,6 +66,14 @@ public:
 
 	dx::XMVECTOR base_model_position;
 	dx::XMMATRIX base_model_rotation;
+	//base_model_rotation followed by the translation to base_model_position
+	dx::XMMATRIX world_transform;
+
+	//Sets the model position and rotation, the cached chain transforms are evaluated again
+	void SetModelTransform(dx::XMVECTOR _model_pos, dx::XMMATRIX _model_rot);
+
+	//Marks every joint's cached transform as out of date
+	void InvalidateChains();
 
 	//Animation control parameters
 	bool stop_animation = false;
@@ -59,10 +97,17 @@ public:
 
 	//the target position;
 	dx::XMVECTOR target_position;
+	//The target of every end effector, the first one uses target_position instead
+	std::vector<dx::XMVECTOR> effector_targets;
+
+	//Returns: XMVector - the target of the manipulator's end effector, target_position if there is no such manipulator
+	dx::XMVECTOR GetEffectorTarget(unsigned int manipulator_indx) const;
+	//Returns: bool - false if there is no such manipulator
+	bool SetEffectorTarget(unsigned int manipulator_indx, dx::XMVECTOR target);
 	//The threshold to check if the EE is close enough to the target_position
 	float distance_threshold = 3.0f;
 
-	//Process the animation
+	//Solves the manipulators, then updates the skeleton with the result
 	void Process(float dt);
 
 	//Sets the skeleton pointer and adjusts the size of the bone_matrix_buffer accordingly
@@ -88,11 +133,137 @@ public:
 	//Calculate the angles of the joins within all the manipulators for this frame
 	void ProcessManipulators(float dt);
 
-	//Caclulate the bone transformation matrix for rendering the animation
+	//Longest chain solved with fixed size matrices, longer ones fall back to armadillo
+	static const unsigned int max_fixed_chain_length = 8;
+
+	/*
+	* Calculates the joint angle change for the manipulator using FixedJacobianSolver
+	* A damping above 0 gives the damped least squares step.
+	* Returns: bool - false if the chain is too long for the fixed size solver
+	*/
+	bool GetFixedJacobianStep(unsigned int manipulator_indx, dx::XMVECTOR ee_position,
+		dx::XMVECTOR dP, float damping, double* dQ);
+
+	//Result of the last two bone, damped least squares or FABRIK solve of a manipulator
+	struct SolveStats {
+		unsigned int iterations = 0;
+		float start_residual = 0.0f;
+		float end_residual = 0.0f;
+		float time_us = 0.0f;
+		bool converged = false;
+	};
+	std::vector<SolveStats> solve_stats;
+
+	//Damping for the least squares solve, higher is steadier near singularities but slower
+	float dls_damping = 10.0f;
+	//Time the damped least squares solve may take for all manipulators per frame
+	float solve_budget_us = 200.0f;
+	unsigned int max_dls_iterations = 32;
+	//Largest joint angle change per iteration in radians
+	double max_dls_step = 0.3;
+	//The last damped least squares step, kept to avoid reallocating
+	std::vector<double> dls_step;
+
+	/*
+	* Iterates damped least squares steps until the EE is within distance_threshold,
+	* the deadline passes or max_dls_iterations is reached.
+	* The result is written to solve_stats.
+	*/
+	void ProcessDLS(unsigned int manipulator_indx, std::chrono::steady_clock::time_point deadline);
+
+	//Damped least squares step into dls_step, armadillo is used for long chains
+	void GetDLSStep(unsigned int manipulator_indx, dx::XMVECTOR ee_position, dx::XMVECTOR dP);
+
+	unsigned int max_fabrik_iterations = 10;
+	//Joint positions and bone lengths FABRIK works on, kept to avoid reallocating
+	std::vector<dx::XMVECTOR> fabrik_positions;
+	std::vector<float> fabrik_lengths;
+
+	/*
+	* Process the manipulator with FABRIK.
+	* Iterates backward and forward passes over the joint positions, keeping every
+	* bone where its hinge can reach, and converts them back to joint angles
+	* after every iteration.
+	* The result is written to solve_stats.
+	*/
+	void ProcessFABRIK(unsigned int manipulator_indx);
+
+	/*
+	* Rotates each joint about its axis, root to tip, so the next joint
+	* points towards its position in fabrik_positions.
+	* The angle limits are applied if apply_constraints is set.
+	* Updates the joint positions and axes.
+	* Returns: XMVector - EE position
+	*/
+	dx::XMVECTOR ApplyFABRIKPositions(unsigned int manipulator_indx);
+
+	/*
+	* Solve all the end effectors with one stacked damped least squares Jacobian
+	* over the union of their joints, instead of chain by chain.
+	* Used whenever there is more than one end effector, overriding solver_method and use_two_bone.
+	*/
+	bool solve_effectors_together = true;
+	StackedJacobianSolver stacked_solver;
+	//The joint holding the angle of each stacked column, as manipulator and joint index
+	std::vector<std::pair<unsigned int, unsigned int>> stacked_joints;
+	std::vector<double> stacked_step;
+
+	//Assigns the stacked columns and bone_columns, joints of the same bone share one
+	void BuildStackedColumns();
+
+	//Copies the angle of each stacked column to every joint of its bone
+	void SyncStackedJoints();
+
+	/*
+	* Iterates stacked damped least squares steps until every EE is within
+	* distance_threshold, the deadline passes or max_dls_iterations is reached.
+	* The result is written to solve_stats for every manipulator.
+	*/
+	void ProcessStacked(std::chrono::steady_clock::time_point deadline);
+
+	//Solve the last two bones of limb chains in closed form before the general solver
+	bool use_two_bone = true;
+	/*
+	* Whether the last two rotating joints of each manipulator form a limb,
+	* e.g shoulder and elbow. Only limbs are tried with ProcessTwoBone.
+	* Set by the Generate...Constraints functions of limb chains.
+	*/
+	std::vector<bool> two_bone_limbs;
+	/*
+	* Direction the middle joint of a two bone limb should bend towards.
+	* Zero keeps the bend closest to the current pose.
+	*/
+	dx::XMVECTOR pole_vector = dx::XMVectorZero();
+
+	/*
+	* Closed form solve of the last two rotating joints of the chain, e.g shoulder and elbow.
+	* The lower joint sets the distance to the target with the law of cosines,
+	* the upper joint then swings the limb towards it.
+	* Both joints are hinges, so the target can be out of the limb's reach,
+	* then nothing is attempted and the angles are left to the general solver.
+	* Returns: bool - true if the EE is within distance_threshold
+	*/
+	bool ProcessTwoBone(unsigned int manipulator_indx);
+
+	/*
+	* Forward kinematics of only the manipulator chain with its current angles.
+	* Only the joints from the first one whose angle changed since the
+	* last evaluation down to the EE are recomputed.
+	* Updates the joint positions and axes.
+	* Returns: XMVector - EE position
+	*/
+	dx::XMVECTOR EvaluateChain(unsigned int manipulator_indx);
+
+	/*
+	* Caclulate the bone transformation matrix for rendering the animation
+	* Bones in the manipulators reuse the transforms cached by EvaluateChain.
+	*/
 	void ProcessAnimation();
 
 	//IMgui window for the IK controls
 	void ShowIKControls();
+	//Show the IK controls in Update, off for all but one of many controllers
+	bool show_controls = true;
 
 	/*
 	* Evaluates all the angles along the manipulator to get the current 
@@ -104,9 +275,10 @@ public:
 
 	/*
 	* Calculate the Jacobian Matrix for the corresponding manipulator
+	* world_axes uses the world_rot_axis of the joints instead of curr_rot_axis
 	* Returns: Matrix
 	*/
-	arma::mat GetJacobian(unsigned int manipulator_indx);
+	arma::mat GetJacobian(unsigned int manipulator_indx, bool world_axes = false);
 
 	/*
 	* Calculate the PseudoJacobian Matrix for the Jacobian
@@ -116,7 +288,7 @@ public:
 
 	/*
 	* Generates the constraints based on pre-defined values considered
-	* for a human right arm.
+	* for a human right arm, and marks the chain as a two bone limb.
 	*/
 	void GenerateDefaultRightArmConstraints(unsigned int manipulator_indx);
 
@@ -0,0 +1,402 @@
+#include "ImplicitIntegrator.h"
+#include <cmath>
+#include <utility>
+
+namespace dx = DirectX;
+
+namespace {
+	/*
+	* G-trans(a) * G(b) for the points at the offsets ra and rb of two bodies
+	* G(r) = [I, -~r] maps the velocity [v, w] of a body to the velocity of its point at r
+	* Returns: 6x6 block as [[I, -~rb], [~ra, -~ra * ~rb]]
+	*/
+	void PointCoupling(const dx::XMFLOAT3& ra, const dx::XMFLOAT3& rb, float out[6][6]) {
+		const float tilde_a[3][3] = {
+			{ 0, -ra.z, ra.y },
+			{ ra.z, 0, -ra.x },
+			{ -ra.y, ra.x, 0 }
+		};
+		const float tilde_b[3][3] = {
+			{ 0, -rb.z, rb.y },
+			{ rb.z, 0, -rb.x },
+			{ -rb.y, rb.x, 0 }
+		};
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				out[i][j] = i == j ? 1.0f : 0.0f;
+				out[i][j + 3] = -tilde_b[i][j];
+				out[i + 3][j] = tilde_a[i][j];
+				float product = 0.0f;
+				for (int k = 0; k < 3; ++k)
+					product += tilde_a[i][k] * tilde_b[k][j];
+				out[i + 3][j + 3] = -product;
+			}
+		}
+	}
+
+	//Gauss-Jordan elimination with partial pivoting
+	void Invert(const float in[6][6], float out[6][6]) {
+		float a[6][12];
+		for (int i = 0; i < 6; ++i) {
+			for (int j = 0; j < 6; ++j) {
+				a[i][j] = in[i][j];
+				a[i][j + 6] = i == j ? 1.0f : 0.0f;
+			}
+		}
+		for (int col = 0; col < 6; ++col) {
+			int pivot = col;
+			for (int row = col + 1; row < 6; ++row) {
+				if (std::fabs(a[row][col]) > std::fabs(a[pivot][col]))
+					pivot = row;
+			}
+			if (pivot != col) {
+				for (int j = 0; j < 12; ++j)
+					std::swap(a[col][j], a[pivot][j]);
+			}
+			float inv_pivot = a[col][col] != 0.0f ? 1.0f / a[col][col] : 0.0f;
+			for (int j = 0; j < 12; ++j)
+				a[col][j] *= inv_pivot;
+			for (int row = 0; row < 6; ++row) {
+				if (row == col || a[row][col] == 0.0f)
+					continue;
+				float factor = a[row][col];
+				for (int j = 0; j < 12; ++j)
+					a[row][j] -= factor * a[col][j];
+			}
+		}
+		for (int i = 0; i < 6; ++i) {
+			for (int j = 0; j < 6; ++j)
+				out[i][j] = a[i][j + 6];
+		}
+	}
+
+	//out = a * b, or a-trans * b
+	void MultiplyBlocks(const float a[6][6], const float b[6][6], float out[6][6], bool transpose_a = false) {
+		for (int i = 0; i < 6; ++i) {
+			for (int j = 0; j < 6; ++j) {
+				float sum = 0.0f;
+				for (int k = 0; k < 6; ++k)
+					sum += (transpose_a ? a[k][i] : a[i][k]) * b[k][j];
+				out[i][j] = sum;
+			}
+		}
+	}
+
+	//out += a * x, or a-trans * x
+	void MultiplyAdd(const float a[6][6], const float x[6], float out[6], bool transpose_a = false) {
+		for (int i = 0; i < 6; ++i) {
+			float sum = 0.0f;
+			for (int k = 0; k < 6; ++k)
+				sum += (transpose_a ? a[k][i] : a[i][k]) * x[k];
+			out[i] += sum;
+		}
+	}
+
+	double Dot(const float a[6], const float b[6]) {
+		double sum = 0.0;
+		for (int i = 0; i < 6; ++i)
+			sum += (double)a[i] * b[i];
+		return sum;
+	}
+}
+
+void ImplicitIntegrator::Assemble(const RigidBodyStore& bodies, const SpringGraph& graph,
+	const dx::XMFLOAT3* anchor_points, float spring_coeff, float damper_coeff, dx::FXMVECTOR gravity,
+	dx::FXMVECTOR force, dx::FXMVECTOR torque, float dt) {
+	unsigned int count = (unsigned int)bodies.Size();
+	diagonal.assign(count, Block6{});
+	off_diagonal.clear();
+	rhs.assign(count, Vector6{});
+
+	for (unsigned int body = 0; body < count; ++body) {
+		//M = [m * I, 0], [0, I(t)]
+		float mass = 1.0f / bodies.inv_masses[body];
+		dx::XMFLOAT3X3 inertia;
+		dx::XMStoreFloat3x3(&inertia,
+			dx::XMMatrixInverse(nullptr, dx::XMLoadFloat3x3(&bodies.world_inv_inertias[body])));
+		for (int i = 0; i < 3; ++i) {
+			diagonal[body].m[i][i] = mass;
+			for (int j = 0; j < 3; ++j)
+				diagonal[body].m[i + 3][j + 3] = inertia.m[i][j];
+		}
+
+		//h * F for the forces that do not depend on the state
+		dx::XMFLOAT3 external_force, external_torque;
+		dx::XMStoreFloat3(&external_force, dx::XMVectorAdd(force, dx::XMVectorScale(gravity, mass)));
+		dx::XMStoreFloat3(&external_torque, torque);
+		float* b = rhs[body].v;
+		b[0] = dt * external_force.x;
+		b[1] = dt * external_force.y;
+		b[2] = dt * external_force.z;
+		b[3] = dt * external_torque.x;
+		b[4] = dt * external_torque.y;
+		b[5] = dt * external_torque.z;
+	}
+
+	//Adds scale * block at (row, column) of the system matrix
+	auto add_block = [&](unsigned int row, unsigned int column, const float block[6][6], float scale) {
+		Block6* target;
+		if (row == column) {
+			target = &diagonal[row];
+		}
+		else {
+			off_diagonal.push_back(OffDiagonal{ row, column, Block6{} });
+			target = &off_diagonal.back().block;
+		}
+		for (int i = 0; i < 6; ++i) {
+			for (int j = 0; j < 6; ++j)
+				target->m[i][j] += scale * block[i][j];
+		}
+	};
+
+	for (unsigned int edge = 0; edge < graph.Size(); ++edge) {
+		float k, d;
+		graph.GetCoefficients(edge, spring_coeff, damper_coeff, k, d);
+		//-h * dF/du - h^2 * dF/dx of an edge is this times G-trans * G of its ends
+		float edge_scale = dt * d + dt * dt * k;
+
+		int ends[2] = { graph.bodies_a[edge], graph.bodies_b[edge] };
+		const dx::XMFLOAT3* offsets[2] = { &graph.offsets_a[edge], &graph.offsets_b[edge] };
+		dx::XMFLOAT3 r[2];
+		dx::XMVECTOR point[2], point_velocity[2];
+		for (int e = 0; e < 2; ++e) {
+			if (SpringGraph::IsAnchor(ends[e])) {
+				r[e] = dx::XMFLOAT3();
+				point[e] = dx::XMVectorAdd(dx::XMLoadFloat3(offsets[e]),
+					dx::XMLoadFloat3(&anchor_points[SpringGraph::AnchorIndex(ends[e])]));
+				point_velocity[e] = dx::XMVectorZero();
+				continue;
+			}
+			unsigned int body = (unsigned int)ends[e];
+			dx::XMVECTOR r_world = dx::XMVector3Transform(dx::XMLoadFloat3(offsets[e]),
+				dx::XMLoadFloat3x3(&bodies.rotations[body]));
+			dx::XMStoreFloat3(&r[e], r_world);
+			point[e] = dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.positions[body]), r_world);
+			point_velocity[e] = dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.velocities[body]),
+				dx::XMVector3Cross(dx::XMLoadFloat3(&bodies.angular_velocities[body]), r_world));
+		}
+
+		//F + h * dF/dx * u on end a, the velocity term of the spring is folded into the damper
+		dx::XMVECTOR f = dx::XMVectorAdd(
+			dx::XMVectorScale(dx::XMVectorSubtract(point[1], point[0]), k),
+			dx::XMVectorScale(dx::XMVectorSubtract(point_velocity[1], point_velocity[0]), d + dt * k));
+
+		for (int e = 0; e < 2; ++e) {
+			if (SpringGraph::IsAnchor(ends[e]))
+				continue;
+			//End b is pulled the other way
+			dx::XMVECTOR f_end = e == 0 ? f : dx::XMVectorNegate(f);
+			dx::XMFLOAT3 linear, angular;
+			dx::XMStoreFloat3(&linear, f_end);
+			dx::XMStoreFloat3(&angular, dx::XMVector3Cross(dx::XMLoadFloat3(&r[e]), f_end));
+			float* b = rhs[ends[e]].v;
+			b[0] += dt * linear.x;
+			b[1] += dt * linear.y;
+			b[2] += dt * linear.z;
+			b[3] += dt * angular.x;
+			b[4] += dt * angular.y;
+			b[5] += dt * angular.z;
+		}
+
+		float coupling[6][6];
+		for (int e = 0; e < 2; ++e) {
+			if (SpringGraph::IsAnchor(ends[e]))
+				continue;
+			PointCoupling(r[e], r[e], coupling);
+			add_block(ends[e], ends[e], coupling, edge_scale);
+
+			int other = 1 - e;
+			if (SpringGraph::IsAnchor(ends[other]))
+				continue;
+			PointCoupling(r[e], r[other], coupling);
+			add_block(ends[e], ends[other], coupling, -edge_scale);
+		}
+	}
+}
+
+bool ImplicitIntegrator::IsChain() const {
+	for (const auto& block : off_diagonal) {
+		if (block.row + 1 != block.column && block.column + 1 != block.row)
+			return false;
+	}
+	return true;
+}
+
+void ImplicitIntegrator::Multiply(const std::vector<Vector6>& x, std::vector<Vector6>& y) const {
+	for (size_t i = 0; i < diagonal.size(); ++i) {
+		y[i] = Vector6{};
+		MultiplyAdd(diagonal[i].m, x[i].v, y[i].v);
+	}
+	for (const auto& block : off_diagonal) {
+		MultiplyAdd(block.block.m, x[block.column].v, y[block.row].v);
+	}
+}
+
+void ImplicitIntegrator::SolveChain() {
+	size_t count = diagonal.size();
+	solution.assign(count, Vector6{});
+	if (count == 0)
+		return;
+
+	//Upper blocks (i, i + 1), the lower ones are their transposes
+	chain_upper.assign(count, Block6{});
+	for (const auto& block : off_diagonal) {
+		if (block.column != block.row + 1)
+			continue;
+		for (int i = 0; i < 6; ++i) {
+			for (int j = 0; j < 6; ++j)
+				chain_upper[block.row].m[i][j] += block.block.m[i][j];
+		}
+	}
+
+	//Forward elimination
+	//S(i) = D(i) - U(i-1)-trans * C(i-1), C(i) = S(i)-inv * U(i), d(i) = S(i)-inv * (b(i) - U(i-1)-trans * d(i-1))
+	chain_factor.resize(count);
+	chain_rhs.resize(count);
+	Block6 schur, schur_inv, temp;
+	for (size_t i = 0; i < count; ++i) {
+		schur = diagonal[i];
+		Vector6 b = rhs[i];
+		if (i > 0) {
+			MultiplyBlocks(chain_upper[i - 1].m, chain_factor[i - 1].m, temp.m, true);
+			for (int r = 0; r < 6; ++r) {
+				for (int c = 0; c < 6; ++c)
+					schur.m[r][c] -= temp.m[r][c];
+			}
+			Vector6 correction{};
+			MultiplyAdd(chain_upper[i - 1].m, chain_rhs[i - 1].v, correction.v, true);
+			for (int r = 0; r < 6; ++r)
+				b.v[r] -= correction.v[r];
+		}
+		Invert(schur.m, schur_inv.m);
+		MultiplyBlocks(schur_inv.m, chain_upper[i].m, chain_factor[i].m);
+		chain_rhs[i] = Vector6{};
+		MultiplyAdd(schur_inv.m, b.v, chain_rhs[i].v);
+	}
+
+	//Back substitution, x(i) = d(i) - C(i) * x(i+1)
+	solution[count - 1] = chain_rhs[count - 1];
+	for (size_t i = count - 1; i-- > 0;) {
+		Vector6 correction{};
+		MultiplyAdd(chain_factor[i].m, solution[i + 1].v, correction.v);
+		for (int r = 0; r < 6; ++r)
+			solution[i].v[r] = chain_rhs[i].v[r] - correction.v[r];
+	}
+}
+
+void ImplicitIntegrator::SolveConjugateGradient() {
+	size_t count = diagonal.size();
+	if (solution.size() != count)
+		solution.assign(count, Vector6{});
+	inv_diagonal.resize(count);
+	residual.resize(count);
+	direction.resize(count);
+	preconditioned.resize(count);
+	product.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+		Invert(diagonal[i].m, inv_diagonal[i].m);
+
+	//r = b - A * x, z = P-inv * r, p = z
+	Multiply(solution, product);
+	double rhs_norm = 0.0;
+	double rz = 0.0;
+	for (size_t i = 0; i < count; ++i) {
+		for (int r = 0; r < 6; ++r)
+			residual[i].v[r] = rhs[i].v[r] - product[i].v[r];
+		preconditioned[i] = Vector6{};
+		MultiplyAdd(inv_diagonal[i].m, residual[i].v, preconditioned[i].v);
+		direction[i] = preconditioned[i];
+		rhs_norm += Dot(rhs[i].v, rhs[i].v);
+		rz += Dot(residual[i].v, preconditioned[i].v);
+	}
+
+	double threshold = (double)tolerance * tolerance * rhs_norm;
+	last_iterations = 0;
+	while (last_iterations < max_iterations) {
+		double residual_norm = 0.0;
+		for (size_t i = 0; i < count; ++i)
+			residual_norm += Dot(residual[i].v, residual[i].v);
+		if (residual_norm <= threshold)
+			break;
+
+		//alpha = r.z / p.A*p
+		Multiply(direction, product);
+		double p_ap = 0.0;
+		for (size_t i = 0; i < count; ++i)
+			p_ap += Dot(direction[i].v, product[i].v);
+		if (p_ap <= 0.0)
+			break;
+		float alpha = (float)(rz / p_ap);
+
+		double rz_new = 0.0;
+		for (size_t i = 0; i < count; ++i) {
+			for (int r = 0; r < 6; ++r) {
+				solution[i].v[r] += alpha * direction[i].v[r];
+				residual[i].v[r] -= alpha * product[i].v[r];
+			}
+			preconditioned[i] = Vector6{};
+			MultiplyAdd(inv_diagonal[i].m, residual[i].v, preconditioned[i].v);
+			rz_new += Dot(residual[i].v, preconditioned[i].v);
+		}
+
+		//p = z + beta * p
+		float beta = (float)(rz_new / rz);
+		rz = rz_new;
+		for (size_t i = 0; i < count; ++i) {
+			for (int r = 0; r < 6; ++r)
+				direction[i].v[r] = preconditioned[i].v[r] + beta * direction[i].v[r];
+		}
+		last_iterations++;
+	}
+}
+
+void ImplicitIntegrator::Step(RigidBodyStore& bodies, const SpringGraph& graph,
+	const dx::XMFLOAT3* anchor_points, float spring_coeff, float damper_coeff, dx::FXMVECTOR gravity,
+	dx::FXMVECTOR force, dx::FXMVECTOR torque, bool use_quaternion, float dt) {
+	Assemble(bodies, graph, anchor_points, spring_coeff, damper_coeff, gravity, force, torque, dt);
+	if (use_chain_solver && IsChain()) {
+		SolveChain();
+		last_iterations = 0;
+	}
+	else {
+		SolveConjugateGradient();
+	}
+
+	for (unsigned int body = 0; body < bodies.Size(); ++body) {
+		const float* du = solution[body].v;
+		dx::XMVECTOR dv = dx::XMVectorSet(du[0], du[1], du[2], 0.0f);
+		dx::XMVECTOR dw = dx::XMVectorSet(du[3], du[4], du[5], 0.0f);
+		dx::XMVECTOR v = dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.velocities[body]), dv);
+		dx::XMVECTOR w = dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.angular_velocities[body]), dw);
+
+		//P(t+h) = P(t) + M * dv, L(t+h) = L(t) + I(t) * dw
+		dx::XMStoreFloat3(&bodies.back_momenta[body], dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.momenta[body]),
+			dx::XMVectorScale(dv, 1.0f / bodies.inv_masses[body])));
+		dx::XMMATRIX inertia = dx::XMMatrixInverse(nullptr, dx::XMLoadFloat3x3(&bodies.world_inv_inertias[body]));
+		dx::XMStoreFloat3(&bodies.back_angular_momenta[body],
+			dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.angular_momenta[body]), dx::XMVector3Transform(dw, inertia)));
+
+		//c(t+h) = c(t) + h * v(t+h)
+		dx::XMStoreFloat3(&bodies.back_positions[body],
+			dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.positions[body]), dx::XMVectorScale(v, dt)));
+
+		//Rotate by h * w(t+h) about w
+		float angle = dx::XMVectorGetX(dx::XMVector3Length(w)) * dt;
+		dx::XMVECTOR dq = dx::XMQuaternionIdentity();
+		if (angle > 0.0f)
+			dq = dx::XMQuaternionRotationAxis(dx::XMVector3Normalize(w), angle);
+		if (use_quaternion) {
+			Quaternion q = Quaternion(dq).Concatenate(bodies.orientations[body]);
+			q = q.ScalarProduct(1.0f / q.Magnitude());
+			bodies.back_orientations[body] = q;
+			dx::XMStoreFloat3x3(&bodies.back_rotations[body], dx::XMMatrixRotationQuaternion(q.toVector()));
+		}
+		else {
+			bodies.back_orientations[body] = bodies.orientations[body];
+			dx::XMStoreFloat3x3(&bodies.back_rotations[body],
+				dx::XMLoadFloat3x3(&bodies.rotations[body]) * dx::XMMatrixRotationQuaternion(dq));
+		}
+	}
+	bodies.SwapBuffers();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "RigidBodyStore.h"
+#include "SpringGraph.h"
+
+/*
+* Linearly implicit (backward) Euler step for bodies connected by the spring-dampers
+* of a SpringGraph. The velocity of a body is u = [v, w].
+* Every step solves
+*   (M - h * dF/du - h^2 * dF/dx) du = h * (F + h * dF/dx * u)
+* for the change in velocity of all bodies, then moves the bodies by h * (u + du).
+* The Jacobians leave out the change of the attachment offsets with the rotation,
+* so the system matrix is symmetric positive definite.
+*/
+class ImplicitIntegrator
+{
+public:
+	//Use the O(n) block tridiagonal solve when every edge joins neighbouring bodies
+	bool use_chain_solver = true;
+	unsigned int max_iterations = 100;
+	//Residual relative to the right hand side at which the conjugate gradients stop
+	float tolerance = 1e-5f;
+
+	//Conjugate gradient iterations of the last step, 0 when the chain solver was used
+	unsigned int last_iterations = 0;
+
+	/*
+	* Advances all bodies by dt
+	* Expects the velocities and world inverse inertias of the bodies to be up to date
+	* The new state is written to the back buffer, which is then swapped in
+	* force and torque are applied to every body, gravity is scaled by the body's mass
+	*/
+	void Step(RigidBodyStore& bodies, const SpringGraph& graph, const DirectX::XMFLOAT3* anchor_points,
+		float spring_coeff, float damper_coeff, DirectX::FXMVECTOR gravity,
+		DirectX::FXMVECTOR force, DirectX::FXMVECTOR torque, bool use_quaternion, float dt);
+
+private:
+	struct Vector6 {
+		float v[6];
+	};
+	struct Block6 {
+		float m[6][6];
+	};
+	struct OffDiagonal {
+		unsigned int row;
+		unsigned int column;
+		Block6 block;
+	};
+
+	//System matrix, a 6x6 block per body and per linked pair of bodies
+	std::vector<Block6> diagonal;
+	std::vector<OffDiagonal> off_diagonal;
+	std::vector<Vector6> rhs;
+	//du of the last step, the initial guess of the next one
+	std::vector<Vector6> solution;
+
+	//Conjugate gradient work vectors
+	std::vector<Block6> inv_diagonal;
+	std::vector<Vector6> residual;
+	std::vector<Vector6> direction;
+	std::vector<Vector6> preconditioned;
+	std::vector<Vector6> product;
+	//Block tridiagonal work vectors
+	std::vector<Block6> chain_upper;
+	std::vector<Block6> chain_factor;
+	std::vector<Vector6> chain_rhs;
+
+	void Assemble(const RigidBodyStore& bodies, const SpringGraph& graph, const DirectX::XMFLOAT3* anchor_points,
+		float spring_coeff, float damper_coeff, DirectX::FXMVECTOR gravity,
+		DirectX::FXMVECTOR force, DirectX::FXMVECTOR torque, float dt);
+
+	//Returns: bool - true when the off diagonal blocks only join neighbouring bodies
+	bool IsChain() const;
+
+	//Block LU of the tridiagonal system, off_diagonal only joins neighbours
+	void SolveChain();
+
+	//Block Jacobi preconditioned conjugate gradients, starting from solution
+	void SolveConjugateGradient();
+
+	void Multiply(const std::vector<Vector6>& x, std::vector<Vector6>& y) const;
+};
@@ -30,7 +30,8 @@ void Model::LoadModel(Graphics& gfx, FBXLoader* fbx_loader, const wchar_t* tex_f
 }
 
 void Model::Draw(Graphics& gfx) {
-	SpawnModelControls();
+	if (show_controls)
+		SpawnModelControls();
 	for (unsigned int i = 0; i < controller->skeleton->hierarchy.size(); ++i)
 	{
 		//The matrices passed to the shader transform the vertex into bone space and then apply the bones animation
@@ -63,30 +64,33 @@ void Model::Draw(Graphics& gfx) {
 }
 
 
+void Model::SetPathTransform(dx::FXMVECTOR model_pos, dx::FXMVECTOR look_pos) noexcept {
+	position.x = dx::XMVectorGetX(model_pos);
+	position.y = dx::XMVectorGetY(model_pos);
+	position.z = dx::XMVectorGetZ(model_pos);
+
+	//Get rotation matrix based on COI approach 
+	dx::XMVECTOR roll = dx::XMVectorSubtract(model_pos, look_pos);
+	dx::XMVECTOR pitch = dx::XMVector3Cross(dx::XMVectorSet(0, 1, 0, 0), roll);
+	dx::XMVECTOR yaw = dx::XMVector3Cross(roll, pitch);
+	roll = dx::XMVector3Normalize(roll);
+	pitch = dx::XMVector3Normalize(pitch);
+	yaw = dx::XMVector3Normalize(yaw);
+
+	rotation = dx::XMMatrixSet(
+		pitch.m128_f32[0], pitch.m128_f32[1], pitch.m128_f32[2], 0,
+		yaw.m128_f32[0], yaw.m128_f32[1], yaw.m128_f32[2], 0,
+		roll.m128_f32[0], roll.m128_f32[1], roll.m128_f32[2], 0,
+		0, 0, 0, 1
+	);
+}
+
 void Model::Update(float dt) noexcept {
-	if (not ik_mode) {
+	if (not ik_mode && not external_transform) {
 		if (controller->animation_path) {
 			//Get current position based on the animation path
-			dx::XMVECTOR model_pos = controller->animation_path->GetCurrentPosition();
-			position.x = dx::XMVectorGetX(model_pos);
-			position.y = dx::XMVectorGetY(model_pos);
-			position.z = dx::XMVectorGetZ(model_pos);
-
-			//Get rotation matrix based on COI approach 
-			dx::XMVECTOR look_pos = controller->animation_path->GetLookPosition();
-			dx::XMVECTOR roll = dx::XMVectorSubtract(model_pos, look_pos);
-			dx::XMVECTOR pitch = dx::XMVector3Cross(dx::XMVectorSet(0, 1, 0, 0), roll);
-			dx::XMVECTOR yaw = dx::XMVector3Cross(roll, pitch);
-			roll = dx::XMVector3Normalize(roll);
-			pitch = dx::XMVector3Normalize(pitch);
-			yaw = dx::XMVector3Normalize(yaw);
-
-			rotation = dx::XMMatrixSet(
-				pitch.m128_f32[0], pitch.m128_f32[1], pitch.m128_f32[2], 0,
-				yaw.m128_f32[0], yaw.m128_f32[1], yaw.m128_f32[2], 0,
-				roll.m128_f32[0], roll.m128_f32[1], roll.m128_f32[2], 0,
-				0, 0, 0, 1
-			);
+			SetPathTransform(controller->animation_path->GetCurrentPosition(),
+				controller->animation_path->GetLookPosition());
 		}
 		else {
 			position = dx::XMFLOAT3(0.0f, 0.0f, 0.0f);
@@ -112,7 +116,8 @@ void Model::Update(float dt) noexcept {
 
 	if (ik_mode) {
 		ik_controller->Update(dt, dx::XMLoadFloat3(&position), rotation);
-		ik_controller->Process(dt);
+		if (!batch_ik)
+			ik_controller->Process(dt);
 	}
 }
 
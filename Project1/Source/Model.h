@@ -14,6 +14,8 @@ public:
 	void Draw(Graphics& gfx);
 	void Update(float dt) noexcept;
 	void Reset();
+	//Places the model at model_pos, facing the center of interest look_pos
+	void SetPathTransform(dx::FXMVECTOR model_pos, dx::FXMVECTOR look_pos) noexcept;
 
 	void SpawnModelControls() noexcept;
 
@@ -29,6 +31,12 @@ public:
 
 	//Get animations from IK Controller instead if this is true
 	bool ik_mode;
+	//The IK is solved by an IKBatchSolver together with other models instead of in Update
+	bool batch_ik = false;
+	//Show the ImGui model window, off for all but one of many models
+	bool show_controls = true;
+	//The position and rotation are set by the owner, e.g. with SetPathTransform for a crowd
+	bool external_transform = false;
 
 	dx::XMFLOAT3 position;
 	dx::XMMATRIX rotation;
@@ -1,34 +1,28 @@
 #include <vector>
-#include <queue>
 #include <iostream>
+#include <algorithm>
 #include "Path.h"
 
 #include "imgui/imgui.h"
 
-static dx::XMMATRIX bezier_mat(
-	-1, 3, -3, 1,
-	3, -6, 3, 0,
-	-3, 3, 0, 0,
-	1, 0, 0, 0
-);
-
-static float lerp(float a, float b, float t) {
-	return (t * a) + ((1 - t) * b);
-}
-
 /*
 * Resets the path time
 */
 void Path::Reset() {
 	path_time = 0;
+	ClearFrameEvaluations();
 }
 
 void Path::AddControlPoint(const dx::XMFLOAT3& new_point, unsigned int segment) {
 	control_segments[segment].push_back(new_point);
+	spans_dirty = true;
+	InvalidatePathEvaluations();
 }
 
 void Path::PopControlPoint(unsigned int segment) {
 	control_segments[segment].pop_back();
+	spans_dirty = true;
+	InvalidatePathEvaluations();
 }
 
 /*
@@ -51,30 +45,43 @@ std::vector<dx::XMFLOAT3> Path::GetAllControlPoints() {
 */
 void Path::ReplaceLastPoint(const dx::XMFLOAT3& new_point, unsigned int segment) {
 	unsigned int segment_size = control_segments[segment].size();
-	if (loop)
-		control_segments[segment][segment_size - 1] = new_point;
-	else {
-		//Pop the extra appended point and the last point
-		control_segments[segment].pop_back();
-		control_segments[segment].pop_back();
+	if (loop) {
+		SetControlPoint(new_point, segment_size - 1, segment);
+		return;
+	}
 
-		//Add the new last point
-		dx::XMFLOAT3 pn_prev = control_segments[segment].back();
-		control_segments[segment].push_back(new_point);
+	//The last point is the one before the extra appended point
+	dx::XMFLOAT3 pn_prev = control_segments[segment][segment_size - 3];
+	dx::XMFLOAT3 pn = new_point;
 
-		dx::XMFLOAT3 pn = new_point;
+	//Caclulate the new final point to append
+	dx::XMFLOAT3 diff(pn.x - pn_prev.x, pn.y - pn_prev.y, pn.z - pn_prev.z);
+	dx::XMFLOAT3 pn_next(pn.x + diff.x, pn.y + diff.y, pn.z + diff.z);
 
-		//Caclulate the new final point to append
-		dx::XMFLOAT3 diff(pn.x - pn_prev.x, pn.y - pn_prev.y, pn.z - pn_prev.z);
-		dx::XMFLOAT3 pn_next(pn.x + diff.x, pn.y + diff.y, pn.z + diff.z);
+	//Replace the last point and the extra appended point
+	SetControlPoint(pn, segment_size - 2, segment);
+	SetControlPoint(pn_next, segment_size - 1, segment);
+}
 
-		//Append the new final point
-		control_segments[segment].push_back(pn_next);
-	}
+/*
+* Moves a control point in place.
+* Only the spans using the point are re-tessellated and re-integrated.
+*/
+void Path::SetControlPoint(const dx::XMFLOAT3& new_point, unsigned int point_indx, unsigned int segment) {
+	dx::XMFLOAT3& point = control_segments[segment][point_indx];
+	//Nothing to refresh if the point did not move
+	if (point.x == new_point.x && point.y == new_point.y && point.z == new_point.z)
+		return;
+
+	point = new_point;
+	MarkControlPointDirty(point_indx, segment);
+	InvalidatePathEvaluations();
 }
 
 void Path::AddControlSegment() {
 	control_segments.push_back(control_points());
+	spans_dirty = true;
+	InvalidatePathEvaluations();
 }
 
 void Path::SetSubdivisionCount(int _subdivision_count) {
@@ -88,43 +95,10 @@ std::vector<dx::XMFLOAT3> Path::GeneratePath() {
 		//Generate the path using a different method if it's not looped
 		return GenerateUnloopedPath();
 	}
-		
 
-	std::vector<dx::XMFLOAT3> path_points;
-	for (unsigned int j = 0; j < control_segments.size(); j++) {
-		for (unsigned int i = 0; i < control_segments[j].size(); i++) {
-			dx::XMVECTOR pi_prev;
-			dx::XMVECTOR pi;
-			dx::XMVECTOR pi_next;
-			dx::XMVECTOR pi_next_next;
-
-			GetPointsFromIndex(i, j, pi_prev, pi, pi_next, pi_next_next);
-
-			// itr = ((Pi+1 - Pi-1) / k);
-			dx::XMVECTOR itr_a = dx::XMVectorScale(
-				dx::XMVectorSubtract(pi_next, pi_prev), 1.0f / k);
-
-			// a = Pi + ((Pi+1 - Pi-1) / k);
-			dx::XMVECTOR a = dx::XMVectorAdd(pi, itr_a);
-
-			// itr = ((Pi+2 - Pi) / k);
-			dx::XMVECTOR itr_b = dx::XMVectorScale(
-				dx::XMVectorSubtract(pi_next_next, pi), 1.0f / k);
-
-			// b = Pi+1 - ((Pi+2 - Pi) / k);
-			dx::XMVECTOR b = dx::XMVectorSubtract(pi_next, itr_b);
-
-			for (int j = 0; j < subdivision_count; j++) {
-				float u = (float)j / subdivision_count;
-				dx::XMVECTOR new_point = BezierFunc(u, pi, a, b, pi_next);
-				path_points.push_back(
-					dx::XMFLOAT3(
-						dx::XMVectorGetX(new_point),
-						dx::XMVectorGetY(new_point),
-						dx::XMVectorGetZ(new_point)));
-			}
-		}
-	}
+	//The caller gets the full list so nothing is left to upload
+	std::vector<dx::XMFLOAT3> path_points = GetPathVertices();
+	upload_spans.assign(spans.size(), false);
 	return path_points;
 }
 
@@ -135,108 +109,226 @@ std::vector<dx::XMFLOAT3> Path::GeneratePath() {
 * Returns: Vector<FLOAT3> - the list of points
 */
 std::vector<dx::XMFLOAT3> Path::GenerateUnloopedPath() {
+	//The spans of an unlooped path already skip the extra appended points
+	std::vector<dx::XMFLOAT3> path_points = GetPathVertices();
+	upload_spans.assign(spans.size(), false);
+	return path_points;
+}
+
+std::vector<dx::XMFLOAT3> Path::GenerateAdaptivePath(float max_error) {
+	RefreshDirtySpans();
+
 	std::vector<dx::XMFLOAT3> path_points;
-	for (unsigned int i = 1; i < control_segments[0].size() - 2; i++) {
-		dx::XMVECTOR pi_prev;
-		dx::XMVECTOR pi;
-		dx::XMVECTOR pi_next;
-		dx::XMVECTOR pi_next_next;
-
-		GetPointsFromIndexNoLoop(i, pi_prev, pi, pi_next, pi_next_next);
-
-		// itr = ((Pi+1 - Pi-1) / k);
-		dx::XMVECTOR itr_a = dx::XMVectorScale(
-			dx::XMVectorSubtract(pi_next, pi_prev), 1.0f / k);
-
-		// a = Pi + ((Pi+1 - Pi-1) / k);
-		dx::XMVECTOR a = dx::XMVectorAdd(pi, itr_a);
-
-		// itr = ((Pi+2 - Pi) / k);
-		dx::XMVECTOR itr_b = dx::XMVectorScale(
-			dx::XMVectorSubtract(pi_next_next, pi), 1.0f / k);
-
-		// b = Pi+1 - ((Pi+2 - Pi) / k);
-		dx::XMVECTOR b = dx::XMVectorSubtract(pi_next, itr_b);
-
-		for (int j = 0; j < subdivision_count; j++) {
-			float u = (float)j / subdivision_count;
-			dx::XMVECTOR new_point = BezierFunc(u, pi, a, b, pi_next);
-			path_points.push_back(
-				dx::XMFLOAT3(
-					dx::XMVectorGetX(new_point),
-					dx::XMVectorGetY(new_point),
-					dx::XMVectorGetZ(new_point)));
-		}
+	for (auto& span : spans) {
+		span.Flatten(max_error, path_points);
+	}
+	//Close the last span
+	if (!spans.empty()) {
+		path_points.emplace_back();
+		dx::XMStoreFloat3(&path_points.back(), spans.back().Evaluate(1.0f));
 	}
 	return path_points;
 }
 
+std::vector<dx::XMFLOAT3> Path::GenerateAdaptivePath(float max_pixel_error, float max_world_error,
+	dx::FXMMATRIX view_proj, float screen_width, float screen_height) {
+	RefreshDirtySpans();
+
+	std::vector<dx::XMFLOAT3> path_points;
+	for (auto& span : spans) {
+		span.FlattenProjected(max_pixel_error, max_world_error, view_proj, screen_width, screen_height, path_points);
+	}
+	//Close the last span
+	if (!spans.empty()) {
+		path_points.emplace_back();
+		dx::XMStoreFloat3(&path_points.back(), spans.back().Evaluate(1.0f));
+	}
+	return path_points;
+}
+
+const std::vector<dx::XMFLOAT3>& Path::GetPathVertices() {
+	RefreshDirtySpans();
+
+	//Tessellate everything if the path has never been generated
+	//or the subdivision count changed
+	if (path_vertices.size() != spans.size() * subdivision_count) {
+		path_vertices.resize(spans.size() * subdivision_count);
+		for (unsigned int i = 0; i < spans.size(); i++) {
+			TessellateSpan(i);
+		}
+		upload_spans.assign(spans.size(), true);
+	}
+	return path_vertices;
+}
+
+unsigned int Path::GetDirtyVertexRanges(unsigned int first_vertex[2], unsigned int vertex_count[2]) {
+	GetPathVertices();
+	unsigned int span_count = upload_spans.size();
+	auto first_iter = std::find(upload_spans.begin(), upload_spans.end(), true);
+	if (first_iter == upload_spans.end())
+		return 0;
+
+	unsigned int first_span = (unsigned int)(first_iter - upload_spans.begin());
+	unsigned int last_span = span_count - 1;
+	while (!upload_spans[last_span])
+		last_span--;
+	unsigned int dirty_begin = first_span;
+	unsigned int dirty_count = last_span + 1 - first_span;
+
+	//On a loop the changed spans start after the longest run of unchanged ones,
+	//which may be in the middle of the path when an edit is next to where the loop closes
+	if (loop) {
+		unsigned int run_begin = 0;
+		unsigned int run_count = 0;
+		unsigned int longest_begin = 0;
+		unsigned int longest_count = 0;
+		//Start at a changed span so no run of unchanged spans is cut in two
+		for (unsigned int i = 1; i <= span_count; i++) {
+			unsigned int span_indx = (first_span + i) % span_count;
+			if (upload_spans[span_indx]) {
+				run_count = 0;
+				continue;
+			}
+			if (run_count == 0)
+				run_begin = span_indx;
+			run_count++;
+			if (run_count > longest_count) {
+				longest_begin = run_begin;
+				longest_count = run_count;
+			}
+		}
+		dirty_begin = (longest_begin + longest_count) % span_count;
+		dirty_count = span_count - longest_count;
+	}
+	upload_spans.assign(span_count, false);
+
+	first_vertex[0] = dirty_begin * subdivision_count;
+	if (dirty_begin + dirty_count <= span_count) {
+		vertex_count[0] = dirty_count * subdivision_count;
+		return 1;
+	}
+	vertex_count[0] = (span_count - dirty_begin) * subdivision_count;
+	first_vertex[1] = 0;
+	vertex_count[1] = (dirty_begin + dirty_count - span_count) * subdivision_count;
+	return 2;
+}
+
+void Path::TessellateSpan(unsigned int span_indx) {
+	//The same subdivision u values are used for every span
+	if (subdivision_u.size() != subdivision_count) {
+		subdivision_u.resize(subdivision_count);
+		for (int i = 0; i < subdivision_count; i++) {
+			subdivision_u[i] = (float)i / subdivision_count;
+		}
+	}
+	spans[span_indx].Evaluate(subdivision_u.data(), subdivision_count,
+		&path_vertices[span_indx * subdivision_count]);
+}
+
 /*
-* Generates the forward difference table to evalute the distance for the
-* space curve using the adaptive approach.
-* If use_adaptive = true then expand the table using adapative approach
+* Generates the arc length tables to evalute the distance for the
+* space curve. The speed |P'(u)| of every span is integrated with
+* Gauss-Legendre quadrature up to arc_length_tolerance.
 * Returns: void
 */
-void Path::GenerateForwardDiffTable(bool use_adaptive) {
-	const float delta_u = 0.01f;
-	unsigned int n = 1 / delta_u;
-	for (unsigned int j = 0; j < control_segments.size(); j++) {
-		//Create a forward difference table for each segment
-		fwrd_diff_tables.push_back(forward_diff_table());
-		fwrd_diff_tables.back().insert(std::make_pair(0.0f, 0.0f));
-
-		float Si;
-		float Ui = 0.0f;
-		float Ui_prev = Ui;
-		float approx_distance;
-		for (unsigned int i = 1; i < n; i++) {
-			Ui = Ui_prev + delta_u;
-			//approx_distance = ||P(Ui) - P(Ui-1)||
-			approx_distance = dx::XMVectorGetX(dx::XMVector4Length(
-				dx::XMVectorSubtract(GetSegmentPosition(Ui, j), GetSegmentPosition(Ui_prev,  j))));
-			Si = GetSegmentDistance(Ui_prev, j) + approx_distance;
-			fwrd_diff_tables.back().insert(std::make_pair(Ui, Si));
-			Ui_prev = Ui;
-		}
-		//Insert one more for Ui = 1
-		Ui = 1.0f;
-		//approx_distance = ||P(Ui) - P(Ui-1)||
-		approx_distance = dx::XMVectorGetX(dx::XMVector4Length(
-			dx::XMVectorSubtract(GetSegmentPosition(Ui, j), GetSegmentPosition(Ui_prev, j))));
-		Si = GetSegmentDistance(Ui_prev, j) + approx_distance;
-		fwrd_diff_tables.back().insert(std::make_pair(Ui, Si));
+void Path::GenerateArcLengthTable() {
+	RefreshDirtySpans();
+
+	arc_length_tables.resize(spans.size() * (arc_length_samples + 1));
+	for (unsigned int i = 0; i < spans.size(); i++) {
+		BuildSpanArcLengths(i);
+	}
 
+	span_length_prefix.assign(spans.size() + 1, 0.0f);
+	UpdateLengthPrefix(0);
+	InvalidatePathEvaluations();
+}
+
+void Path::BuildSpanArcLengths(unsigned int span_indx) {
+	const unsigned int max_depth = 8;
+	const CubicSpan& span = spans[span_indx];
+	float* table = &arc_length_tables[span_indx * (arc_length_samples + 1)];
+
+	//Si = Si-1 + integral of |P'(u)| from Ui-1 to Ui
+	table[0] = 0.0f;
+	float Ui_prev = 0.0f;
+	for (unsigned int i = 1; i <= arc_length_samples; i++) {
+		float Ui = (float)i / arc_length_samples;
+		float interval_length = span.GetArcLength(Ui_prev, Ui);
+		table[i] = table[i - 1] +
+			IntegrateArcLength(span, Ui_prev, Ui, interval_length, arc_length_tolerance, max_depth);
+		Ui_prev = Ui;
 	}
+}
 
-	if (use_adaptive)
-		AdaptiveExpand();
+float Path::IntegrateArcLength(const CubicSpan& span, float ua, float ub,
+	float whole, float tolerance, unsigned int max_depth) {
+	float um = (ua + ub) * 0.5f;
+	float left = span.GetArcLength(ua, um);
+	float right = span.GetArcLength(um, ub);
+	if (max_depth == 0 || abs(left + right - whole) <= tolerance)
+		return left + right;
+
+	//Each half gets half the error budget
+	return IntegrateArcLength(span, ua, um, left, tolerance * 0.5f, max_depth - 1) +
+		IntegrateArcLength(span, um, ub, right, tolerance * 0.5f, max_depth - 1);
+}
+
+void Path::UpdateLengthPrefix(unsigned int first_span) {
+	for (unsigned int i = first_span; i < spans.size(); i++) {
+		span_length_prefix[i + 1] = span_length_prefix[i] +
+			arc_length_tables[i * (arc_length_samples + 1) + arc_length_samples];
+	}
 }
 
 void Path::GenerateDefaultVelocityFunction() {
-	velocity_function.clear();
+	velocity_profile.Clear();
 
 	const float t1 = 0.3;
 	const float t2 = 0.6;
 	const float Vc = constant_velocity;
 
 	//Accelerate to Vc until t1
-	velocity_function.insert(
-		{ t1, Vc }
-	);
+	velocity_profile.AddLinearSegment(t1, Vc);
 	//Maintain constant Vc until t2
-	velocity_function.insert(
-		{ t2, Vc }
-	);
+	velocity_profile.AddLinearSegment(t2, Vc);
 	//Deccelerate to 0 until 1
-	velocity_function.insert(
-		{ 1, 0 }
-	);
+	velocity_profile.AddLinearSegment(1, 0);
 
-	max_distance = GetDistanceFromTime(loop_time);
+	max_distance = velocity_profile.GetTotalDistance();
+	ClearFrameEvaluations();
+}
+
+void Path::SetVelocityProfile(const VelocityProfile& profile) {
+	velocity_profile = profile;
+	max_distance = velocity_profile.GetTotalDistance();
+	ClearFrameEvaluations();
 }
 
 void Path::Update(float dt) {
 	path_time += dt;
+	ClearFrameEvaluations();
+}
+
+void Path::ClearFrameEvaluations() {
+	frame_evaluations.position_valid = false;
+	frame_evaluations.look_position_valid = false;
+	frame_evaluations.velocity_valid = false;
+}
+
+void Path::ValidateFrameEvaluations() {
+	if (frame_evaluations.loop_time != loop_time ||
+		frame_evaluations.look_ahead_time != constant_look_ahead_time) {
+		ClearFrameEvaluations();
+		frame_evaluations.loop_time = loop_time;
+		frame_evaluations.look_ahead_time = constant_look_ahead_time;
+	}
+}
+
+void Path::InvalidatePathEvaluations() {
+	ClearFrameEvaluations();
+	total_length = -1.0f;
+	last_S = -1.0f;
 }
 
 void Path::Scale(float s_x, float s_y, float s_z) {
@@ -247,6 +339,8 @@ void Path::Scale(float s_x, float s_y, float s_z) {
 			control_segments[j][i].z *= s_z;
 		}
 	}
+	spans_dirty = true;
+	InvalidatePathEvaluations();
 }
 
 /*
@@ -268,68 +362,55 @@ void Path::ShowPathControls() {
 }
 
 dx::XMVECTOR Path::GetSegmentPosition(float u, unsigned int segment_indx) {
-	float point_indx_f = 0.0f;
-	int point_indx = 0;
-	float final_u = 0.0f;
+	RefreshDirtySpans();
+
+	unsigned int span_indx;
+	float span_u;
+	GetSpanFromSegmentU(u, segment_indx, span_indx, span_u);
+	return spans[segment_span_offsets[segment_indx] + span_indx].Evaluate(span_u);
+}
+
+void Path::GetSpanFromSegmentU(float u, unsigned int segment_indx,
+	unsigned int& span_indx, float& span_u) {
+	//If it's not a loop then the first and last points are not part of the path
+	//and the spans start from the second point
+	unsigned int span_count =
+		segment_span_offsets[segment_indx + 1] - segment_span_offsets[segment_indx];
 	if (u == 1) {
-		//If it's not a loop then discount the first and last points 
-		// as they are not part of the path
-		if (not loop)
-			point_indx = control_segments[segment_indx].size() - 3;
-		else
-			point_indx = control_segments[segment_indx].size() - 1;
-		final_u = 1;
+		span_indx = span_count - 1;
+		span_u = 1;
 	}
 	else if (u == 0) {
-		//If it's not a loop then discount the first and last points 
-		// as they are not part of the path
-		if (not loop) 
-			point_indx = 1;
-		else 
-			point_indx = 0;
-		final_u = 0;
+		span_indx = 0;
+		span_u = 0;
 	}
 	else {
-		if (not loop) {
-			//If it's not a loop then discount the first and last points 
-			// as they are not part of the path
-			point_indx_f = u * (control_segments[segment_indx].size() - 3);
-			point_indx = (int)point_indx_f;
-			final_u = point_indx_f - point_indx;
-			point_indx += 1;
-		}
-		else {
-			point_indx_f = u * control_segments[segment_indx].size();
-			point_indx = (int)point_indx_f;
-			final_u = point_indx_f - point_indx;
+		float span_indx_f = u * span_count;
+		span_indx = (unsigned int)span_indx_f;
+		span_u = span_indx_f - span_indx;
+		//Guard against u rounding up onto the end of the last span
+		if (span_indx >= span_count) {
+			span_indx = span_count - 1;
+			span_u = 1;
 		}
 	}
+}
 
-	dx::XMVECTOR pi_prev;
-	dx::XMVECTOR pi;
-	dx::XMVECTOR pi_next;
-	dx::XMVECTOR pi_next_next;
-	
-	if (not loop)
-		GetPointsFromIndexNoLoop(point_indx, pi_prev, pi, pi_next, pi_next_next);
-	else
-		GetPointsFromIndex(point_indx, segment_indx, pi_prev, pi, pi_next, pi_next_next);
-
-	// itr = ((Pi+1 - Pi-1) / k);
-	dx::XMVECTOR itr_a = dx::XMVectorScale(
-		dx::XMVectorSubtract(pi_next, pi_prev), 1.0f / k);
-
-	// a = Pi + ((Pi+1 - Pi-1) / k);
-	dx::XMVECTOR a = dx::XMVectorAdd(pi, itr_a);
-
-	// itr = ((Pi+2 - Pi) / k);
-	dx::XMVECTOR itr_b = dx::XMVectorScale(
-		dx::XMVectorSubtract(pi_next_next, pi), 1.0f / k);
-
-	// b = Pi+1 - ((Pi+2 - Pi) / k);
-	dx::XMVECTOR b = dx::XMVectorSubtract(pi_next, itr_b);
+void Path::GetSegmentPositions(const float* u, unsigned int count,
+	unsigned int segment_indx, dx::XMFLOAT3* out_points) {
+	RefreshDirtySpans();
 
-	return BezierFunc(final_u, pi, a, b, pi_next);
+	//Resolve the span of each sample and evaluate them four spans at a time
+	if (sample_spans.size() < count) {
+		sample_spans.resize(count);
+		sample_span_u.resize(count);
+	}
+	unsigned int span_indx;
+	for (unsigned int i = 0; i < count; i++) {
+		GetSpanFromSegmentU(u[i], segment_indx, span_indx, sample_span_u[i]);
+		sample_spans[i] = &spans[segment_span_offsets[segment_indx] + span_indx];
+	}
+	CubicSpan::EvaluateSpans(sample_spans.data(), sample_span_u.data(), count, out_points);
 }
 
 dx::XMVECTOR Path::GetPosition(float u) {
@@ -352,51 +433,98 @@ dx::XMVECTOR Path::GetPosition(float u) {
 	return GetSegmentPosition(point_u, segment_indx);
 }
 
-float Path::GetSegmentDistance(float u, unsigned int segment_indx) {
-	//Get corresponding segment forward diff table and
-	//access it with the closest Ui >= U
-	//Access is O(logN)
-	auto Ui_iter = fwrd_diff_tables[segment_indx].lower_bound(u);
-	float Ui = (*Ui_iter).first;
-
-	//Found an exact match in the forward difference table
-	if (Ui == u) {
-		//Return corresponding Si
-		return (*Ui_iter).second;
-	}
-	//No exact match, interpolate the distance between Ui and Ui-1
-	else {
-		float Si = (*Ui_iter).second;
-		//Get Ui-1
-		float Ui_prev = (*(--Ui_iter)).first;
-		float t_u = (u - Ui_prev) / (Ui - Ui_prev);
-		//Lerp between Si and Si-1
-		float Si_prev = (*Ui_iter).second;
-		return lerp(Si_prev, Si, t_u);;
+void Path::UpdateSpanBVH() {
+	RefreshDirtySpans();
+	if (span_bvh_dirty) {
+		span_bvh.Build(spans.data(), spans.size());
+		span_bvh_dirty = false;
 	}
 }
 
+float Path::GetPathU(unsigned int span_indx, float span_u) {
+	//Find the segment the span belongs to
+	unsigned int segment_indx = (unsigned int)(std::upper_bound(
+		segment_span_offsets.begin(), segment_span_offsets.end(), span_indx) -
+		segment_span_offsets.begin()) - 1;
+	unsigned int span_count =
+		segment_span_offsets[segment_indx + 1] - segment_span_offsets[segment_indx];
+
+	//Inverse of GetPosition and GetSpanFromSegmentU
+	float segment_u = (span_indx - segment_span_offsets[segment_indx] + span_u) / span_count;
+	return (segment_indx + segment_u) / control_segments.size();
+}
+
+float Path::GetClosestPoint(const dx::XMFLOAT3& point, dx::XMFLOAT3& closest_point) {
+	UpdateSpanBVH();
+
+	PathProjection projection = span_bvh.GetClosestPoint(point);
+	closest_point = projection.position;
+	return GetPathU(projection.span_indx, projection.span_u);
+}
+
+void Path::GetClosestPoints(const dx::XMFLOAT3* points, unsigned int count,
+	float* out_u, dx::XMFLOAT3* out_points) {
+	UpdateSpanBVH();
+
+	std::vector<PathProjection> projections(count);
+	span_bvh.GetClosestPoints(points, count, projections.data());
+	for (unsigned int i = 0; i < count; i++) {
+		out_u[i] = GetPathU(projections[i].span_indx, projections[i].span_u);
+		out_points[i] = projections[i].position;
+	}
+}
+
+float Path::GetSegmentDistance(float u, unsigned int segment_indx) {
+	RefreshDirtySpans();
+
+	unsigned int span_indx;
+	float span_u;
+	GetSpanFromSegmentU(u, segment_indx, span_indx, span_u);
+	span_indx += segment_span_offsets[segment_indx];
+
+	//Distance covered by the previous spans of the segment
+	float concat_distance =
+		span_length_prefix[span_indx] - span_length_prefix[segment_span_offsets[segment_indx]];
+
+	return concat_distance + GetSpanDistance(span_indx, span_u);
+}
+
+float Path::GetSpanDistance(unsigned int span_indx, float u) {
+	const float* table = &arc_length_tables[span_indx * (arc_length_samples + 1)];
+
+	//The table is evenly spaced in u so the entry is found directly
+	float Ui_f = u * arc_length_samples;
+	unsigned int Ui_indx = (unsigned int)Ui_f;
+	if (Ui_indx >= arc_length_samples)
+		return table[arc_length_samples];
+
+	//Lerp between Si and Si+1
+	float t_u = Ui_f - Ui_indx;
+	return table[Ui_indx] + (table[Ui_indx + 1] - table[Ui_indx]) * t_u;
+}
+
 float Path::GetDistance(float u) {
 	int segment_indx;
 	float segment_u;
 	//Convert normalized u to segment table u
 	if (u == 1) {
-		segment_indx = control_segments.size() - 1;
-		segment_u = 1;
+		//The total length only changes with the path
+		if (total_length < 0.0f) {
+			RefreshDirtySpans();
+			total_length = span_length_prefix.back();
+		}
+		return total_length;
 	}
 	else {
 		float t_u = u * control_segments.size();
 		segment_indx = (int)t_u;
 		segment_u = t_u - segment_indx;
 	}
-	
 
-	//Concatenate the previous segment table distances
-	float concat_distance = 0.0f;
-	for (unsigned int i = 0; i < segment_indx; i++) {
-		concat_distance += GetSegmentDistance(1, i);
-	}
-	
+	RefreshDirtySpans();
+	//Distance covered by the previous segments
+	float concat_distance = span_length_prefix[segment_span_offsets[segment_indx]];
+
 	return (GetSegmentDistance(segment_u, segment_indx) + concat_distance);
 }
 
@@ -407,6 +535,10 @@ float Path::GetDistance(float u) {
 * Returns: float - u
 */
 float Path::GetU(float S) {
+	//The same distance is often inverted several times in a frame
+	if (S == last_S)
+		return last_U;
+
 	const float threshold = 0.00001f;
 	const float compare_threshold = 0.0001f;
 	float Ua = 0.0f;
@@ -426,30 +558,15 @@ float Path::GetU(float S) {
 			Ub = Um;
 		Um_prev = Um;
 	} while (abs(S - Sm) > threshold);
+
+	last_S = S;
+	last_U = Um;
 	return Um;
 }
 
 float Path::GetVelocity(float t) {
 	float normalized_t = GetNormalizedT(t);
-
-	//Get Ti and Ti-1 where Ti-1 <= t <= Ti
-	auto velo_func_iter = velocity_function.lower_bound(normalized_t);
-	float curr_velo = (*velo_func_iter).second;
-	float curr_t = (*velo_func_iter).first;
-	float prev_velo, prev_t;
-	if (velo_func_iter == velocity_function.begin()) {
-		prev_velo = 0;
-		prev_t = 0;
-	}
-	else {
-		--velo_func_iter;
-		prev_velo = (*velo_func_iter).second;
-		prev_t = (*velo_func_iter).first;
-	}
-	// Vi(t) = ((Vi - Vi-1)/(ti - ti-1))(t - ti-1) + Vi-1
-	float velo_change = (((curr_velo - prev_velo) * (normalized_t - prev_t)) /
-							(curr_t - prev_t));
-	return  velo_change + prev_velo;
+	return velocity_profile.GetVelocity(normalized_t);
 }
 
 float Path::GetDistanceFromTime(float t) {
@@ -458,33 +575,11 @@ float Path::GetDistanceFromTime(float t) {
 		return 0;
 
 	float normalized_t = GetNormalizedT(t);
+	return velocity_profile.GetDistance(normalized_t);
+}
 
-	//Get Ti and Ti-1 where Ti-1 <= t <= Ti
-	auto velo_func_iter = velocity_function.lower_bound(normalized_t);
-	
-	float curr_velo = (*velo_func_iter).second;
-	float curr_t = (*velo_func_iter).first;
-	float prev_velo, prev_t;
-	if (velo_func_iter == velocity_function.begin()) {
-		prev_velo = 0;
-		prev_t = 0;
-	}
-	else {
-		--velo_func_iter;
-		prev_velo = (*velo_func_iter).second;
-		prev_t = (*velo_func_iter).first;
-	}
-
-	float distance = ((curr_velo - prev_velo) / (curr_t - prev_t)) * 
-					 (((normalized_t * normalized_t) / 2) - (normalized_t * prev_t)) + 
-					 (prev_velo * normalized_t);
-	
-	/*float distance = (0.5f * (curr_velo - prev_velo) * (normalized_t - prev_t)) +
-		(prev_velo * (curr_velo - prev_velo));*/
-
-	float prev_distance = GetDistanceFromTime(prev_t*loop_time);
-
-	return distance + prev_distance;
+float Path::GetTimeFromDistance(float S) {
+	return velocity_profile.GetTime(S) * loop_time;
 }
 
 float Path::GetNormalizedDistanceFromTime(float t) {
@@ -502,14 +597,26 @@ float Path::GetCurrentPathTime() {
 }
 
 dx::XMVECTOR Path::GetCurrentPosition() {
+	ValidateFrameEvaluations();
+	if (frame_evaluations.position_valid)
+		return dx::XMLoadFloat3(&frame_evaluations.position);
+
 	/*float curr_distance = GetDistanceFromTime(path_time);*/
 	float norm_distance = GetSinDistanceFromTime(path_time);
 	float curr_distance = norm_distance * GetDistance(1);
 	float curr_u = GetU(curr_distance);
-	return GetPosition(curr_u);
+	dx::XMVECTOR position = GetPosition(curr_u);
+
+	dx::XMStoreFloat3(&frame_evaluations.position, position);
+	frame_evaluations.position_valid = true;
+	return position;
 }
 
 dx::XMVECTOR Path::GetLookPosition() {
+	ValidateFrameEvaluations();
+	if (frame_evaluations.look_position_valid)
+		return dx::XMLoadFloat3(&frame_evaluations.look_position);
+
 	unsigned int average_count = 3;
 	float norm_distance;
 	dx::XMVECTOR pos = dx::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
@@ -519,62 +626,169 @@ dx::XMVECTOR Path::GetLookPosition() {
 		float curr_u = GetU(curr_distance);
 		pos = dx::XMVectorAdd(GetPosition(curr_u), pos);
 	}
-	return dx::XMVectorScale(pos, 1.0f / average_count);
+	pos = dx::XMVectorScale(pos, 1.0f / average_count);
+
+	dx::XMStoreFloat3(&frame_evaluations.look_position, pos);
+	frame_evaluations.look_position_valid = true;
+	return pos;
 }
 
 float Path::GetCurrentVelocity() {
-	return GetVelocity(path_time);
+	ValidateFrameEvaluations();
+	if (!frame_evaluations.velocity_valid) {
+		frame_evaluations.velocity = GetVelocity(path_time);
+		frame_evaluations.velocity_valid = true;
+	}
+	return frame_evaluations.velocity;
 }
 
-dx::XMVECTOR Path::BezierFunc(float u, 
-	const dx::XMVECTOR& p0, const dx::XMVECTOR& p1, 
-	const dx::XMVECTOR& p2, const dx::XMVECTOR& p3) {
-	dx::XMVECTOR u_v = dx::XMVectorSet(u * u * u, u * u, u, 1);
+CubicSpan Path::BuildSpan(dx::FXMVECTOR pi_prev, dx::FXMVECTOR pi,
+	dx::FXMVECTOR pi_next, dx::GXMVECTOR pi_next_next) {
+	// itr = ((Pi+1 - Pi-1) / k);
+	dx::XMVECTOR itr_a = dx::XMVectorScale(
+		dx::XMVectorSubtract(pi_next, pi_prev), 1.0f / k);
 
-	// X value for the point ----
-	dx::XMVECTOR x_points = 
-		dx::XMVectorSet(
-			dx::XMVectorGetX(p0),
-			dx::XMVectorGetX(p1),
-			dx::XMVectorGetX(p2),
-			dx::XMVectorGetX(p3));
+	// a = Pi + ((Pi+1 - Pi-1) / k);
+	dx::XMVECTOR a = dx::XMVectorAdd(pi, itr_a);
 
-	dx::XMVECTOR x_res = dx::XMVector4Transform(x_points, bezier_mat);
+	// itr = ((Pi+2 - Pi) / k);
+	dx::XMVECTOR itr_b = dx::XMVectorScale(
+		dx::XMVectorSubtract(pi_next_next, pi), 1.0f / k);
+
+	// b = Pi+1 - ((Pi+2 - Pi) / k);
+	dx::XMVECTOR b = dx::XMVectorSubtract(pi_next, itr_b);
+
+	return CubicSpan::FromBezier(pi, a, b, pi_next);
+}
+
+void Path::UpdateSpanCoefficients() {
+	if (not spans_dirty)
+		return;
+
+	dx::XMVECTOR pi_prev;
+	dx::XMVECTOR pi;
+	dx::XMVECTOR pi_next;
+	dx::XMVECTOR pi_next_next;
+
+	spans.clear();
+	segment_span_offsets.resize(control_segments.size() + 1);
+	for (unsigned int j = 0; j < control_segments.size(); j++) {
+		segment_span_offsets[j] = spans.size();
+		if (not loop) {
+			//The unlooped path only uses the first segment and skips the
+			//extra points appended to its start and end
+			if (j != 0 || control_segments[0].size() < 4)
+				continue;
+			for (unsigned int i = 1; i < control_segments[0].size() - 2; i++) {
+				GetPointsFromIndexNoLoop(i, pi_prev, pi, pi_next, pi_next_next);
+				spans.push_back(BuildSpan(pi_prev, pi, pi_next, pi_next_next));
+			}
+		}
+		else {
+			for (unsigned int i = 0; i < control_segments[j].size(); i++) {
+				GetPointsFromIndex(i, j, pi_prev, pi, pi_next, pi_next_next);
+				spans.push_back(BuildSpan(pi_prev, pi, pi_next, pi_next_next));
+			}
+		}
+	}
+	segment_span_offsets[control_segments.size()] = spans.size();
+
+	dirty_spans.assign(spans.size(), false);
+	dirty_span_list.clear();
+	spans_dirty = false;
+	span_bvh_dirty = true;
+
+	//Regenerate everything that was built from the old spans
+	if (!path_vertices.empty()) {
+		path_vertices.resize(spans.size() * subdivision_count);
+		for (unsigned int i = 0; i < spans.size(); i++) {
+			TessellateSpan(i);
+		}
+		upload_spans.assign(spans.size(), true);
+	}
+	if (!arc_length_tables.empty()) {
+		arc_length_tables.resize(spans.size() * (arc_length_samples + 1));
+		for (unsigned int i = 0; i < spans.size(); i++) {
+			BuildSpanArcLengths(i);
+		}
+		span_length_prefix.assign(spans.size() + 1, 0.0f);
+		UpdateLengthPrefix(0);
+	}
+}
 
-	x_res = dx::XMVector4Dot(u_v, x_res);
-	// -----------
+void Path::MarkControlPointDirty(unsigned int point_indx, unsigned int segment) {
+	//Every span is rebuilt anyway
+	if (spans_dirty || spans.empty())
+		return;
 
-	// Y value for the point ----
-	dx::XMVECTOR y_points = 
-		dx::XMVectorSet(
-			dx::XMVectorGetY(p0),
-			dx::XMVectorGetY(p1),
-			dx::XMVectorGetY(p2),
-			dx::XMVectorGetY(p3));
+	int span_count = spans.size();
+	int first_span, last_span;
+	if (not loop) {
+		//Span i is built from the points i to i+3
+		first_span = (int)point_indx - 3;
+		last_span = point_indx;
+	}
+	else {
+		//Span i is built from the points i-1 to i+2 of the whole loop
+		int loop_indx = segment_span_offsets[segment] + point_indx;
+		first_span = loop_indx - 2;
+		last_span = loop_indx + 1;
+	}
 
-	dx::XMVECTOR y_res = dx::XMVector4Transform(y_points, bezier_mat);
+	for (int i = first_span; i <= last_span; i++) {
+		int span_indx = i;
+		if (loop)
+			span_indx = (i + span_count) % span_count;
+		else if (i < 0 || i >= span_count)
+			continue;
 
-	y_res = dx::XMVector4Dot(u_v, y_res);
-	// -----------
+		if (!dirty_spans[span_indx]) {
+			dirty_spans[span_indx] = true;
+			dirty_span_list.push_back(span_indx);
+		}
+	}
+}
 
-	// Z value for the point ----
-	dx::XMVECTOR z_points = 
-		dx::XMVectorSet(
-			dx::XMVectorGetZ(p0),
-			dx::XMVectorGetZ(p1),
-			dx::XMVectorGetZ(p2),
-			dx::XMVectorGetZ(p3));
+void Path::RefreshDirtySpans() {
+	UpdateSpanCoefficients();
+	if (dirty_span_list.empty())
+		return;
 
-	dx::XMVECTOR z_res = dx::XMVector4Transform(z_points, bezier_mat);
+	dx::XMVECTOR pi_prev;
+	dx::XMVECTOR pi;
+	dx::XMVECTOR pi_next;
+	dx::XMVECTOR pi_next_next;
 
-	z_res = dx::XMVector4Dot(u_v, z_res);
-	// -----------
+	unsigned int first_dirty = spans.size();
+	for (unsigned int span_indx : dirty_span_list) {
+		//Find the segment the span belongs to
+		unsigned int segment_indx = (unsigned int)(std::upper_bound(
+			segment_span_offsets.begin(), segment_span_offsets.end(), span_indx) -
+			segment_span_offsets.begin()) - 1;
+		unsigned int point_indx = span_indx - segment_span_offsets[segment_indx];
 
-	return dx::XMVectorSet(
-		dx::XMVectorGetX(x_res),
-		dx::XMVectorGetX(y_res),
-		dx::XMVectorGetX(z_res),
-		1.0f);
+		if (not loop)
+			GetPointsFromIndexNoLoop(point_indx + 1, pi_prev, pi, pi_next, pi_next_next);
+		else
+			GetPointsFromIndex(point_indx, segment_indx, pi_prev, pi, pi_next, pi_next_next);
+		spans[span_indx] = BuildSpan(pi_prev, pi, pi_next, pi_next_next);
+
+		if (!path_vertices.empty()) {
+			TessellateSpan(span_indx);
+			upload_spans[span_indx] = true;
+		}
+		if (!arc_length_tables.empty())
+			BuildSpanArcLengths(span_indx);
+
+		dirty_spans[span_indx] = false;
+		span_bvh_dirty = true;
+		first_dirty = (std::min)(first_dirty, span_indx);
+	}
+	dirty_span_list.clear();
+
+	//Only the lengths after the first edited span change
+	if (!arc_length_tables.empty())
+		UpdateLengthPrefix(first_dirty);
 }
 
 void Path::AddDefaultControlPoints() {
@@ -642,56 +856,6 @@ void Path::GetPointsFromIndexNoLoop(unsigned int point_indx,
 		pi_next_next = dx::XMLoadFloat3(&control_segments[0][point_indx] + 2);
 }
 
-void Path::AdaptiveExpand() {
-	const float len_diff_threshold = 1.0f;
-	const float U_diff_threshold = 0.01f;
-	unsigned int segment_indx = 0;
-	for (auto& fwrd_diff_table : fwrd_diff_tables) {
-		std::queue<std::pair<float, float>> segment_list;
-		segment_list.push(std::make_pair(0.0f, 1.0f));
-		float Um, Ua, Ub;
-		float A, B, C, D;
-		while (!segment_list.empty()) {
-			Ua = segment_list.front().first;
-			Ub = segment_list.front().second;
-			segment_list.pop();
-			//Find middle U
-			Um = ((Ua + Ub) / 2);
-			//Calculate A, B, C and D
-			//A = |P(Ua) - P(Um)|
-			A = dx::XMVectorGetX(dx::XMVector4Length(
-				dx::XMVectorSubtract(GetSegmentPosition(Ua, segment_indx), 
-									 GetSegmentPosition(Um, segment_indx))));
-
-			//B = |P(Um) - P(Ub)|
-			B = dx::XMVectorGetX(dx::XMVector4Length(
-				dx::XMVectorSubtract(GetSegmentPosition(Um, segment_indx), 
-									 GetSegmentPosition(Ub, segment_indx))));
-
-			//C = |P(Ua) - P(Ub)|
-			C = dx::XMVectorGetX(dx::XMVector4Length(
-				dx::XMVectorSubtract(GetSegmentPosition(Ua, segment_indx),
-									 GetSegmentPosition(Ub, segment_indx))));
-
-			//D = |A + B - C|
-			D = abs(A + B - C);
-
-			if (D > len_diff_threshold ||
-				abs(Ub - Ua) > U_diff_threshold) {
-				segment_list.push(std::make_pair(Ua, Um));
-				segment_list.push(std::make_pair(Um, Ub));
-			}
-			else {
-				fwrd_diff_table.insert(
-					std::make_pair(Um, A + GetSegmentDistance(Ua, segment_indx)));
-				fwrd_diff_table.insert(
-					std::make_pair(Ub, B + GetSegmentDistance(Um, segment_indx)));
-			}
-		}
-		segment_indx++;
-	}
-}
-
 /*
 * Append extra points to the start and end of the path if there's no loop
 * for the bezier function
@@ -727,6 +891,8 @@ void Path::AppendExtraPoints() {
 
 	//Append the new final point
 	control_segments[0].push_back(pn_next);
+	spans_dirty = true;
+	InvalidatePathEvaluations();
 }
 
 float Path::GetNormalizedT(float t) {
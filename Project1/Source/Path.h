@@ -1,11 +1,15 @@
 #pragma once
 #include <DirectXMath.h>
-#include <map>
+#include <vector>
+#include "CubicSpan.h"
+#include "PathBVH.h"
+#include "VelocityProfile.h"
 
 namespace dx = DirectX;
 
 class Path
 {
+	friend class SharedPath;
 private:
 	static const int k = 8;
 	int subdivision_count;
@@ -21,16 +25,19 @@ private:
 	std::vector<control_points> control_segments;
 	
 	/*
-	* A list of forward difference tables.
-	* Each forward difference table is used to evaluate the distance function
-	* for a particular segment.
-	* Final distance is calculated by concatenating the distances.
+	* Arc length tables for all the spans, stored back to back.
+	* Each span has arc_length_samples + 1 entries, the distance from the
+	* start of the span at evenly spaced u values.
+	* Final distance is calculated by adding the span distance to the
+	* cumulative length of all the previous spans.
 	*/
-	typedef std::map<float, float> forward_diff_table;
-	std::vector<forward_diff_table> fwrd_diff_tables;
+	static const unsigned int arc_length_samples = 16;
+	std::vector<float> arc_length_tables;
+	//span_length_prefix[i] is the length of the path up to the start of span i
+	std::vector<float> span_length_prefix;
 	
-	//The constant velocity for movement 
-	std::map<float, float> velocity_function;
+	//Velocity over the normalized path time 
+	VelocityProfile velocity_profile;
 	
 	float path_time = 0.0f;
 
@@ -38,12 +45,135 @@ private:
 	float max_distance;
 
 	/*
-	* Evaluates the polynomial using a bezier matrix and 4 points
-	* Returns: VECTOR  - the point evaluated at u
+	* Evaluations for the current path_time, reused by every query in a frame.
+	* Cleared by Update, Reset and any change to the path.
 	*/
-	static dx::XMVECTOR BezierFunc(float u, 
-		const dx::XMVECTOR& p0, const dx::XMVECTOR& p1, 
-		const dx::XMVECTOR& p2, const dx::XMVECTOR& p3);
+	struct FrameEvaluations {
+		bool position_valid = false;
+		bool look_position_valid = false;
+		bool velocity_valid = false;
+		dx::XMFLOAT3 position;
+		dx::XMFLOAT3 look_position;
+		float velocity;
+		//Settings the evaluations were made with, they can change through the controls
+		float loop_time = 0.0f;
+		float look_ahead_time = 0.0f;
+	};
+	FrameEvaluations frame_evaluations;
+
+	//Length of the whole path, negative until it is calculated
+	float total_length = -1.0f;
+	//The last inverse arc length query, negative if there is none
+	float last_S = -1.0f;
+	float last_U;
+
+	//Clears the evaluations for the current path_time
+	void ClearFrameEvaluations();
+
+	//Clears the frame evaluations if the settings they depend on changed
+	void ValidateFrameEvaluations();
+
+	//Clears everything that depends on the shape of the path
+	void InvalidatePathEvaluations();
+
+	/*
+	* Cached polynomial coefficients for every span, segment after segment.
+	* A span is the curve between two consecutive control points.
+	* Rebuilt only when the control points change.
+	*/
+	std::vector<CubicSpan> spans;
+	//Index of the first span of each segment, plus one past the last span
+	std::vector<unsigned int> segment_span_offsets;
+	//Set when control points are added or removed so every span is rebuilt
+	bool spans_dirty = true;
+
+	/*
+	* Spans whose control points moved since they were last evaluated.
+	* Only these spans are re-tessellated and re-integrated.
+	*/
+	std::vector<bool> dirty_spans;
+	std::vector<unsigned int> dirty_span_list;
+
+	/*
+	* The tessellated path, subdivision_count vertices per span.
+	* Kept so that an edit only regenerates the vertices of the changed spans.
+	*/
+	std::vector<dx::XMFLOAT3> path_vertices;
+	//The u values used to tessellate every span
+	std::vector<float> subdivision_u;
+	//Scratch buffers of GetSegmentPositions, grown as needed and reused between calls
+	std::vector<const CubicSpan*> sample_spans;
+	std::vector<float> sample_span_u;
+	//Spans whose path_vertices changed since GetDirtyVertexRanges was last called
+	std::vector<bool> upload_spans;
+
+	//Hierarchy over the span bounds for closest point queries, rebuilt when a span changes
+	PathBVH span_bvh;
+	bool span_bvh_dirty = true;
+
+	//Rebuilds the span hierarchy if any span changed
+	void UpdateSpanBVH();
+
+	//Converts a span and the u within it to the u of the whole path
+	float GetPathU(unsigned int span_indx, float span_u);
+
+	/*
+	* Builds the span for the curve between pi and pi_next
+	* using the neighbouring points to calculate the inner bezier points a and b
+	*/
+	static CubicSpan BuildSpan(dx::FXMVECTOR pi_prev, dx::FXMVECTOR pi,
+		dx::FXMVECTOR pi_next, dx::GXMVECTOR pi_next_next);
+
+	//Recalculates the span coefficients for all the spans if points were added or removed
+	void UpdateSpanCoefficients();
+
+	/*
+	* Marks the spans that use the control point as dirty
+	*/
+	void MarkControlPointDirty(unsigned int point_indx, unsigned int segment);
+
+	/*
+	* Rebuilds the coefficients of the dirty spans and refreshes
+	* their vertices and forward difference tables.
+	* Cheap when nothing has changed, so every query calls it first.
+	*/
+	void RefreshDirtySpans();
+
+	//Regenerates the vertices of a single span in path_vertices
+	void TessellateSpan(unsigned int span_indx);
+
+	//Integrates the arc length table for a single span
+	void BuildSpanArcLengths(unsigned int span_indx);
+
+	/*
+	* Integrates the arc length of the span between ua and ub.
+	* Splits the interval in half until both halves agree with
+	* the whole within tolerance, or max_depth is reached.
+	*/
+	static float IntegrateArcLength(const CubicSpan& span, float ua, float ub,
+		float whole, float tolerance, unsigned int max_depth);
+
+	/*
+	* Looks up the distance for u in the arc length table of a span,
+	* interpolating between the closest entries
+	*/
+	float GetSpanDistance(unsigned int span_indx, float u);
+
+	//Recalculates the cumulative span lengths starting from first_span
+	void UpdateLengthPrefix(unsigned int first_span);
+
+	/*
+	* Converts a u within a segment to the span it falls in and the u within that span
+	*/
+	void GetSpanFromSegmentU(float u, unsigned int segment_indx,
+		unsigned int& span_indx, float& span_u);
+
+	/*
+	* Evaluates count positions within a segment in a single batch
+	* Returns: void - the positions are written to out_points
+	*/
+	void GetSegmentPositions(const float* u, unsigned int count,
+		unsigned int segment_indx, dx::XMFLOAT3* out_points);
 
 	void AddDefaultControlPoints();
 	
@@ -66,11 +196,6 @@ private:
 		dx::XMVECTOR& pi_prev, dx::XMVECTOR& pi,
 		dx::XMVECTOR& pi_next, dx::XMVECTOR& pi_next_next);
 
-	/*
-	* Expand the forward difference table using the adaptive approach
-	*/
-	void AdaptiveExpand();
-
 	/*
 	* Append extra points to the start and end of the path if there's no loop
 	* for the bezier function
@@ -82,6 +207,8 @@ public:
 	float constant_look_ahead_time = 0.2f;
 	//The time taken for 1 complete loop. Used to normalize t
 	float loop_time = 30.0f;
+	//Max error allowed in the length of a single arc length table interval
+	float arc_length_tolerance = 0.01f;
 
 	/*
 	* Converts a T value to the noramlized 0-1 range based on loop_time;
@@ -114,6 +241,12 @@ public:
 	*/
 	void ReplaceLastPoint(const dx::XMFLOAT3& new_point, unsigned int segment);
 
+	/*
+	* Moves a control point in place.
+	* Only the spans using the point are re-tessellated and re-integrated.
+	*/
+	void SetControlPoint(const dx::XMFLOAT3& new_point, unsigned int point_indx, unsigned int segment);
+
 	//Adds an empty control segment to the list of control segments
 	void AddControlSegment();
 
@@ -136,12 +269,44 @@ public:
 	std::vector<dx::XMFLOAT3> GenerateUnloopedPath();
 
 	/*
-	* Generates the forward difference table to evalute the distance for the 
-	* space curve using the adaptive approach.
-	* If use_adaptive = true then expand the table using adapative approach
+	* Generates a list of points that represents the path in world space.
+	* Each span gets as many points as needed to keep the curve within
+	* max_error of the line segments, instead of a fixed subdivision count.
+	* An unlooped path must have been generated with GeneratePath first.
+	* Returns: Vector<FLOAT3> - the list of points
+	*/
+	std::vector<dx::XMFLOAT3> GenerateAdaptivePath(float max_error);
+
+	/*
+	* Same as GenerateAdaptivePath but the error is measured in pixels,
+	* projecting with view_proj (camera * projection) to a screen of the given size.
+	* Parts of the path crossing the camera plane are held to max_world_error.
+	* Returns: Vector<FLOAT3> - the list of points
+	*/
+	std::vector<dx::XMFLOAT3> GenerateAdaptivePath(float max_pixel_error, float max_world_error,
+		dx::FXMMATRIX view_proj, float screen_width, float screen_height);
+
+	/*
+	* Gets the tessellated path, updated for any edited control points.
+	* Returns: const ref to the list of points
+	*/
+	const std::vector<dx::XMFLOAT3>& GetPathVertices();
+
+	/*
+	* Gets the ranges of path vertices changed since the last call and clears them.
+	* On a looped path the changed vertices may wrap around from the last span to the first,
+	* they are then split into a range at the end of the path and one at its start.
+	* Returns: unsigned int - number of ranges written, 0 if no vertices changed
+	*/
+	unsigned int GetDirtyVertexRanges(unsigned int first_vertex[2], unsigned int vertex_count[2]);
+
+	/*
+	* Generates the arc length tables to evalute the distance for the 
+	* space curve. The speed |P'(u)| of every span is integrated with
+	* Gauss-Legendre quadrature up to arc_length_tolerance.
 	* Returns: void
 	*/
-	void GenerateForwardDiffTable(bool use_adaptive=true);
+	void GenerateArcLengthTable();
 
 	/*
 	* Generates the default velocity function 
@@ -149,6 +314,13 @@ public:
 	*/
 	void GenerateDefaultVelocityFunction();
 
+	/*
+	* Replaces the velocity function with a user defined profile.
+	* The profile is over the normalized time, from 0 to 1.
+	* Returns: void
+	*/
+	void SetVelocityProfile(const VelocityProfile& profile);
+
 	void Update(float dt);
 
 	/*
@@ -176,6 +348,19 @@ public:
 	*/
 	dx::XMVECTOR GetPosition(float u);
 
+	/*
+	* Finds the point on the path closest to the given point in world space
+	* Returns: float - u of the closest point, its position is written to closest_point
+	*/
+	float GetClosestPoint(const dx::XMFLOAT3& point, dx::XMFLOAT3& closest_point);
+
+	/*
+	* Finds the closest point on the path for count points in world space
+	* Returns: void - the u and position of every closest point are written to out_u and out_points
+	*/
+	void GetClosestPoints(const dx::XMFLOAT3* points, unsigned int count,
+		float* out_u, dx::XMFLOAT3* out_points);
+
 	/*
 	* Returns the distance on the path for the corresponding u within a segment
 	* G(u) function
@@ -201,7 +386,7 @@ public:
 	/*
 	* Returns the velocity for the corresponding time elapsed.
 	* i.e the Velocity function V(t)
-	* Uses parabolic ease-in/out approach
+	* Uses the velocity profile
 	* Returns: float - velocity
 	*/
 	float GetVelocity(float t);
@@ -209,11 +394,18 @@ public:
 	/*
 	* Returns the distance travelled after the given time t
 	* i.e Distance-time function S(t)
-	* Uses parabolic ease-in/out approach
+	* Uses the velocity profile
 	* Returns: float - distance
 	*/
 	float GetDistanceFromTime(float t);
 
+	/*
+	* Returns the time within the first loop at which the distance S is reached
+	* i.e the inverse of the Distance-time function t(S)
+	* Returns: float - time
+	*/
+	float GetTimeFromDistance(float S);
+
 	/*
 	* Returns the normalized distance travelled after the given time t
 	* i.e Distance-time function S(t)
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <execution>
+#include <cfloat>
+#include "PathBVH.h"
+
+void PathBVH::Build(const CubicSpan* _spans, unsigned int span_count) {
+	spans = _spans;
+	nodes.clear();
+	span_order.resize(span_count);
+	span_box_min.resize(span_count);
+	span_box_max.resize(span_count);
+	if (span_count == 0)
+		return;
+
+	for (unsigned int i = 0; i < span_count; i++) {
+		span_order[i] = i;
+
+		//Convert back to the bezier control points
+		//p0 = c0, p1 = c0 + c1/3, p2 = c0 + 2c1/3 + c2/3, p3 = c0 + c1 + c2 + c3
+		dx::XMVECTOR c0 = dx::XMLoadFloat4A(&spans[i].c0);
+		dx::XMVECTOR c1 = dx::XMLoadFloat4A(&spans[i].c1);
+		dx::XMVECTOR c2 = dx::XMLoadFloat4A(&spans[i].c2);
+		dx::XMVECTOR c3 = dx::XMLoadFloat4A(&spans[i].c3);
+		dx::XMVECTOR p1 = dx::XMVectorAdd(c0, dx::XMVectorScale(c1, 1.0f / 3.0f));
+		dx::XMVECTOR p2 = dx::XMVectorAdd(p1, dx::XMVectorScale(dx::XMVectorAdd(c1, c2), 1.0f / 3.0f));
+		dx::XMVECTOR p3 = dx::XMVectorAdd(dx::XMVectorAdd(c0, c1), dx::XMVectorAdd(c2, c3));
+
+		dx::XMStoreFloat3(&span_box_min[i],
+			dx::XMVectorMin(dx::XMVectorMin(c0, p1), dx::XMVectorMin(p2, p3)));
+		dx::XMStoreFloat3(&span_box_max[i],
+			dx::XMVectorMax(dx::XMVectorMax(c0, p1), dx::XMVectorMax(p2, p3)));
+	}
+
+	//A binary tree with one span per leaf has at most 2n - 1 nodes
+	nodes.reserve(2 * span_count);
+	nodes.push_back(Node());
+	BuildNode(0, 0, span_count);
+}
+
+void PathBVH::BuildNode(unsigned int node_indx, unsigned int first, unsigned int count) {
+	//Bounds of the spans and of their centers
+	dx::XMVECTOR box_min = dx::XMVectorReplicate(FLT_MAX);
+	dx::XMVECTOR box_max = dx::XMVectorReplicate(-FLT_MAX);
+	dx::XMVECTOR center_min = box_min;
+	dx::XMVECTOR center_max = box_max;
+	for (unsigned int i = first; i < first + count; i++) {
+		dx::XMVECTOR span_min = dx::XMLoadFloat3(&span_box_min[span_order[i]]);
+		dx::XMVECTOR span_max = dx::XMLoadFloat3(&span_box_max[span_order[i]]);
+		dx::XMVECTOR center = dx::XMVectorScale(dx::XMVectorAdd(span_min, span_max), 0.5f);
+		box_min = dx::XMVectorMin(box_min, span_min);
+		box_max = dx::XMVectorMax(box_max, span_max);
+		center_min = dx::XMVectorMin(center_min, center);
+		center_max = dx::XMVectorMax(center_max, center);
+	}
+	dx::XMStoreFloat3(&nodes[node_indx].box_min, box_min);
+	dx::XMStoreFloat3(&nodes[node_indx].box_max, box_max);
+
+	if (count <= max_leaf_spans) {
+		nodes[node_indx].first = first;
+		nodes[node_indx].span_count = count;
+		return;
+	}
+
+	//Split at the median along the axis the centers spread the most
+	dx::XMFLOAT3 extent;
+	dx::XMStoreFloat3(&extent, dx::XMVectorSubtract(center_max, center_min));
+	int axis = 0;
+	if (extent.y > extent.x)
+		axis = 1;
+	if (extent.z > (axis == 0 ? extent.x : extent.y))
+		axis = 2;
+
+	auto center_on_axis = [&](unsigned int span_indx) {
+		const float* span_min = &span_box_min[span_indx].x;
+		const float* span_max = &span_box_max[span_indx].x;
+		return span_min[axis] + span_max[axis];
+	};
+	unsigned int half = count / 2;
+	std::nth_element(span_order.begin() + first, span_order.begin() + first + half,
+		span_order.begin() + first + count,
+		[&](unsigned int a, unsigned int b) { return center_on_axis(a) < center_on_axis(b); });
+
+	//Both children are added before either is filled so they sit next to each other
+	unsigned int left = nodes.size();
+	nodes[node_indx].first = left;
+	nodes[node_indx].span_count = 0;
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	BuildNode(left, first, half);
+	BuildNode(left + 1, first + half, count - half);
+}
+
+float PathBVH::BoxDistanceSq(dx::FXMVECTOR point, const Node& node) {
+	dx::XMVECTOR box_min = dx::XMLoadFloat3(&node.box_min);
+	dx::XMVECTOR box_max = dx::XMLoadFloat3(&node.box_max);
+	dx::XMVECTOR clamped = dx::XMVectorClamp(point, box_min, box_max);
+	return dx::XMVectorGetX(dx::XMVector3LengthSq(dx::XMVectorSubtract(point, clamped)));
+}
+
+void PathBVH::ProjectOnSpan(const CubicSpan& span, dx::FXMVECTOR point,
+	float& span_u, float& distance_sq) {
+	const unsigned int sample_count = 8;
+	const unsigned int newton_iterations = 5;
+
+	//Pick the closest sample as the starting guess
+	float best_u = 0.0f;
+	float best_dist_sq = FLT_MAX;
+	for (unsigned int i = 0; i <= sample_count; i++) {
+		float u = (float)i / sample_count;
+		float dist_sq = dx::XMVectorGetX(
+			dx::XMVector3LengthSq(dx::XMVectorSubtract(span.Evaluate(u), point)));
+		if (dist_sq < best_dist_sq) {
+			best_dist_sq = dist_sq;
+			best_u = u;
+		}
+	}
+
+	//f(u) = (P(u) - q).P'(u), f'(u) = P'(u).P'(u) + (P(u) - q).P''(u)
+	float u = best_u;
+	for (unsigned int i = 0; i < newton_iterations; i++) {
+		dx::XMVECTOR diff = dx::XMVectorSubtract(span.Evaluate(u), point);
+		dx::XMVECTOR d1 = span.EvaluateDerivative(u);
+		dx::XMVECTOR d2 = span.EvaluateSecondDerivative(u);
+		float f = dx::XMVectorGetX(dx::XMVector3Dot(diff, d1));
+		float f_prime = dx::XMVectorGetX(dx::XMVector3Dot(d1, d1)) +
+			dx::XMVectorGetX(dx::XMVector3Dot(diff, d2));
+		if (f_prime <= 0.0f)
+			break;
+		u = (std::max)(0.0f, (std::min)(1.0f, u - f / f_prime));
+	}
+
+	float dist_sq = dx::XMVectorGetX(
+		dx::XMVector3LengthSq(dx::XMVectorSubtract(span.Evaluate(u), point)));
+	//Newton can wander off, keep the sample if it was closer
+	if (dist_sq < best_dist_sq) {
+		best_dist_sq = dist_sq;
+		best_u = u;
+	}
+	span_u = best_u;
+	distance_sq = best_dist_sq;
+}
+
+PathProjection PathBVH::GetClosestPoint(const dx::XMFLOAT3& point) const {
+	PathProjection projection = {};
+	projection.distance_sq = FLT_MAX;
+	if (nodes.empty())
+		return projection;
+
+	dx::XMVECTOR point_v = dx::XMLoadFloat3(&point);
+
+	//The depth of the tree is log2 of the span count, 64 covers any path
+	unsigned int node_stack[64];
+	unsigned int stack_size = 0;
+	node_stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		const Node& node = nodes[node_stack[--stack_size]];
+		if (BoxDistanceSq(point_v, node) >= projection.distance_sq)
+			continue;
+
+		if (node.span_count > 0) {
+			for (unsigned int i = node.first; i < node.first + node.span_count; i++) {
+				float span_u, distance_sq;
+				ProjectOnSpan(spans[span_order[i]], point_v, span_u, distance_sq);
+				if (distance_sq < projection.distance_sq) {
+					projection.span_indx = span_order[i];
+					projection.span_u = span_u;
+					projection.distance_sq = distance_sq;
+				}
+			}
+			continue;
+		}
+
+		//Push the farther child first so the nearer one is visited first
+		unsigned int left = node.first;
+		unsigned int right = node.first + 1;
+		float left_dist_sq = BoxDistanceSq(point_v, nodes[left]);
+		float right_dist_sq = BoxDistanceSq(point_v, nodes[right]);
+		if (left_dist_sq < right_dist_sq) {
+			node_stack[stack_size++] = right;
+			node_stack[stack_size++] = left;
+		}
+		else {
+			node_stack[stack_size++] = left;
+			node_stack[stack_size++] = right;
+		}
+	}
+
+	dx::XMStoreFloat3(&projection.position, spans[projection.span_indx].Evaluate(projection.span_u));
+	return projection;
+}
+
+void PathBVH::GetClosestPoints(const dx::XMFLOAT3* points, unsigned int count,
+	PathProjection* out_projections) const {
+	std::vector<unsigned int> query_indices(count);
+	for (unsigned int i = 0; i < count; i++) {
+		query_indices[i] = i;
+	}
+
+	std::for_each(std::execution::par, query_indices.begin(), query_indices.end(),
+		[&](unsigned int i) {
+			out_projections[i] = GetClosestPoint(points[i]);
+		});
+}
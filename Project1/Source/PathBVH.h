@@ -0,0 +1,80 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "CubicSpan.h"
+
+namespace dx = DirectX;
+
+//Closest point on a path to a query point
+struct PathProjection {
+	unsigned int span_indx;
+	//u within the span
+	float span_u;
+	dx::XMFLOAT3 position;
+	float distance_sq;
+};
+
+/*
+* Bounding volume hierarchy over the spans of a path.
+* Every span is bounded by the box of its bezier control points,
+* the hull property guarantees the curve stays inside it.
+* Used to find the closest point on the path without testing every span.
+*/
+class PathBVH
+{
+private:
+	struct Node {
+		dx::XMFLOAT3 box_min;
+		dx::XMFLOAT3 box_max;
+		//Index of the left child, the right child follows it.
+		//For a leaf, the index of the first span in span_order
+		unsigned int first;
+		//Number of spans in a leaf, 0 for an inner node
+		unsigned int span_count;
+	};
+
+	//Spans are referenced by pointer into the owner's vector, which must outlive the BVH
+	const CubicSpan* spans = nullptr;
+	std::vector<Node> nodes;
+	//Span indices, reordered so each leaf refers to a contiguous range
+	std::vector<unsigned int> span_order;
+	std::vector<dx::XMFLOAT3> span_box_min;
+	std::vector<dx::XMFLOAT3> span_box_max;
+
+	static const unsigned int max_leaf_spans = 2;
+
+	//Fills the node with the spans in span_order[first, first + count), splitting them if needed
+	void BuildNode(unsigned int node_indx, unsigned int first, unsigned int count);
+
+	//Squared distance from the point to the box, 0 if it is inside
+	static float BoxDistanceSq(dx::FXMVECTOR point, const Node& node);
+
+	/*
+	* Closest point on a single span.
+	* Starts from the closest of a few samples and refines with Newton
+	* iterations on (P(u) - point).P'(u) = 0
+	*/
+	static void ProjectOnSpan(const CubicSpan& span, dx::FXMVECTOR point,
+		float& span_u, float& distance_sq);
+public:
+	/*
+	* Builds the hierarchy over span_count spans
+	*/
+	void Build(const CubicSpan* _spans, unsigned int span_count);
+
+	/*
+	* Finds the closest point on any span to the point.
+	* Descends the nearest child first and skips boxes farther
+	* than the best distance found so far.
+	* Returns: PathProjection - span and u of the closest point
+	*/
+	PathProjection GetClosestPoint(const dx::XMFLOAT3& point) const;
+
+	/*
+	* Finds the closest point for count query points.
+	* The queries are independent and run in parallel.
+	* Returns: void - the results are written to out_projections
+	*/
+	void GetClosestPoints(const dx::XMFLOAT3* points, unsigned int count,
+		PathProjection* out_projections) const;
+};
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <algorithm>
+#include "PathFlattenCheck.h"
+
+//Distance from the point to the segment between a and b
+static float SegmentDistance(dx::FXMVECTOR point, dx::FXMVECTOR a, dx::FXMVECTOR b) {
+	dx::XMVECTOR segment = dx::XMVectorSubtract(b, a);
+	dx::XMVECTOR to_point = dx::XMVectorSubtract(point, a);
+	float segment_len_sq = dx::XMVectorGetX(dx::XMVector3LengthSq(segment));
+	float t = segment_len_sq > 0.0f ?
+		dx::XMVectorGetX(dx::XMVector3Dot(to_point, segment)) / segment_len_sq : 0.0f;
+	t = (std::max)(0.0f, (std::min)(1.0f, t));
+	return dx::XMVectorGetX(dx::XMVector3Length(
+		dx::XMVectorSubtract(to_point, dx::XMVectorScale(segment, t))));
+}
+
+/*
+* Largest distance between the span and the polyline through the points, measured
+* after to_measure maps positions to the space the tolerance is in.
+* parameters[i] is the span parameter of points[i], the polyline ends at the end of the span.
+*/
+template<class MeasureFunc>
+static float GetMaxError(const CubicSpan& span, const std::vector<float>& parameters,
+	unsigned int samples_per_segment, const MeasureFunc& to_measure) {
+	float max_error = 0.0f;
+	for (unsigned int i = 0; i < parameters.size(); ++i) {
+		float ua = parameters[i];
+		float ub = i + 1 < parameters.size() ? parameters[i + 1] : 1.0f;
+		dx::XMVECTOR a = to_measure(span.Evaluate(ua));
+		dx::XMVECTOR b = to_measure(span.Evaluate(ub));
+		for (unsigned int sample = 1; sample < samples_per_segment; ++sample) {
+			float u = ua + (ub - ua) * sample / samples_per_segment;
+			max_error = (std::max)(max_error, SegmentDistance(to_measure(span.Evaluate(u)), a, b));
+		}
+	}
+	return max_error;
+}
+
+std::vector<PathFlattenCheck::Result> PathFlattenCheck::Run() {
+	std::vector<Result> results;
+
+	//Control points along one line, unevenly spaced so the speed along the span varies
+	CubicSpan straight = CubicSpan::FromBezier(
+		dx::XMVectorSet(-100.0f, 0.0f, 100.0f, 1.0f), dx::XMVectorSet(-90.0f, 0.0f, 110.0f, 1.0f),
+		dx::XMVectorSet(60.0f, 0.0f, 260.0f, 1.0f), dx::XMVectorSet(100.0f, 0.0f, 300.0f, 1.0f));
+	//Turns back on itself within 10 units
+	CubicSpan corner = CubicSpan::FromBezier(
+		dx::XMVectorSet(-100.0f, 0.0f, 200.0f, 1.0f), dx::XMVectorSet(150.0f, 0.0f, 200.0f, 1.0f),
+		dx::XMVectorSet(150.0f, 0.0f, 210.0f, 1.0f), dx::XMVectorSet(-100.0f, 0.0f, 210.0f, 1.0f));
+
+	//Looking down on the spans from above, as the demo camera does
+	float screen_width = 1280.0f;
+	float screen_height = 960.0f;
+	dx::XMMATRIX view = dx::XMMatrixLookAtLH(dx::XMVectorSet(0.0f, 300.0f, -100.0f, 1.0f),
+		dx::XMVectorSet(0.0f, 0.0f, 200.0f, 1.0f), dx::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	dx::XMMATRIX view_proj = view * dx::XMMatrixPerspectiveLH(1.0f, 3.0f / 4.0f, 0.5f, 2000.0f);
+
+	unsigned int max_point_count = 1u << CubicSpan::max_flatten_depth;
+	results.push_back(CheckWorld("Straight world", straight, 0.1f, max_straight_points));
+	results.push_back(CheckWorld("Corner world", corner, 0.1f, max_point_count));
+	results.push_back(CheckProjected("Straight projected", straight, 0.5f,
+		view_proj, screen_width, screen_height, max_straight_points));
+	results.push_back(CheckProjected("Corner projected", corner, 0.5f,
+		view_proj, screen_width, screen_height, max_point_count));
+	return results;
+}
+
+PathFlattenCheck::Result PathFlattenCheck::CheckWorld(const char* name, const CubicSpan& span,
+	float max_error, unsigned int max_point_count) {
+	Result result;
+	result.name = name;
+	result.tolerance = max_error;
+	result.max_point_count = max_point_count;
+
+	std::vector<dx::XMFLOAT3> points;
+	span.Flatten(max_error, points);
+	result.point_count = (unsigned int)points.size();
+
+	std::vector<float> parameters;
+	if (!GetPointParameters(span, points, parameters))
+		return result;
+	result.max_error = GetMaxError(span, parameters, samples_per_segment,
+		[](dx::FXMVECTOR point) { return point; });
+	result.passed = result.point_count <= max_point_count && result.max_error <= max_error;
+	return result;
+}
+
+PathFlattenCheck::Result PathFlattenCheck::CheckProjected(const char* name, const CubicSpan& span,
+	float max_pixel_error, dx::FXMMATRIX view_proj, float screen_width, float screen_height,
+	unsigned int max_point_count) {
+	Result result;
+	result.name = name;
+	result.tolerance = max_pixel_error;
+	result.max_point_count = max_point_count;
+
+	std::vector<dx::XMFLOAT3> points;
+	//The spans are in front of the camera, the world error is never used
+	span.FlattenProjected(max_pixel_error, max_pixel_error, view_proj, screen_width, screen_height, points);
+	result.point_count = (unsigned int)points.size();
+
+	std::vector<float> parameters;
+	if (!GetPointParameters(span, points, parameters))
+		return result;
+	const dx::XMVECTOR half_screen = dx::XMVectorSet(
+		screen_width * 0.5f, screen_height * 0.5f, 0.0f, 0.0f);
+	dx::XMMATRIX projection = view_proj;
+	result.max_error = GetMaxError(span, parameters, samples_per_segment,
+		[&](dx::FXMVECTOR point) {
+			dx::XMVECTOR clip = dx::XMVector3Transform(point, projection);
+			return dx::XMVectorMultiply(
+				dx::XMVectorScale(clip, 1.0f / dx::XMVectorGetW(clip)), half_screen);
+		});
+	result.passed = result.point_count <= max_point_count && result.max_error <= max_pixel_error;
+	return result;
+}
+
+bool PathFlattenCheck::GetPointParameters(const CubicSpan& span, const std::vector<dx::XMFLOAT3>& points,
+	std::vector<float>& parameters) {
+	unsigned int step_count = 1u << CubicSpan::max_flatten_depth;
+	parameters.clear();
+	unsigned int step = 0;
+	for (const auto& point : points) {
+		//The points are in order of their parameters
+		while (step <= step_count) {
+			dx::XMFLOAT3 evaluated;
+			dx::XMStoreFloat3(&evaluated, span.Evaluate((float)step / step_count));
+			if (evaluated.x == point.x && evaluated.y == point.y && evaluated.z == point.z)
+				break;
+			step++;
+		}
+		if (step > step_count)
+			return false;
+		parameters.push_back((float)step / step_count);
+		step++;
+	}
+	return true;
+}
+
+void PathFlattenCheck::PrintResults(const std::vector<Result>& results) {
+	printf("%-20s %12s %11s %11s %6s\n", "Check", "Points", "Max Error", "Tolerance", "Result");
+	for (const auto& result : results) {
+		printf("%-20s %5u/%-6u %11.4f %11.4f %6s\n", result.name,
+			result.point_count, result.max_point_count, result.max_error, result.tolerance,
+			result.passed ? "pass" : "FAIL");
+	}
+}
+
+int PathFlattenCheck::RunFromCommandLine(const char* command_line) {
+	std::vector<Result> results = Run();
+	PrintResults(results);
+	for (const auto& result : results) {
+		if (!result.passed)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include "CubicSpan.h"
+
+/*
+* Headless checks of CubicSpan::Flatten and FlattenProjected.
+* A straight span has to flatten to a handful of points and a tight corner
+* has to stay within the tolerance everywhere, not only at the points the
+* flattening tested. The error is measured on a dense sampling of the span,
+* in world units for Flatten and in pixels for FlattenProjected.
+*/
+class PathFlattenCheck
+{
+public:
+	struct Result {
+		const char* name;
+		//Points appended by the flattening, the end point of the span is not counted
+		unsigned int point_count = 0;
+		unsigned int max_point_count = 0;
+		float max_error = 0.0f;
+		float tolerance = 0.0f;
+		bool passed = false;
+	};
+
+	//Most points a straight span may produce
+	static const unsigned int max_straight_points = 4;
+	//Samples of the span between two flattened points
+	static const unsigned int samples_per_segment = 64;
+
+	/*
+	* Flattens a straight span and a tight corner in world space and projected.
+	* Returns: vector<Result> - one result per check
+	*/
+	static std::vector<Result> Run();
+
+	static void PrintResults(const std::vector<Result>& results);
+
+	/*
+	* Runs the checks and prints the results.
+	* Returns: int - exit code, 0 if every check passed
+	*/
+	static int RunFromCommandLine(const char* command_line);
+
+private:
+	static Result CheckWorld(const char* name, const CubicSpan& span, float max_error,
+		unsigned int max_point_count);
+
+	static Result CheckProjected(const char* name, const CubicSpan& span, float max_pixel_error,
+		dx::FXMMATRIX view_proj, float screen_width, float screen_height, unsigned int max_point_count);
+
+	/*
+	* Finds the parameter of every flattened point, which are all at multiples of 2^-10.
+	* Returns: bool - false if a point is not on the span
+	*/
+	static bool GetPointParameters(const CubicSpan& span, const std::vector<dx::XMFLOAT3>& points,
+		std::vector<float>& parameters);
+};
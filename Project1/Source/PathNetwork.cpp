@@ -0,0 +1,191 @@
+#include <queue>
+#include <cfloat>
+#include <climits>
+#include <algorithm>
+#include "PathNetwork.h"
+
+PathNetwork::PathNetwork(unsigned int _route_cache_capacity) :
+	route_cache_capacity(_route_cache_capacity) {
+}
+
+std::unique_ptr<Path> PathRoute::CreatePath() const {
+	std::unique_ptr<Path> route_path = std::make_unique<Path>(false);
+	route_path->AddControlSegment();
+	for (auto& control_point : control_points) {
+		route_path->AddControlPoint(control_point, 0);
+	}
+	route_path->GeneratePath();
+	route_path->GenerateArcLengthTable();
+	route_path->GenerateDefaultVelocityFunction();
+	return route_path;
+}
+
+unsigned int PathNetwork::AddJunction(const dx::XMFLOAT3& position) {
+	std::unique_lock<std::shared_mutex> lock(graph_mutex);
+	junctions.push_back(Junction{ position, {} });
+	return junctions.size() - 1;
+}
+
+unsigned int PathNetwork::AddEdge(unsigned int from, unsigned int to,
+	const std::vector<dx::XMFLOAT3>& inner_points) {
+	Edge edge;
+	edge.from = from;
+	edge.to = to;
+	{
+		std::shared_lock<std::shared_mutex> lock(graph_mutex);
+		edge.control_points.push_back(junctions[from].position);
+		edge.control_points.insert(edge.control_points.end(), inner_points.begin(), inner_points.end());
+		edge.control_points.push_back(junctions[to].position);
+	}
+
+	//Measure the edge with the same spline the route will use
+	Path edge_path(false);
+	edge_path.AddControlSegment();
+	for (auto& control_point : edge.control_points) {
+		edge_path.AddControlPoint(control_point, 0);
+	}
+	edge_path.GeneratePath();
+	edge_path.GenerateArcLengthTable();
+	edge.length = edge_path.GetDistance(1);
+
+	std::unique_lock<std::shared_mutex> lock(graph_mutex);
+	edges.push_back(edge);
+	unsigned int edge_indx = edges.size() - 1;
+	junctions[from].edges.push_back(edge_indx);
+	junctions[to].edges.push_back(edge_indx);
+
+	//A new edge can make cached routes longer than the shortest one
+	ClearRouteCache();
+	return edge_indx;
+}
+
+float PathNetwork::GetEdgeLength(unsigned int edge_indx) const {
+	std::shared_lock<std::shared_mutex> lock(graph_mutex);
+	return edges[edge_indx].length;
+}
+
+void PathNetwork::ClearRouteCache() {
+	std::lock_guard<std::mutex> lock(route_cache_mutex);
+	route_list.clear();
+	route_cache.clear();
+}
+
+bool PathNetwork::FindRoute(unsigned int start, unsigned int goal,
+	std::vector<unsigned int>& route_junctions, std::vector<unsigned int>& route_edges) {
+	//The straight line distance never overestimates the arc length
+	auto heuristic = [&](unsigned int junction_indx) {
+		return dx::XMVectorGetX(dx::XMVector3Length(dx::XMVectorSubtract(
+			dx::XMLoadFloat3(&junctions[junction_indx].position),
+			dx::XMLoadFloat3(&junctions[goal].position))));
+	};
+
+	std::vector<float> cost(junctions.size(), FLT_MAX);
+	std::vector<unsigned int> came_from_edge(junctions.size(), UINT_MAX);
+	std::vector<bool> closed(junctions.size(), false);
+
+	//Open list ordered by cost + heuristic, smallest first
+	typedef std::pair<float, unsigned int> open_entry;
+	std::priority_queue<open_entry, std::vector<open_entry>, std::greater<open_entry>> open_list;
+	cost[start] = 0.0f;
+	open_list.push({ heuristic(start), start });
+
+	while (!open_list.empty()) {
+		unsigned int curr = open_list.top().second;
+		open_list.pop();
+		if (closed[curr])
+			continue;
+		if (curr == goal)
+			break;
+		closed[curr] = true;
+
+		for (unsigned int edge_indx : junctions[curr].edges) {
+			const Edge& edge = edges[edge_indx];
+			unsigned int next = edge.from == curr ? edge.to : edge.from;
+			float next_cost = cost[curr] + edge.length;
+			if (next_cost < cost[next]) {
+				cost[next] = next_cost;
+				came_from_edge[next] = edge_indx;
+				open_list.push({ next_cost + heuristic(next), next });
+			}
+		}
+	}
+
+	if (cost[goal] == FLT_MAX)
+		return false;
+
+	//Walk back from the goal
+	route_junctions.clear();
+	route_edges.clear();
+	unsigned int curr = goal;
+	route_junctions.push_back(curr);
+	while (curr != start) {
+		const Edge& edge = edges[came_from_edge[curr]];
+		route_edges.push_back(came_from_edge[curr]);
+		curr = edge.from == curr ? edge.to : edge.from;
+		route_junctions.push_back(curr);
+	}
+	std::reverse(route_junctions.begin(), route_junctions.end());
+	std::reverse(route_edges.begin(), route_edges.end());
+	return true;
+}
+
+std::shared_ptr<const PathRoute> PathNetwork::BuildRoute(unsigned int start,
+	const std::vector<unsigned int>& route_junctions, const std::vector<unsigned int>& route_edges) {
+	std::shared_ptr<PathRoute> route = std::make_shared<PathRoute>();
+	route->junctions = route_junctions;
+	route->control_points.push_back(junctions[start].position);
+	for (unsigned int i = 0; i < route_edges.size(); i++) {
+		const Edge& edge = edges[route_edges[i]];
+		//Edges travelled backwards add their points in reverse
+		bool reversed = edge.from != route_junctions[i];
+		unsigned int point_count = edge.control_points.size();
+		//The first point is the junction already added by the previous edge
+		for (unsigned int j = 1; j < point_count; j++) {
+			route->control_points.push_back(
+				edge.control_points[reversed ? point_count - 1 - j : j]);
+		}
+	}
+
+	Path route_path(false);
+	route_path.AddControlSegment();
+	for (auto& control_point : route->control_points) {
+		route_path.AddControlPoint(control_point, 0);
+	}
+	route_path.GeneratePath();
+	route->path = std::make_shared<const SharedPath>(route_path);
+	route->length = route->path->GetLength();
+	return route;
+}
+
+std::shared_ptr<const PathRoute> PathNetwork::GetRoute(unsigned int start, unsigned int goal) {
+	route_key key = ((route_key)start << 32) | goal;
+	{
+		std::lock_guard<std::mutex> lock(route_cache_mutex);
+		auto cache_iter = route_cache.find(key);
+		if (cache_iter != route_cache.end()) {
+			//Move to the front as the most recently used
+			route_list.splice(route_list.begin(), route_list, cache_iter->second);
+			return cache_iter->second->second;
+		}
+	}
+
+	//Held until the route is cached so an edit can't leave a stale route behind
+	std::shared_lock<std::shared_mutex> graph_lock(graph_mutex);
+	std::vector<unsigned int> route_junctions;
+	std::vector<unsigned int> route_edges;
+	if (start == goal || !FindRoute(start, goal, route_junctions, route_edges))
+		return nullptr;
+	std::shared_ptr<const PathRoute> route = BuildRoute(start, route_junctions, route_edges);
+
+	std::lock_guard<std::mutex> lock(route_cache_mutex);
+	//Another thread may have resolved the same route in the meantime
+	if (route_cache.find(key) == route_cache.end()) {
+		route_list.push_front({ key, route });
+		route_cache[key] = route_list.begin();
+		if (route_list.size() > route_cache_capacity) {
+			route_cache.erase(route_list.back().first);
+			route_list.pop_back();
+		}
+	}
+	return route;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include "Path.h"
+#include "SharedPath.h"
+
+namespace dx = DirectX;
+
+//A resolved route through the network
+struct PathRoute {
+	//Junctions visited in order, from start to goal
+	std::vector<unsigned int> junctions;
+	float length;
+	//Control points of the edges stitched together, from start to goal
+	std::vector<dx::XMFLOAT3> control_points;
+	//The edges stitched into a single spline, followed with PathAgentState
+	std::shared_ptr<const SharedPath> path;
+
+	/*
+	* Builds a Path through the control points of the route,
+	* with its arc length table and default velocity function,
+	* so a single model can follow it with AnimationController::SetAnimationPath
+	*/
+	std::unique_ptr<Path> CreatePath() const;
+};
+
+/*
+* A graph of junctions joined by paths.
+* Finds the shortest route between two junctions with A* over the
+* arc lengths of the edge paths, and keeps the most recently used
+* routes so agents asking for the same route share one spline.
+* Routes can be requested from any thread. Adding junctions or edges
+* waits for the searches in progress and clears the cached routes.
+*/
+class PathNetwork
+{
+private:
+	struct Junction {
+		dx::XMFLOAT3 position;
+		//Indices of the edges connected to the junction
+		std::vector<unsigned int> edges;
+	};
+
+	struct Edge {
+		unsigned int from;
+		unsigned int to;
+		//Control points from the from junction to the to junction
+		std::vector<dx::XMFLOAT3> control_points;
+		//Arc length of the edge path
+		float length;
+	};
+
+	std::vector<Junction> junctions;
+	std::vector<Edge> edges;
+	//Shared by the route searches, exclusive while the graph is edited
+	mutable std::shared_mutex graph_mutex;
+
+	//Least recently used routes are at the back of the list
+	typedef unsigned long long route_key;
+	typedef std::pair<route_key, std::shared_ptr<const PathRoute>> cached_route;
+	std::list<cached_route> route_list;
+	std::unordered_map<route_key, std::list<cached_route>::iterator> route_cache;
+	unsigned int route_cache_capacity;
+	std::mutex route_cache_mutex;
+
+	/*
+	* A* search from start to goal.
+	* Expects graph_mutex to be held.
+	* Returns: bool - false if the goal can't be reached
+	*/
+	bool FindRoute(unsigned int start, unsigned int goal,
+		std::vector<unsigned int>& route_junctions, std::vector<unsigned int>& route_edges);
+
+	//Stitches the edges of the route into a single unlooped spline, expects graph_mutex to be held
+	std::shared_ptr<const PathRoute> BuildRoute(unsigned int start,
+		const std::vector<unsigned int>& route_junctions, const std::vector<unsigned int>& route_edges);
+public:
+	PathNetwork(unsigned int _route_cache_capacity = 64);
+
+	/*
+	* Adds a junction at the given position
+	* Returns: unsigned int - index of the junction
+	*/
+	unsigned int AddJunction(const dx::XMFLOAT3& position);
+
+	/*
+	* Joins two junctions with a path through the inner points.
+	* The edge can be travelled both ways.
+	* Returns: unsigned int - index of the edge
+	*/
+	unsigned int AddEdge(unsigned int from, unsigned int to,
+		const std::vector<dx::XMFLOAT3>& inner_points);
+
+	//Arc length of the edge path
+	float GetEdgeLength(unsigned int edge_indx) const;
+
+	//Removes all the cached routes
+	void ClearRouteCache();
+
+	/*
+	* Returns the shortest route between two junctions.
+	* Cached routes are returned without searching or building a spline.
+	* Returns: PathRoute - nullptr if the goal can't be reached
+	*/
+	std::shared_ptr<const PathRoute> GetRoute(unsigned int start, unsigned int goal);
+};
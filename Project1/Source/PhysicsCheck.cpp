@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include "PhysicsCheck.h"
+
+namespace dx = DirectX;
+
+std::vector<PhysicsCheck::Result> PhysicsCheck::Run() {
+	std::vector<Result> results;
+	const float dt = 1.0f / 60.0f;
+
+	//The block tridiagonal solve and the conjugate gradients solve the same system
+	{
+		PhysicsSystem chain, conjugate_gradient;
+		BuildSticks(chain, false);
+		BuildSticks(conjugate_gradient, false);
+		chain.use_method = PhysicsSystem::IntegrateMethod::IMPLICIT_EULER;
+		conjugate_gradient.use_method = PhysicsSystem::IntegrateMethod::IMPLICIT_EULER;
+		conjugate_gradient.implicit_integrator.use_chain_solver = false;
+		Simulate(chain, dt, 10.0f);
+		Simulate(conjugate_gradient, dt, 10.0f);
+		results.push_back(MakeResult("Chain solve vs CG", GetMaxDistance(chain, conjugate_gradient), 1e-2f));
+	}
+
+	//Stiff springs, past the step RK4 is stable for. The bodies of the reference move less than 50 units
+	{
+		PhysicsSystem reference, rk4, implicit;
+		BuildSticks(reference, false);
+		BuildSticks(rk4, false);
+		BuildSticks(implicit, false);
+		SetCoefficients(reference, 1000.0f, 1000.0f);
+		SetCoefficients(rk4, 1000.0f, 1000.0f);
+		SetCoefficients(implicit, 1000.0f, 1000.0f);
+		implicit.use_method = PhysicsSystem::IntegrateMethod::IMPLICIT_EULER;
+		Simulate(reference, dt / reference_substeps, 10.0f);
+		results.push_back(MakeResult("Stiff RK4 offset", Simulate(rk4, dt, 10.0f), 1000.0f, true));
+		Simulate(implicit, dt, 10.0f);
+		results.push_back(MakeResult("Stiff implicit error", GetMaxDistance(reference, implicit), 0.1f));
+	}
+
+	//Error after 2 s against the system RK4 with a step reference_substeps times smaller
+	{
+		PhysicsSystem reference, system_rk4, body_rk4, implicit;
+		BuildSticks(reference, false);
+		BuildSticks(system_rk4, false);
+		BuildSticks(body_rk4, false);
+		BuildSticks(implicit, false);
+		body_rk4.system_integration = false;
+		implicit.use_method = PhysicsSystem::IntegrateMethod::IMPLICIT_EULER;
+		Simulate(reference, dt / reference_substeps, 2.0f);
+		Simulate(system_rk4, dt, 2.0f);
+		Simulate(body_rk4, dt, 2.0f);
+		Simulate(implicit, dt, 2.0f);
+
+		//Integrating the whole system has to beat integrating body by body
+		results.push_back(MakeResult("System RK4 error", GetMaxDistance(reference, system_rk4),
+			GetMaxDistance(reference, body_rk4)));
+		//Backward Euler is first order, it lags the reference by more than RK4
+		results.push_back(MakeResult("Implicit error", GetMaxDistance(reference, implicit), 0.5f));
+	}
+
+	//A net the chain solver cannot take, solved with the conjugate gradients
+	{
+		PhysicsSystem reference, implicit;
+		BuildSticks(reference, true);
+		BuildSticks(implicit, true);
+		implicit.use_method = PhysicsSystem::IntegrateMethod::IMPLICIT_EULER;
+		Simulate(reference, dt / reference_substeps, 2.0f);
+		Simulate(implicit, dt, 2.0f);
+		results.push_back(MakeResult("Net CG iterations", (float)implicit.implicit_integrator.last_iterations,
+			0.0f, true));
+		results.push_back(MakeResult("Net implicit error", GetMaxDistance(reference, implicit), 0.5f));
+	}
+	return results;
+}
+
+void PhysicsCheck::BuildSticks(PhysicsSystem& system, bool cross_springs) {
+	//Stick dimensions of Project_Physics
+	float width = 4.0f;
+	float height = 2.0f;
+	float depth = 2.0f;
+
+	std::vector<std::pair<dx::XMFLOAT3, float>> vertices;
+	for (float z : { -depth, depth }) {
+		for (float y : { -height, height }) {
+			for (float x : { -width, width }) {
+				vertices.push_back(std::make_pair(dx::XMFLOAT3(x, y, z), 1.0f));
+			}
+		}
+	}
+
+	system.SetStickWidth(width);
+	for (unsigned int i = 0; i < stick_count; ++i) {
+		system.AddPhysicsObject(vertices);
+	}
+	system.BuildStickChain();
+	if (!cross_springs)
+		return;
+	for (int body = 0; body + 2 < (int)stick_count; ++body) {
+		system.spring_graph.AddEdge(SpringGraph::EdgeType::SPRING, body, dx::XMFLOAT3(0.0f, height, 0.0f),
+			body + 2, dx::XMFLOAT3(0.0f, height, 0.0f));
+		system.spring_graph.AddEdge(SpringGraph::EdgeType::PIN, body, dx::XMFLOAT3(0.0f, -height, 0.0f),
+			SpringGraph::Anchor(body % 2), dx::XMFLOAT3(0.0f, -10.0f, 0.0f));
+	}
+}
+
+void PhysicsCheck::SetCoefficients(PhysicsSystem& system, float spring_coeff, float damper_coeff) {
+	system.spring_coeff = spring_coeff;
+	system.damper_coeff = damper_coeff;
+}
+
+float PhysicsCheck::Simulate(PhysicsSystem& system, float dt, float duration) {
+	std::vector<dx::XMFLOAT3> start_positions = system.bodies.positions;
+	system.CalculateAllForces();
+	system.CalculateAllTorques();
+
+	float max_offset = 0.0f;
+	unsigned int step_count = (unsigned int)std::lround(duration / dt);
+	for (unsigned int step = 0; step < step_count; ++step) {
+		system.Step(dt);
+		for (unsigned int body = 0; body < start_positions.size(); ++body) {
+			float offset = dx::XMVectorGetX(dx::XMVector3Length(dx::XMVectorSubtract(
+				dx::XMLoadFloat3(&system.bodies.positions[body]), dx::XMLoadFloat3(&start_positions[body]))));
+			//A diverged simulation stays diverged, there is no need to keep stepping it
+			if (!std::isfinite(offset))
+				return FLT_MAX;
+			max_offset = (std::max)(max_offset, offset);
+		}
+	}
+	return max_offset;
+}
+
+float PhysicsCheck::GetMaxDistance(const PhysicsSystem& a, const PhysicsSystem& b) {
+	float max_distance = 0.0f;
+	for (unsigned int body = 0; body < a.bodies.Size(); ++body) {
+		float distance = dx::XMVectorGetX(dx::XMVector3Length(dx::XMVectorSubtract(
+			dx::XMLoadFloat3(&a.bodies.positions[body]), dx::XMLoadFloat3(&b.bodies.positions[body]))));
+		if (!std::isfinite(distance))
+			return FLT_MAX;
+		max_distance = (std::max)(max_distance, distance);
+	}
+	return max_distance;
+}
+
+PhysicsCheck::Result PhysicsCheck::MakeResult(const char* name, float value, float limit, bool expect_above) {
+	Result result;
+	result.name = name;
+	result.value = value;
+	result.limit = limit;
+	result.expect_above = expect_above;
+	result.passed = expect_above ? value > limit : value <= limit;
+	return result;
+}
+
+void PhysicsCheck::PrintResults(const std::vector<Result>& results) {
+	printf("%-24s %12s %14s %6s\n", "Check", "Value", "Limit", "Result");
+	for (const auto& result : results) {
+		printf("%-24s %12.5g %c %12.5g %6s\n", result.name, result.value,
+			result.expect_above ? '>' : '<', result.limit, result.passed ? "pass" : "FAIL");
+	}
+}
+
+int PhysicsCheck::RunFromCommandLine(const char* command_line) {
+	std::vector<Result> results = Run();
+	PrintResults(results);
+	for (const auto& result : results) {
+		if (!result.passed)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "PhysicsSystem.h"
+
+/*
+* Headless checks of the PhysicsSystem integrators on the stick chain of Project_Physics.
+* Every check simulates systems without graphics and compares the positions of their bodies,
+* either between two solvers, against a reference taken with a much smaller step,
+* or against a bound that only a diverging simulation exceeds.
+*/
+class PhysicsCheck
+{
+public:
+	struct Result {
+		const char* name;
+		float value = 0.0f;
+		float limit = 0.0f;
+		//The check passes when the value is above the limit instead of below it
+		bool expect_above = false;
+		bool passed = false;
+	};
+
+	static const unsigned int stick_count = 6;
+	//Steps of the reference for every step of the checked simulation
+	static const unsigned int reference_substeps = 100;
+
+	/*
+	* Runs every check with the system's default step of 1/60 s.
+	* Returns: vector<Result> - one result per check
+	*/
+	static std::vector<Result> Run();
+
+	static void PrintResults(const std::vector<Result>& results);
+
+	/*
+	* Runs the checks and prints the results.
+	* Returns: int - exit code, 0 if every check passed
+	*/
+	static int RunFromCommandLine(const char* command_line);
+
+private:
+	/*
+	* Adds the sticks of Project_Physics and joins them into a chain between the anchor points.
+	* With cross_springs every stick is also joined to the stick after next and pinned
+	* below an anchor point, so the implicit step can no longer use the chain solver.
+	*/
+	static void BuildSticks(PhysicsSystem& system, bool cross_springs);
+
+	static void SetCoefficients(PhysicsSystem& system, float spring_coeff, float damper_coeff);
+
+	/*
+	* Steps the system by dt until duration has passed
+	* Returns: float - the furthest any body got from its starting position, FLT_MAX if it was not finite
+	*/
+	static float Simulate(PhysicsSystem& system, float dt, float duration);
+
+	//Returns: float - the largest distance between a body of a and the same body of b
+	static float GetMaxDistance(const PhysicsSystem& a, const PhysicsSystem& b);
+
+	static Result MakeResult(const char* name, float value, float limit, bool expect_above = false);
+};
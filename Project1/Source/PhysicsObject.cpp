@@ -14,12 +14,12 @@ void PhysicsObject::MoveToOrigin() {
 	}
 }
 
-void PhysicsObject::UpdatePositions() {
+void PhysicsObject::UpdatePositions(const dx::XMFLOAT3& position, const dx::XMFLOAT3X3& rotation) {
 	unsigned int indx = 0;
 	for (auto& vertex : vertices) {
 		dx::XMVECTOR updated_pos =
 			dx::XMVectorAdd(
-				dx::XMVector3Transform(vertex.position, dx::XMLoadFloat3x3(&rotational_positon)),
+				dx::XMVector3Transform(vertex.position, dx::XMLoadFloat3x3(&rotation)),
 				dx::XMLoadFloat3(&position));
 
 		dx::XMStoreFloat3(&vertex_positions[indx], updated_pos);
@@ -29,11 +29,7 @@ void PhysicsObject::UpdatePositions() {
 
 PhysicsObject::PhysicsObject() :
 	vertices(), mass(0), center_of_mass(), 
-	Iobj(), Iobj_inv(),
-	position(), rotational_positon(),
-	force(), momentum(), velocity(),
-	torque(), angular_momentum(), angular_velocity() {
-	dx::XMStoreFloat3x3(&rotational_positon, dx::XMMatrixIdentity());
+	Iobj(), Iobj_inv() {
 }
 
 PhysicsObject::PhysicsObject(std::vector<DirectX::XMFLOAT3> positions, std::vector<float> masses) :
@@ -115,17 +111,6 @@ void PhysicsObject::CalculateIObj() {
 
 }
 
-void PhysicsObject::Add(const PhysicsState& _other) {
-	dx::XMStoreFloat3(&position,
-	 dx::XMVectorAdd(dx::XMLoadFloat3(&position), dx::XMLoadFloat3(&_other.c)));
-	dx::XMStoreFloat3x3(&rotational_positon, 
-		dx::XMLoadFloat3x3(&rotational_positon) + dx::XMLoadFloat3x3(&_other.R));
-	dx::XMStoreFloat3(&momentum, 
-		dx::XMVectorAdd(dx::XMLoadFloat3(&momentum), dx::XMLoadFloat3(&_other.P)));
-	dx::XMStoreFloat3(&angular_momentum, 
-		dx::XMVectorAdd(dx::XMLoadFloat3(&angular_momentum), dx::XMLoadFloat3(&_other.L)));
-}
-
 const std::vector<DirectX::XMFLOAT3>& PhysicsObject::GetVertexPositions() {
 	return vertex_positions;
 }
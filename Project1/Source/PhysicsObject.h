@@ -26,8 +26,6 @@ public:
 	*/
 	void CalculateIObj();
 
-	void Add(const PhysicsState& _other);
-
 	/*
 	* Gets the current positions of the vertices
 	* Returns: const ref to vertex_positions
@@ -48,21 +46,6 @@ private:
 	//Intertial Tensor Inverse
 	DirectX::XMFLOAT3X3 Iobj_inv;
 
-	//x(t) == c(t)
-	DirectX::XMFLOAT3 position;
-	//R(t)
-	DirectX::XMFLOAT3X3 rotational_positon;
-
-	//Linear components
-	DirectX::XMFLOAT3 force;
-	DirectX::XMFLOAT3 momentum;
-	DirectX::XMFLOAT3 velocity;
-	
-	//Angular components
-	DirectX::XMFLOAT3 torque;
-	DirectX::XMFLOAT3 angular_momentum;
-	DirectX::XMFLOAT3 angular_velocity;
-
 	/*
 	* Move the object (along with all vertices) so that the centre of mass 
 	* corresponds with the origin.
@@ -71,8 +54,9 @@ private:
 
 	/*
 	* Called by the physics manager to update all the position at the end of each frame
+	* with the position c(t) and rotation R(t) of the object's body
 	* Returns : void
 	*/
-	void UpdatePositions();
+	void UpdatePositions(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3X3& rotation);
 };
 
@@ -4,6 +4,9 @@
 #include "DrawableBase.h"
 #include "imgui/imgui.h"
 #include <string>
+#include <cmath>
+#include <algorithm>
+#include <execution>
 
 namespace dx = DirectX;
 
@@ -22,56 +25,208 @@ dx::XMMATRIX TildeOperator(dx::XMVECTOR _vec) {
 	);
 }
 
-void PhysicsSystem::EulerIntegrate(PhysicsObject* _obj, float dt) {
-	PhysicsState curr_state{
-		.c = _obj->position,
-		.R = _obj->rotational_positon,
-		.P = _obj->momentum,
-		.L = _obj->angular_momentum,
+void PhysicsSystem::GetState(unsigned int body, PhysicsState& _state) const {
+	_state = PhysicsState{
+		.c = bodies.positions[body],
+		.R = bodies.rotations[body],
+		.P = bodies.momenta[body],
+		.L = bodies.angular_momenta[body],
 	};
-	PhysicsState k1;
-	Derivative(curr_state, _obj, k1);
-	k1.Scale(dt);
-	_obj->Add(k1);
-
-	elapsed_time += dt;
 }
 
-void PhysicsSystem::RK4Integrate(PhysicsObject* _obj, float dt) {
-	PhysicsState curr_state{
-		.c = _obj->position,
-		.R = _obj->rotational_positon,
-		.P = _obj->momentum,
-		.L = _obj->angular_momentum,
+void PhysicsSystem::GetState(unsigned int body, QuaternionPhysicsState& _state) const {
+	_state = QuaternionPhysicsState{
+		.c = bodies.positions[body],
+		.q = bodies.orientations[body],
+		.P = bodies.momenta[body],
+		.L = bodies.angular_momenta[body],
 	};
-	PhysicsState k1, k2, k3, k4;
+}
 
-	//k1 = dt * (y`(yi))
-	Derivative(curr_state, _obj, k1);
+void PhysicsSystem::SetState(unsigned int body, const PhysicsState& _state, bool back_buffer) {
+	(back_buffer ? bodies.back_positions : bodies.positions)[body] = _state.c;
+	(back_buffer ? bodies.back_rotations : bodies.rotations)[body] = _state.R;
+	(back_buffer ? bodies.back_momenta : bodies.momenta)[body] = _state.P;
+	(back_buffer ? bodies.back_angular_momenta : bodies.angular_momenta)[body] = _state.L;
+}
+
+void PhysicsSystem::SetState(unsigned int body, const QuaternionPhysicsState& _state, bool back_buffer) {
+	(back_buffer ? bodies.back_positions : bodies.positions)[body] = _state.c;
+	(back_buffer ? bodies.back_momenta : bodies.momenta)[body] = _state.P;
+	(back_buffer ? bodies.back_angular_momenta : bodies.angular_momenta)[body] = _state.L;
+
+	//The step moves q off the unit sphere, renormalize so R(t) stays a rotation
+	Quaternion q = _state.q.ScalarProduct(1.0f / _state.q.Magnitude());
+	(back_buffer ? bodies.back_orientations : bodies.orientations)[body] = q;
+	dx::XMStoreFloat3x3(&(back_buffer ? bodies.back_rotations : bodies.rotations)[body],
+		dx::XMMatrixRotationQuaternion(q.toVector()));
+}
+
+dx::XMMATRIX PhysicsSystem::GetWorldInverseInertia(const PhysicsState& _state, unsigned int body) const {
+	//I-inv(t) = R(t) * Iobj-inv * R(t)-trans
+	dx::XMMATRIX R_mat = dx::XMLoadFloat3x3(&_state.R);
+	return dx::XMMatrixTranspose(R_mat) * dx::XMLoadFloat3x3(&bodies.inv_inertias[body]) * R_mat;
+}
+
+dx::XMMATRIX PhysicsSystem::GetWorldInverseInertia(const QuaternionPhysicsState& _state, unsigned int body) const {
+	//The intermediate RK4 states are not unit quaternions
+	dx::XMMATRIX R_mat = dx::XMMatrixRotationQuaternion(dx::XMQuaternionNormalize(_state.q.toVector()));
+	return dx::XMMatrixTranspose(R_mat) * dx::XMLoadFloat3x3(&bodies.inv_inertias[body]) * R_mat;
+}
+
+template <typename State>
+void PhysicsSystem::EulerIntegrate(unsigned int body, float dt) {
+	State curr_state, k1;
+	GetState(body, curr_state);
+	Derivative(curr_state, body, dx::XMLoadFloat3x3(&bodies.world_inv_inertias[body]), k1);
+	k1.Scale(dt);
+	SetState(body, curr_state + k1, true);
+}
+
+template <typename State>
+void PhysicsSystem::RK4Integrate(unsigned int body, float dt) {
+	State curr_state, k1, k2, k3, k4;
+	GetState(body, curr_state);
+
+	//k1 = dt * (y`(yi)), the inverse inertia of the current state is cached
+	Derivative(curr_state, body, dx::XMLoadFloat3x3(&bodies.world_inv_inertias[body]), k1);
 	k1.Scale(dt);
 	
 	//k2 = dt * (y`(yi + k1/2))
-	PhysicsState temp = k1 * 0.5;
+	State temp = k1 * 0.5;
 	temp = curr_state + temp;
-	Derivative(temp, _obj, k2);
+	Derivative(temp, body, GetWorldInverseInertia(temp, body), k2);
 	k2.Scale(dt);
 
 	//k3 = dt * (y`(yi + k2/2))
 	temp = k2 * 0.5;
 	temp = curr_state + temp;
-	Derivative(temp, _obj, k3);
+	Derivative(temp, body, GetWorldInverseInertia(temp, body), k3);
 	k3.Scale(dt);
 
 	//k4 = dt * (y`(yi + k3))
 	temp = curr_state + k3;
-	Derivative(temp, _obj, k4);
+	Derivative(temp, body, GetWorldInverseInertia(temp, body), k4);
 	k4.Scale(dt);
 
 	//yi+1 = yi + (k1 + 2k2 + 2k3 + k4)*(1/6)
 	temp = (k1 + k2 * 2 + k3 * 2 + k4) * (1.0f / 6);
-	_obj->Add(temp);
+	SetState(body, curr_state + temp, true);
+}
+
+template <typename State>
+void PhysicsSystem::SystemDerivative(const std::vector<State>& _input, std::vector<State>& _output) {
+	//The spring forces of a body depend on the bodies it is connected to,
+	//so all bodies are moved to the input state before any forces are calculated
+	std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+		[&](unsigned int body) {
+			SetState(body, _input[body]);
+			bodies.CalculateVelocities(body);
+		});
+
+	UpdateEdgeForces();
+
+	//Every body only reads the edge forces and writes its own forces and derivative
+	std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+		[&](unsigned int body) {
+			GatherEdgeForces(body);
+			Derivative(_input[body], body, dx::XMLoadFloat3x3(&bodies.world_inv_inertias[body]), _output[body]);
+		});
+}
+
+template <>
+PhysicsSystem::SystemStages<PhysicsState>& PhysicsSystem::GetSystemStages<PhysicsState>() {
+	matrix_stages.Resize(bodies.Size());
+	return matrix_stages;
+}
 
-	elapsed_time += dt;
+template <>
+PhysicsSystem::SystemStages<QuaternionPhysicsState>& PhysicsSystem::GetSystemStages<QuaternionPhysicsState>() {
+	quaternion_stages.Resize(bodies.Size());
+	return quaternion_stages;
+}
+
+template <typename State>
+void PhysicsSystem::SystemEulerIntegrate(float dt) {
+	SystemStages<State>& stages = GetSystemStages<State>();
+	std::vector<State>& curr_state = stages.curr_state;
+	std::vector<State>& k1 = stages.k1;
+	std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+		[&](unsigned int body) {
+			GetState(body, curr_state[body]);
+		});
+
+	SystemDerivative(curr_state, k1);
+
+	std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+		[&](unsigned int body) {
+			SetState(body, curr_state[body] + k1[body] * dt, true);
+		});
+	bodies.SwapBuffers();
+}
+
+template <typename State>
+void PhysicsSystem::SystemRK4Integrate(float dt) {
+	SystemStages<State>& stages = GetSystemStages<State>();
+	std::vector<State>& curr_state = stages.curr_state;
+	std::vector<State>& temp = stages.temp;
+	std::vector<State>& k1 = stages.k1;
+	std::vector<State>& k2 = stages.k2;
+	std::vector<State>& k3 = stages.k3;
+	std::vector<State>& k4 = stages.k4;
+	auto for_each_body = [&](auto function) {
+		std::for_each(std::execution::par, body_indices.begin(), body_indices.end(), function);
+	};
+	for_each_body([&](unsigned int body) {
+		GetState(body, curr_state[body]);
+	});
+
+	//k1 = dt * (y`(yi))
+	SystemDerivative(curr_state, k1);
+
+	//k2 = dt * (y`(yi + k1/2))
+	for_each_body([&](unsigned int body) {
+		k1[body].Scale(dt);
+		temp[body] = curr_state[body] + k1[body] * 0.5;
+	});
+	SystemDerivative(temp, k2);
+
+	//k3 = dt * (y`(yi + k2/2))
+	for_each_body([&](unsigned int body) {
+		k2[body].Scale(dt);
+		temp[body] = curr_state[body] + k2[body] * 0.5;
+	});
+	SystemDerivative(temp, k3);
+
+	//k4 = dt * (y`(yi + k3))
+	for_each_body([&](unsigned int body) {
+		k3[body].Scale(dt);
+		temp[body] = curr_state[body] + k3[body];
+	});
+	SystemDerivative(temp, k4);
+
+	//yi+1 = yi + (k1 + 2k2 + 2k3 + k4)*(1/6)
+	for_each_body([&](unsigned int body) {
+		k4[body].Scale(dt);
+		SetState(body, curr_state[body] + (k1[body] + k2[body] * 2 + k3[body] * 2 + k4[body]) * (1.0f / 6), true);
+	});
+	bodies.SwapBuffers();
+}
+
+void PhysicsSystem::SystemIntegrate(float dt) {
+	bool use_quaternion = orientation_method == OrientationMethod::QUATERNION;
+	if (use_method == IntegrateMethod::EULER) {
+		if (use_quaternion)
+			SystemEulerIntegrate<QuaternionPhysicsState>(dt);
+		else
+			SystemEulerIntegrate<PhysicsState>(dt);
+	}
+	else if (use_method == IntegrateMethod::RK4) {
+		if (use_quaternion)
+			SystemRK4Integrate<QuaternionPhysicsState>(dt);
+		else
+			SystemRK4Integrate<PhysicsState>(dt);
+	}
 }
 
 void PhysicsSystem::CalculateAllForces() {
@@ -88,38 +243,46 @@ void PhysicsSystem::CalculateAllTorques() {
 	}
 }
 
-void PhysicsSystem::CalculateVelocities() {
-	for (auto& obj : physics_objects) {
-		//c'(t) = v(t) = P(t)/M
-		dx::XMStoreFloat3(&obj->velocity, 
-			dx::XMVectorScale(dx::XMLoadFloat3(&obj->momentum), 1.0f / obj->mass));
-
-		//I-inv(t) = R(t) * Iobj-inv * R(t)-trans
-		dx::XMMATRIX I_inv =
-			dx::XMMatrixTranspose(dx::XMLoadFloat3x3(&obj->rotational_positon)) *
-			dx::XMLoadFloat3x3(&obj->Iobj_inv) * 
-			dx::XMLoadFloat3x3(&obj->rotational_positon);
-
-		//w(t) = I-inv(t) * L(t)
-		dx::XMStoreFloat3(&obj->angular_velocity, 
-			dx::XMVector3Transform(dx::XMLoadFloat3(&obj->angular_momentum), I_inv));
-	}
-	
-}
-
 void PhysicsSystem::SystemControls() {
 	unsigned int indx = 0;
 	if (ImGui::Begin("Physics controls")) {
 
 		if (ImGui::BeginMenu("Integration Method")) {
 			if (ImGui::MenuItem("Runge-Kutta 4th", "", use_method == IntegrateMethod::RK4)) use_method = IntegrateMethod::RK4;
+			if (ImGui::MenuItem("Implicit Euler", "", use_method == IntegrateMethod::IMPLICIT_EULER)) use_method = IntegrateMethod::IMPLICIT_EULER;
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("Orientation")) {
+			if (ImGui::MenuItem("Matrix", "", orientation_method == OrientationMethod::MATRIX))
+				orientation_method = OrientationMethod::MATRIX;
+			if (ImGui::MenuItem("Quaternion", "", orientation_method == OrientationMethod::QUATERNION)) {
+				//Start from the rotations integrated so far
+				if (orientation_method != OrientationMethod::QUATERNION)
+					bodies.SyncOrientations();
+				orientation_method = OrientationMethod::QUATERNION;
+			}
 			ImGui::EndMenu();
 		}
 
+		ImGui::Checkbox("Integrate Whole System", &system_integration);
+		if (use_method == IntegrateMethod::IMPLICIT_EULER) {
+			ImGui::Checkbox("Chain Solver", &implicit_integrator.use_chain_solver);
+			ImGui::Text("Conjugate Gradient Iterations : %u", implicit_integrator.last_iterations);
+		}
+
+		//=========================================
+		ImGui::Checkbox("Fixed Timestep", &fixed_timestep);
+		ImGui::SliderFloat("Timestep", &fixed_dt, 1.0f / 480.0f, 1.0f / 30.0f, "%.5f");
+		ImGui::SliderInt("Substeps", &substep_count, 1, 16);
+		ImGui::SliderInt("Max Steps Per Frame", &max_steps_per_frame, 1, 32);
+
 		//=========================================
 		ImGui::SliderFloat("Spring Coefficient", &spring_coeff, 0.1f, 1000.0f);
 		ImGui::SliderFloat("Damper Coefficient", &damper_coeff, 0.1f, 1000.0f);
-		ImGui::SliderFloat("Stick widht", &stick_width, 0.0f, 10.0f);
+		if (ImGui::SliderFloat("Stick widht", &stick_width, 0.0f, 10.0f))
+			BuildStickChain();
+		ImGui::SliderFloat("Pin Scale", &spring_graph.pin_scale, 1.0f, 100.0f);
 		//=========================================
 
 		if (ImGui::Button("Add Global Force")) {
@@ -174,54 +337,49 @@ void PhysicsSystem::SystemControls() {
 }
 
 void PhysicsSystem::UpdateDrawSprings() {
-	dx::XMFLOAT3 stick_a, stick_b;
-	stick_a.x = stick_width;
-	stick_a.y = 0;
-	stick_a.z = 0;
-
-	stick_b.x = -stick_width;
-	stick_b.y = 0;
-	stick_b.z = 0;
-
-	unsigned int indx = 0;
-	draw_spring_vertices[indx] = anchor_points[0];
-	indx++;
-	for (auto& obj : physics_objects) {
-		dx::XMFLOAT3 new_pos;
-		dx::XMStoreFloat3(
-			&new_pos,
-			dx::XMVectorAdd(
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_a),
-					dx::XMLoadFloat3x3(&obj->rotational_positon)),
-				dx::XMLoadFloat3(&obj->position))
-		);
-		draw_spring_vertices[indx] = new_pos;
-	
-		indx++;
-		dx::XMStoreFloat3(
-			&new_pos,
-			dx::XMVectorAdd(
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_b),
-					dx::XMLoadFloat3x3(&obj->rotational_positon)),
-				dx::XMLoadFloat3(&obj->position))
-		);
-		draw_spring_vertices[indx] = new_pos;
-		indx++;
+	//A line per edge of the spring graph
+	size_t vertex_count = spring_graph.Size() * 2;
+	if (vertex_count == 0)
+		return;
+	bool resized = draw_spring_vertices.size() != vertex_count;
+	draw_spring_vertices.resize(vertex_count);
+
+	auto get_end = [&](int end, const dx::XMFLOAT3& offset) {
+		if (SpringGraph::IsAnchor(end))
+			return dx::XMVectorAdd(dx::XMLoadFloat3(&anchor_points[SpringGraph::AnchorIndex(end)]),
+				dx::XMLoadFloat3(&offset));
+		return dx::XMVectorAdd(
+			dx::XMVector3Transform(dx::XMLoadFloat3(&offset), dx::XMLoadFloat3x3(&draw_rotations[end])),
+			dx::XMLoadFloat3(&draw_positions[end]));
+	};
+	for (unsigned int edge = 0; edge < spring_graph.Size(); ++edge) {
+		dx::XMStoreFloat3(&draw_spring_vertices[edge * 2],
+			get_end(spring_graph.bodies_a[edge], spring_graph.offsets_a[edge]));
+		dx::XMStoreFloat3(&draw_spring_vertices[edge * 2 + 1],
+			get_end(spring_graph.bodies_b[edge], spring_graph.offsets_b[edge]));
 	}
-	draw_spring_vertices[indx] = anchor_points[1];
 
-	draw_spring->UpdateVertices(gfx_ref, draw_spring_vertices);
+	if (resized)
+		draw_spring = std::make_unique<Curve>(*p_gfx, draw_spring_vertices, false, Curve::Connectivity::SEGMENTS);
+	else
+		draw_spring->UpdateVertices(*p_gfx, draw_spring_vertices);
 }
 
 void PhysicsSystem::SetAnchorPoint(unsigned int indx, dx::XMFLOAT3 point_pos) {
 	anchor_points[indx] = point_pos;
 }
 
-PhysicsSystem::PhysicsSystem(Graphics& gfx) : gfx_ref(gfx),
-	elapsed_time(0), use_method(IntegrateMethod::RK4), 
-	anchor_sphere_1(gfx, 5), anchor_sphere_2(gfx, 5), draw_spring(),
+PhysicsSystem::PhysicsSystem(Graphics& gfx) : PhysicsSystem(&gfx) {
+}
+
+PhysicsSystem::PhysicsSystem() : PhysicsSystem(nullptr) {
+}
+
+PhysicsSystem::PhysicsSystem(Graphics* gfx) : p_gfx(gfx),
+	elapsed_time(0), use_method(IntegrateMethod::RK4), orientation_method(OrientationMethod::MATRIX),
+	system_integration(true),
+	fixed_timestep(true), fixed_dt(1.0f / 60.0f), accumulator(0.0f), max_steps_per_frame(8), substep_count(1),
+	draw_spring(),
 	spring_coeff(100.0f), damper_coeff(100.0f) {
 
 	//Add gravitational force
@@ -230,11 +388,17 @@ PhysicsSystem::PhysicsSystem(Graphics& gfx) : gfx_ref(gfx),
 	anchor_points[0] = dx::XMFLOAT3(-20, 5, 0);
 	anchor_points[1] = dx::XMFLOAT3(20, 5, 0);
 
+	if (!p_gfx)
+		return;
+
+	anchor_sphere_1 = std::make_unique<SolidSphere>(*p_gfx, 5);
+	anchor_sphere_2 = std::make_unique<SolidSphere>(*p_gfx, 5);
+
 	std::vector<dx::XMFLOAT3> curve_points{ anchor_points[0] , anchor_points[1] };
 
 	draw_spring_vertices.push_back(anchor_points[0]);
 	draw_spring_vertices.push_back(anchor_points[1]);
-	draw_spring = std::make_unique<Curve>(gfx, draw_spring_vertices);
+	draw_spring = std::make_unique<Curve>(*p_gfx, draw_spring_vertices, false, Curve::Connectivity::SEGMENTS);
 }
 
 PhysicsSystem::~PhysicsSystem() {
@@ -247,201 +411,176 @@ PhysicsSystem::~PhysicsSystem() {
 	}
 }
 
-void PhysicsSystem::Derivative(PhysicsState& _input, PhysicsObject* _obj, PhysicsState& _output) {
+void PhysicsSystem::Derivative(const PhysicsState& _input, unsigned int body, dx::FXMMATRIX I_inv,
+	PhysicsState& _output) {
 	//c`(t) = v(t) = P(t)/M
 	dx::XMStoreFloat3(&_output.c, 
-		dx::XMVectorScale(dx::XMLoadFloat3(&_input.P), 1.0f / _obj->mass));
-
-	//I-inv(t) = R(t) * Iobj-inv * R(t)-trans
-	dx::XMMATRIX I_inv =
-		dx::XMMatrixTranspose(dx::XMLoadFloat3x3(&_input.R)) *
-		dx::XMLoadFloat3x3(&_obj->Iobj_inv) * 
-		dx::XMLoadFloat3x3(&_input.R);
+		dx::XMVectorScale(dx::XMLoadFloat3(&_input.P), bodies.inv_masses[body]));
 
 	//w(t) = I-inv(t) * L(t)
 	dx::XMVECTOR omega = dx::XMVector3Transform(dx::XMLoadFloat3(&_input.L), I_inv);
 
-	//R`(t) = ~w(t) * R(t)
+	//R`(t) = ~w(t) * R(t), R is stored transposed as points are transformed by p * R
 	dx::XMStoreFloat3x3(&_output.R,
-		dx::XMLoadFloat3x3(&_input.R) * TildeOperator(omega));
+		dx::XMLoadFloat3x3(&_input.R) * dx::XMMatrixTranspose(TildeOperator(omega)));
 
 	//P`(t) = F(t)
 	dx::XMVECTOR F = dx::XMVectorAdd(
 		total_global_force,
 		dx::XMVectorScale(gravity,
-			_obj->mass)
+			1.0f / bodies.inv_masses[body])
 	);
 	dx::XMStoreFloat3(&_output.P, 
-		dx::XMVectorAdd(dx::XMLoadFloat3(&_obj->force), F));
+		dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.forces[body]), F));
 
 	//L`(t) = T(t)
 	dx::XMStoreFloat3(&_output.L, 
-		dx::XMVectorAdd(dx::XMLoadFloat3(&_obj->torque), total_global_torque));
-}
-
-void PhysicsSystem::Integrate(PhysicsObject* _obj, float dt){
-	if (use_method == IntegrateMethod::EULER)
-		EulerIntegrate(_obj, dt);
-	else if (use_method == IntegrateMethod::RK4)
-		RK4Integrate(_obj, dt);
+		dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.torques[body]), total_global_torque));
 }
 
-void PhysicsSystem::UpdateStickForces(PhysicsObject* _obj) {
-	unsigned int indx = 0;
-	//Get the index of the physics object
-	while (_obj != physics_objects[indx])
-		indx++;
+void PhysicsSystem::Derivative(const QuaternionPhysicsState& _input, unsigned int body, dx::FXMMATRIX I_inv,
+	QuaternionPhysicsState& _output) {
+	//c`(t) = v(t) = P(t)/M
+	dx::XMStoreFloat3(&_output.c,
+		dx::XMVectorScale(dx::XMLoadFloat3(&_input.P), bodies.inv_masses[body]));
 
-	dx::XMVECTOR fa, fb;
-	dx::XMVECTOR ta, tb;
-
-	dx::XMVECTOR qi_prev, qi_a, qi_b, qi_next;
-	dx::XMVECTOR vi_prev, vi_a, vi_b, vi_next;
-
-	dx::XMFLOAT3 stick_a, stick_b;
-	stick_a.x = -stick_width;
-	stick_a.y = 0;
-	stick_a.z = 0;
-
-	stick_b.x = stick_width;
-	stick_b.y = 0;
-	stick_b.z = 0;
-
-	if (indx == 0) {
-		//First object i-1 is anchor point
-		qi_prev = dx::XMLoadFloat3(&anchor_points[0]);
-			
-		//qi_a = R(t) * [-x, 0, 0] + c(t)
-		qi_next = dx::XMVectorAdd(
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_a),
-				dx::XMLoadFloat3x3(&physics_objects[indx + 1]->rotational_positon)
-			),
-			dx::XMLoadFloat3(&physics_objects[indx + 1]->position)
-		);
-			
-		vi_prev = dx::XMVectorZero();
-		vi_next = dx::XMVectorAdd(
-			dx::XMVector3Cross(
-				dx::XMLoadFloat3(&physics_objects[indx + 1]->angular_velocity),
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_a),
-					dx::XMLoadFloat3x3(&physics_objects[indx + 1]->rotational_positon))),
-			dx::XMLoadFloat3(&physics_objects[indx + 1]->velocity));
-	}
-	else if (indx == physics_objects.size() - 1)
-	{
-		//Last object i+1 is anchor point
-
-		//qi_b = R(t) * [x, 0, 0] + c(t)
-		qi_prev = dx::XMVectorAdd(
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_b),
-				dx::XMLoadFloat3x3(&physics_objects[indx - 1]->rotational_positon)
-			),
-			dx::XMLoadFloat3(&physics_objects[indx - 1]->position)
-		);
-		qi_next = dx::XMLoadFloat3(&anchor_points[1]);
-
-		vi_prev = dx::XMVectorAdd(
-			dx::XMVector3Cross(
-				dx::XMLoadFloat3(&physics_objects[indx - 1]->angular_velocity),
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_b),
-					dx::XMLoadFloat3x3(&physics_objects[indx - 1]->rotational_positon))),
-			dx::XMLoadFloat3(&physics_objects[indx - 1]->velocity));
-		vi_next = dx::XMVectorZero();
-	}
-	else
-	{
-		qi_prev = dx::XMVectorAdd(
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_b),
-				dx::XMLoadFloat3x3(&physics_objects[indx - 1]->rotational_positon)
-			),
-			dx::XMLoadFloat3(&physics_objects[indx - 1]->position)
-		);
-
-		qi_next = dx::XMVectorAdd(
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_a),
-				dx::XMLoadFloat3x3(&physics_objects[indx + 1]->rotational_positon)
-			),
-			dx::XMLoadFloat3(&physics_objects[indx + 1]->position)
-		);
-
-		vi_prev = dx::XMVectorAdd(
-			dx::XMVector3Cross(
-				dx::XMLoadFloat3(&physics_objects[indx - 1]->angular_velocity),
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_b),
-					dx::XMLoadFloat3x3(&physics_objects[indx - 1]->rotational_positon))),
-			dx::XMLoadFloat3(&physics_objects[indx - 1]->velocity));
-		
-		vi_next = dx::XMVectorAdd(
-			dx::XMVector3Cross(
-				dx::XMLoadFloat3(&physics_objects[indx + 1]->angular_velocity),
-				dx::XMVector3Transform(
-					dx::XMLoadFloat3(&stick_a),
-					dx::XMLoadFloat3x3(&physics_objects[indx + 1]->rotational_positon))),
-			dx::XMLoadFloat3(&physics_objects[indx + 1]->velocity));
-	}
+	//w(t) = I-inv(t) * L(t)
+	dx::XMFLOAT3 omega;
+	dx::XMStoreFloat3(&omega, dx::XMVector3Transform(dx::XMLoadFloat3(&_input.L), I_inv));
 
-	qi_a = dx::XMVectorAdd(
-		dx::XMVector3Transform(
-			dx::XMLoadFloat3(&stick_a),
-			dx::XMLoadFloat3x3(&physics_objects[indx]->rotational_positon)
-		),
-		dx::XMLoadFloat3(&physics_objects[indx]->position)
-	);
+	//q`(t) = 1/2 * [0, w(t)] * q(t)
+	_output.q = Quaternion(0.0f, omega).Concatenate(_input.q).ScalarProduct(0.5f);
 
-	qi_b = dx::XMVectorAdd(
-		dx::XMVector3Transform(
-			dx::XMLoadFloat3(&stick_b),
-			dx::XMLoadFloat3x3(&physics_objects[indx]->rotational_positon)
-		),
-		dx::XMLoadFloat3(&physics_objects[indx]->position)
+	//P`(t) = F(t)
+	dx::XMVECTOR F = dx::XMVectorAdd(
+		total_global_force,
+		dx::XMVectorScale(gravity,
+			1.0f / bodies.inv_masses[body])
 	);
+	dx::XMStoreFloat3(&_output.P,
+		dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.forces[body]), F));
 
-	vi_a = dx::XMVectorAdd(
-		dx::XMVector3Cross(
-			dx::XMLoadFloat3(&physics_objects[indx]->angular_velocity),
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_a),
-				dx::XMLoadFloat3x3(&physics_objects[indx]->rotational_positon))),
-		dx::XMLoadFloat3(&physics_objects[indx]->velocity));
+	//L`(t) = T(t)
+	dx::XMStoreFloat3(&_output.L,
+		dx::XMVectorAdd(dx::XMLoadFloat3(&bodies.torques[body]), total_global_torque));
+}
 
-	vi_b = dx::XMVectorAdd(
-		dx::XMVector3Cross(
-			dx::XMLoadFloat3(&physics_objects[indx]->angular_velocity),
-			dx::XMVector3Transform(
-				dx::XMLoadFloat3(&stick_b),
-				dx::XMLoadFloat3x3(&physics_objects[indx]->rotational_positon))),
-		dx::XMLoadFloat3(&physics_objects[indx]->velocity));
+void PhysicsSystem::Integrate(unsigned int body, float dt){
+	bool use_quaternion = orientation_method == OrientationMethod::QUATERNION;
+	if (use_method == IntegrateMethod::EULER) {
+		if (use_quaternion)
+			EulerIntegrate<QuaternionPhysicsState>(body, dt);
+		else
+			EulerIntegrate<PhysicsState>(body, dt);
+	}
+	else if (use_method == IntegrateMethod::RK4) {
+		if (use_quaternion)
+			RK4Integrate<QuaternionPhysicsState>(body, dt);
+		else
+			RK4Integrate<PhysicsState>(body, dt);
+	}
+}
 
-	//Calculate linear forces
+dx::XMVECTOR PhysicsSystem::GetBodyPoint(unsigned int body, dx::FXMVECTOR offset) const {
+	//q = R(t) * offset + c(t)
+	return dx::XMVectorAdd(
+		dx::XMVector3Transform(offset, dx::XMLoadFloat3x3(&bodies.rotations[body])),
+		dx::XMLoadFloat3(&bodies.positions[body]));
+}
 
-	fa = dx::XMVectorAdd(
-		dx::XMVectorScale(dx::XMVectorSubtract(qi_prev, qi_a), spring_coeff),
-		dx::XMVectorScale(dx::XMVectorSubtract(vi_prev, vi_a), damper_coeff));
+dx::XMVECTOR PhysicsSystem::GetBodyPointVelocity(unsigned int body, dx::FXMVECTOR offset) const {
+	//q` = w(t) x (R(t) * offset) + v(t)
+	return dx::XMVectorAdd(
+		dx::XMVector3Cross(
+			dx::XMLoadFloat3(&bodies.angular_velocities[body]),
+			dx::XMVector3Transform(offset, dx::XMLoadFloat3x3(&bodies.rotations[body]))),
+		dx::XMLoadFloat3(&bodies.velocities[body]));
+}
 
-	fb = dx::XMVectorAdd(
-		dx::XMVectorScale(dx::XMVectorSubtract(qi_next, qi_b), spring_coeff),
-		dx::XMVectorScale(dx::XMVectorSubtract(vi_next, vi_b), damper_coeff));
+void PhysicsSystem::GetEndPoint(int end, const dx::XMFLOAT3& offset,
+	dx::XMVECTOR& point, dx::XMVECTOR& velocity) const {
+	if (SpringGraph::IsAnchor(end)) {
+		point = dx::XMVectorAdd(dx::XMLoadFloat3(&anchor_points[SpringGraph::AnchorIndex(end)]),
+			dx::XMLoadFloat3(&offset));
+		velocity = dx::XMVectorZero();
+		return;
+	}
+	point = GetBodyPoint(end, dx::XMLoadFloat3(&offset));
+	velocity = GetBodyPointVelocity(end, dx::XMLoadFloat3(&offset));
+}
 
-	dx::XMStoreFloat3(&_obj->force, dx::XMVectorAdd(fa, fb));
+void PhysicsSystem::UpdateEdgeForces() {
+	if (edge_indices.size() != spring_graph.Size()) {
+		edge_indices.resize(spring_graph.Size());
+		for (unsigned int edge = 0; edge < edge_indices.size(); ++edge) {
+			edge_indices[edge] = edge;
+		}
+	}
 
+	//Every edge only reads the body state and writes its own force
+	std::for_each(std::execution::par, edge_indices.begin(), edge_indices.end(),
+		[&](unsigned int edge) {
+			dx::XMVECTOR qa, va, qb, vb;
+			GetEndPoint(spring_graph.bodies_a[edge], spring_graph.offsets_a[edge], qa, va);
+			GetEndPoint(spring_graph.bodies_b[edge], spring_graph.offsets_b[edge], qb, vb);
+
+			//f = k * (qb - qa) + d * (vb - va) on end a
+			float k, d;
+			spring_graph.GetCoefficients(edge, spring_coeff, damper_coeff, k, d);
+			dx::XMVECTOR f = dx::XMVectorAdd(
+				dx::XMVectorScale(dx::XMVectorSubtract(qb, qa), k),
+				dx::XMVectorScale(dx::XMVectorSubtract(vb, va), d));
+			dx::XMStoreFloat3(&spring_graph.forces[edge], f);
+
+			//Torques about the center of the body of each end
+			int body_a = spring_graph.bodies_a[edge];
+			int body_b = spring_graph.bodies_b[edge];
+			if (!SpringGraph::IsAnchor(body_a)) {
+				dx::XMVECTOR ra = dx::XMVectorSubtract(qa, dx::XMLoadFloat3(&bodies.positions[body_a]));
+				dx::XMStoreFloat3(&spring_graph.torques_a[edge], dx::XMVector3Cross(ra, f));
+			}
+			if (!SpringGraph::IsAnchor(body_b)) {
+				dx::XMVECTOR rb = dx::XMVectorSubtract(qb, dx::XMLoadFloat3(&bodies.positions[body_b]));
+				dx::XMStoreFloat3(&spring_graph.torques_b[edge], dx::XMVector3Cross(rb, dx::XMVectorNegate(f)));
+			}
+		});
+}
 
-	//Calculate angular forces
-	ta = dx::XMVector3Cross(
-		dx::XMVectorSubtract(qi_a, dx::XMLoadFloat3(&physics_objects[indx]->position)),
-		fa);
+void PhysicsSystem::GatherEdgeForces(unsigned int body) {
+	dx::XMVECTOR force = dx::XMVectorZero();
+	dx::XMVECTOR torque = dx::XMVectorZero();
+	for (unsigned int i = spring_graph.body_edge_starts[body]; i < spring_graph.body_edge_starts[body + 1]; ++i) {
+		unsigned int edge = spring_graph.body_edges[i];
+		dx::XMVECTOR f = dx::XMLoadFloat3(&spring_graph.forces[edge]);
+		if (spring_graph.bodies_a[edge] == (int)body) {
+			force = dx::XMVectorAdd(force, f);
+			torque = dx::XMVectorAdd(torque, dx::XMLoadFloat3(&spring_graph.torques_a[edge]));
+		}
+		if (spring_graph.bodies_b[edge] == (int)body) {
+			force = dx::XMVectorSubtract(force, f);
+			torque = dx::XMVectorAdd(torque, dx::XMLoadFloat3(&spring_graph.torques_b[edge]));
+		}
+	}
+	dx::XMStoreFloat3(&bodies.forces[body], force);
+	dx::XMStoreFloat3(&bodies.torques[body], torque);
+}
 
-	tb = dx::XMVector3Cross(
-		dx::XMVectorSubtract(qi_b, dx::XMLoadFloat3(&physics_objects[indx]->position)),
-		fb);
-	
-	dx::XMStoreFloat3(&_obj->torque, dx::XMVectorAdd(ta, tb));
+void PhysicsSystem::BuildStickChain() {
+	dx::XMFLOAT3 stick_a(-stick_width, 0.0f, 0.0f);
+	dx::XMFLOAT3 stick_b(stick_width, 0.0f, 0.0f);
+	dx::XMFLOAT3 anchor_offset(0.0f, 0.0f, 0.0f);
+
+	//End a connects to end b of the previous object, the first object to the left anchor point
+	//and the last object to the right anchor point
+	spring_graph.Clear();
+	int count = (int)bodies.Size();
+	if (count == 0)
+		return;
+	spring_graph.AddEdge(SpringGraph::EdgeType::SPRING, SpringGraph::Anchor(0), anchor_offset, 0, stick_a);
+	for (int body = 1; body < count; ++body) {
+		spring_graph.AddEdge(SpringGraph::EdgeType::SPRING, body - 1, stick_b, body, stick_a);
+	}
+	spring_graph.AddEdge(SpringGraph::EdgeType::SPRING, count - 1, stick_b, SpringGraph::Anchor(1), anchor_offset);
 }
 
 void PhysicsSystem::AddPhysicsObject(const std::vector<std::pair<dx::XMFLOAT3, float>>& vertices) {
@@ -450,27 +589,72 @@ void PhysicsSystem::AddPhysicsObject(const std::vector<std::pair<dx::XMFLOAT3, f
 	anchor_points[1].x += 5;
 
 
-	for (auto& obj : physics_objects) {
-		obj->position.x -= 20.0f;
+	for (auto& position : bodies.positions) {
+		position.x -= 20.0f;
+	}
+	for (auto& position : bodies.previous_positions) {
+		position.x -= 20.0f;
 	}
 
 	PhysicsObject* phy_obj = new PhysicsObject(vertices);
-	phy_obj->position = anchor_points[1];
-	phy_obj->position.x -= 10.0f;
+	dx::XMFLOAT3 position = anchor_points[1];
+	position.x -= 10.0f;
+	unsigned int body = bodies.AddBody(phy_obj->mass, phy_obj->Iobj_inv, position);
+	body_indices.push_back(body);
+	draw_positions.push_back(bodies.positions[body]);
+	draw_rotations.push_back(bodies.rotations[body]);
 
 	physics_objects.push_back(phy_obj);
 
+	if (!p_gfx)
+		return;
 	std::vector<dx::XMFLOAT3> draw_vertices;
 	for (auto& vertex : vertices)
 		draw_vertices.push_back(vertex.first);
-	Polyhedron* draw_obj = new Polyhedron(gfx_ref, draw_vertices,
+	Polyhedron* draw_obj = new Polyhedron(*p_gfx, draw_vertices,
 		dx::XMFLOAT4(162.0f / 255, 0.0f / 255, 255.0f / 255, 255.0f / 255));
 	draw_objects.push_back(draw_obj);
 
-	//Add two vertices to the spring to be drawn
-	draw_spring_vertices.push_back(dx::XMFLOAT3());
-	draw_spring_vertices.push_back(dx::XMFLOAT3());
-	draw_spring = std::make_unique<Curve>(gfx_ref, draw_spring_vertices);
+}
+
+void PhysicsSystem::Step(float step_dt) {
+	bodies.SavePrevious();
+	spring_graph.UpdateBodyEdges(bodies.Size());
+
+	float dt = step_dt / substep_count;
+	for (int substep = 0; substep < substep_count; ++substep) {
+		elapsed_time += dt;
+		if (use_method == IntegrateMethod::IMPLICIT_EULER) {
+			std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+				[&](unsigned int body) {
+					bodies.CalculateVelocities(body);
+				});
+			implicit_integrator.Step(bodies, spring_graph, anchor_points, spring_coeff, damper_coeff, gravity,
+				total_global_force, total_global_torque,
+				orientation_method == OrientationMethod::QUATERNION, dt);
+			continue;
+		}
+		if (system_integration) {
+			SystemIntegrate(dt);
+			continue;
+		}
+
+		//Every pass reads the current state and writes only the body's own data,
+		//so the result does not depend on how the bodies are split between threads
+		std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+			[&](unsigned int body) {
+				bodies.CalculateVelocities(body);
+			});
+		UpdateEdgeForces();
+		std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+			[&](unsigned int body) {
+				//Update the forces on the object from the edges of the spring graph
+				GatherEdgeForces(body);
+				//The new state goes to the back buffer, the neighbours still read the current one
+				Integrate(body, dt);
+			});
+		bodies.SwapBuffers();
+	}
 }
 
 void PhysicsSystem::Update(float dt) {
@@ -479,38 +663,57 @@ void PhysicsSystem::Update(float dt) {
 	//Ensure all global forces are updated
 	CalculateAllForces();
 	CalculateAllTorques();
-	CalculateVelocities();
-
-	for (auto& obj : physics_objects) {
-		//Update the forces on the object using the stick-spring system
-		UpdateStickForces(obj);
-		Integrate(obj, dt);
-
-		//Update the object positions with the new positions for this frame
-		obj->UpdatePositions();
 
+	if (!fixed_timestep) {
+		accumulator = 0.0f;
+		Step(dt);
+		return;
 	}
 
-	UpdateDrawSprings();
+	accumulator += dt;
+	int steps = 0;
+	while (accumulator >= fixed_dt && steps < max_steps_per_frame) {
+		Step(fixed_dt);
+		accumulator -= fixed_dt;
+		steps++;
+	}
+	//Drop the time that could not be simulated this frame
+	if (accumulator >= fixed_dt)
+		accumulator = fmodf(accumulator, fixed_dt);
 }
 
 void PhysicsSystem::Draw() {
+	if (!p_gfx)
+		return;
+
+	//Fraction of a step the frame time is past the last step
+	float alpha = fixed_timestep ? accumulator / fixed_dt : 1.0f;
+	bool use_quaternion = orientation_method == OrientationMethod::QUATERNION;
+	std::for_each(std::execution::par, body_indices.begin(), body_indices.end(),
+		[&](unsigned int body) {
+			bodies.GetInterpolatedPose(body, alpha, use_quaternion, draw_positions[body], draw_rotations[body]);
+			physics_objects[body]->UpdatePositions(draw_positions[body], draw_rotations[body]);
+		});
+	UpdateDrawSprings();
+
 	unsigned int indx = 0;
 	for (auto& obj : draw_objects) {
-		obj->UpdateVertices(gfx_ref,
+		obj->UpdateVertices(*p_gfx,
 			physics_objects[indx]->GetVertexPositions());
-		obj->Draw(gfx_ref);
+		obj->Draw(*p_gfx);
 		indx++;
 	}
 
-	anchor_sphere_1.SetPosition(anchor_points[0]);
-	anchor_sphere_2.SetPosition(anchor_points[1]);
+	anchor_sphere_1->SetPosition(anchor_points[0]);
+	anchor_sphere_2->SetPosition(anchor_points[1]);
 
-	anchor_sphere_1.Draw(gfx_ref);
-	anchor_sphere_2.Draw(gfx_ref);
+	anchor_sphere_1->Draw(*p_gfx);
+	anchor_sphere_2->Draw(*p_gfx);
 
-	draw_spring->Update(0.0f);
-	draw_spring->Draw(gfx_ref);
+	if (spring_graph.Size() > 0) {
+		draw_spring->Update(0.0f);
+		draw_spring->Draw(*p_gfx);
+	}
 }
 
 size_t PhysicsSystem::ObjectCount() {
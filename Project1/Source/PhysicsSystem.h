@@ -2,6 +2,10 @@
 #include "Graphics.h"
 #include "SolidSphere.h"
 #include "Curve.h"
+#include "RigidBodyStore.h"
+#include "Quaternion.h"
+#include "ImplicitIntegrator.h"
+#include "SpringGraph.h"
 
 class Polyhedron;
 
@@ -57,46 +61,173 @@ struct PhysicsState
 	}
 };
 
+/*
+* PhysicsState with the angular position as a unit quaternion.
+* q`(t) = 1/2 * w(t) * q(t), q is renormalized after every step
+*/
+struct QuaternionPhysicsState
+{
+	//Position
+	DirectX::XMFLOAT3 c;
+	//Angular position
+	Quaternion q;
+
+	//Momentum
+	DirectX::XMFLOAT3 P;
+	//Angular momentum
+	DirectX::XMFLOAT3 L;
+
+	void Scale(float t) {
+		*this = *this * t;
+	}
+
+	QuaternionPhysicsState operator+(const QuaternionPhysicsState& _other) const {
+		QuaternionPhysicsState ret_state;
+		DirectX::XMStoreFloat3(&ret_state.c,
+			DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&c), DirectX::XMLoadFloat3(&_other.c)));
+		ret_state.q = q.Add(_other.q);
+		DirectX::XMStoreFloat3(&ret_state.P,
+			DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&P), DirectX::XMLoadFloat3(&_other.P)));
+		DirectX::XMStoreFloat3(&ret_state.L,
+			DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&L), DirectX::XMLoadFloat3(&_other.L)));
+
+		return ret_state;
+	}
+
+	QuaternionPhysicsState operator*(float m) const {
+		QuaternionPhysicsState ret_state;
+		DirectX::XMStoreFloat3(&ret_state.c,
+			DirectX::XMVectorScale(DirectX::XMLoadFloat3(&c), m));
+		ret_state.q = q.ScalarProduct(m);
+		DirectX::XMStoreFloat3(&ret_state.P,
+			DirectX::XMVectorScale(DirectX::XMLoadFloat3(&P), m));
+		DirectX::XMStoreFloat3(&ret_state.L,
+			DirectX::XMVectorScale(DirectX::XMLoadFloat3(&L), m));
+
+		return ret_state;
+	}
+};
+
 class PhysicsObject;
 
 class PhysicsSystem {
+	friend class PhysicsCheck;
 public:
 	PhysicsSystem(Graphics& gfx);
+	//Without graphics, nothing is drawn. Used by the headless checks
+	PhysicsSystem();
 	~PhysicsSystem();
 
 	//Add an object to the system
 	void AddPhysicsObject(const std::vector<std::pair<DirectX::XMFLOAT3, float>>& vertices);
 
-	//Called once every frame
+	/*
+	* Called once every frame
+	* With a fixed timestep dt is added to an accumulator that is consumed
+	* in steps of fixed_dt, otherwise the system takes one step of dt
+	*/
 	void Update(float dt);
 
 	//Called once every frame to render each object
+	//With a fixed timestep the objects are drawn between the last two steps
 	void Draw();
 
 	//Gets the number of physics objects
 	size_t ObjectCount();
 
-	//Sets the uniform stick width
+	//Sets the uniform stick width used by BuildStickChain
 	void SetStickWidth(float width);
 
 	//Anchor points that do not respond to the physics system
 	DirectX::XMFLOAT3 anchor_points[2];
 	unsigned int selected_anchor_point;
 
+	//Springs, dampers and pins between the objects and the anchor points
+	SpringGraph spring_graph;
+
+	/*
+	* Replaces the spring graph with a chain of sticks between the anchor points
+	* End a of each object is joined to end b of the previous one
+	*/
+	void BuildStickChain();
+
 private:
-	Graphics& gfx_ref;
+	//nullptr when the system is not drawn
+	Graphics* p_gfx;
+
+	PhysicsSystem(Graphics* gfx);
 
 	float elapsed_time;
 	enum class IntegrateMethod {
 		EULER,
-		RK4
+		RK4,
+		//Linearly implicit Euler of the whole system, stable for stiff springs
+		IMPLICIT_EULER
 	};
 	IntegrateMethod use_method;
+	ImplicitIntegrator implicit_integrator;
+
+	//Representation of the angular position that is integrated
+	enum class OrientationMethod {
+		MATRIX,
+		QUATERNION
+	};
+	OrientationMethod orientation_method;
 
 	bool apply_torque;
 
+	//Integrate all bodies together, with the forces of every body evaluated at each stage
+	//Otherwise each body is integrated in turn with the forces of its neighbours held
+	bool system_integration;
+
+	//Stage states of the system integrators, one per body, kept between steps
+	template <typename State>
+	struct SystemStages {
+		std::vector<State> curr_state;
+		std::vector<State> temp;
+		std::vector<State> k1;
+		std::vector<State> k2;
+		std::vector<State> k3;
+		std::vector<State> k4;
+
+		//Only reallocates when the number of bodies changed
+		void Resize(size_t count) {
+			if (curr_state.size() == count)
+				return;
+			curr_state.resize(count);
+			temp.resize(count);
+			k1.resize(count);
+			k2.resize(count);
+			k3.resize(count);
+			k4.resize(count);
+		}
+	};
+	SystemStages<PhysicsState> matrix_stages;
+	SystemStages<QuaternionPhysicsState> quaternion_stages;
+
+	//Returns: SystemStages - the stage buffers for the state type, resized to the bodies
+	template <typename State>
+	SystemStages<State>& GetSystemStages();
+
+	//Step by fixed_dt regardless of the frame time
+	bool fixed_timestep;
+	float fixed_dt;
+	//Frame time not yet simulated
+	float accumulator;
+	//Steps per frame after which the remaining time is dropped,
+	//so a slow frame does not cause even more steps in the next one
+	int max_steps_per_frame;
+	//Integrations per step, each of step_dt / substep_count
+	int substep_count;
+
 	//Objects on which to perform the physics calculations
 	std::vector<PhysicsObject*> physics_objects;
+	//State of the physics objects, body i belongs to physics_objects[i]
+	RigidBodyStore bodies;
+	//0 to n-1, to run the per body passes in parallel
+	std::vector<unsigned int> body_indices;
+	//0 to edges-1, to run the edge pass in parallel
+	std::vector<unsigned int> edge_indices;
 	//Objects that represent the physics objects that will be rendered
 	std::vector<Polyhedron*> draw_objects;
 
@@ -107,12 +238,16 @@ private:
 	DirectX::XMVECTOR total_global_torque;
 	
 	//Objects to render the anchor points
-	SolidSphere anchor_sphere_1;
-	SolidSphere anchor_sphere_2;
+	std::unique_ptr<SolidSphere> anchor_sphere_1;
+	std::unique_ptr<SolidSphere> anchor_sphere_2;
 	
 	std::unique_ptr<Curve> draw_spring;
 	std::vector<DirectX::XMFLOAT3> draw_spring_vertices;
 
+	//Poses the objects are drawn with, interpolated between the last two steps
+	std::vector<DirectX::XMFLOAT3> draw_positions;
+	std::vector<DirectX::XMFLOAT3X3> draw_rotations;
+
 	//Stick width for stick-sprint system
 	//All objects are assumed to be uniformly wide sticks.
 	float stick_width;
@@ -121,15 +256,36 @@ private:
 	float spring_coeff;
 	float damper_coeff;
 
+	//Gets the current state of the body
+	void GetState(unsigned int body, PhysicsState& _state) const;
+	void GetState(unsigned int body, QuaternionPhysicsState& _state) const;
+
+	/*
+	* Sets the body's state in the current state or the back buffer
+	* q is normalized and R(t) updated from it
+	*/
+	void SetState(unsigned int body, const PhysicsState& _state, bool back_buffer = false);
+	void SetState(unsigned int body, const QuaternionPhysicsState& _state, bool back_buffer = false);
+
+	//I-inv(t) of the body with the rotation of the state
+	DirectX::XMMATRIX GetWorldInverseInertia(const PhysicsState& _state, unsigned int body) const;
+	DirectX::XMMATRIX GetWorldInverseInertia(const QuaternionPhysicsState& _state, unsigned int body) const;
+
 	/*
 	* Euler's method for integration by timesetp dt
+	* State is PhysicsState or QuaternionPhysicsState
+	* The new state is written to the back buffer
 	*/
-	void EulerIntegrate(PhysicsObject* _obj, float dt);
+	template <typename State>
+	void EulerIntegrate(unsigned int body, float dt);
 
 	/*
 	* Runge-Kutta 4th order method for integration by timesetp dt
+	* State is PhysicsState or QuaternionPhysicsState
+	* The new state is written to the back buffer
 	*/
-	void RK4Integrate(PhysicsObject* _obj, float dt);
+	template <typename State>
+	void RK4Integrate(unsigned int body, float dt);
 	
 	/*
 	* Calculates all the global forces acting on the system
@@ -142,17 +298,55 @@ private:
 	* and stores it in total_global_torque
 	*/
 	void CalculateAllTorques();
-	void Derivative(PhysicsState& _input, PhysicsObject* _obj, PhysicsState& _output);
-	void Integrate(PhysicsObject* _obj, float dt);
+	//I_inv is I-inv(t) for the rotation of the input state
+	void Derivative(const PhysicsState& _input, unsigned int body, DirectX::FXMMATRIX I_inv,
+		PhysicsState& _output);
+	void Derivative(const QuaternionPhysicsState& _input, unsigned int body, DirectX::FXMMATRIX I_inv,
+		QuaternionPhysicsState& _output);
+	void Integrate(unsigned int body, float dt);
+
+	/*
+	* Derivative of the state of every body, with the spring forces calculated
+	* from the input states of all bodies
+	* The current state of the bodies is set to the input state
+	*/
+	template <typename State>
+	void SystemDerivative(const std::vector<State>& _input, std::vector<State>& _output);
+
+	//Euler's method on the state of the whole system
+	template <typename State>
+	void SystemEulerIntegrate(float dt);
+
+	//Runge-Kutta 4th order method on the state of the whole system
+	template <typename State>
+	void SystemRK4Integrate(float dt);
+
+	void SystemIntegrate(float dt);
+
+	/*
+	* Advances all bodies by step_dt in substep_count integrations
+	* and keeps the state before it as the previous state
+	*/
+	void Step(float step_dt);
+
+	//Point of the body at the offset from its center, in world space
+	DirectX::XMVECTOR GetBodyPoint(unsigned int body, DirectX::FXMVECTOR offset) const;
+
+	//Velocity of the point of the body at the offset from its center
+	DirectX::XMVECTOR GetBodyPointVelocity(unsigned int body, DirectX::FXMVECTOR offset) const;
+
+	//Point and velocity of an end of a spring graph edge
+	void GetEndPoint(int end, const DirectX::XMFLOAT3& offset,
+		DirectX::XMVECTOR& point, DirectX::XMVECTOR& velocity) const;
 
 	/*
-	* Update the forces for the object with the Stick Spring system
-	* Assumes each object is a uniformly sized stick
+	* Calculates the force of every edge of the spring graph from the current state
+	* and the torques it applies to the bodies of its ends
 	*/
-	void UpdateStickForces(PhysicsObject* _obj);
+	void UpdateEdgeForces();
 
-	//Calculate the velocities for all objects using the momentums for the current frame
-	void CalculateVelocities();
+	//Sums the edge forces and torques on the body into its force and torque
+	void GatherEdgeForces(unsigned int body);
 
 	/*
 	* Window to display and controle the Physics system parameters
@@ -161,6 +355,7 @@ private:
 
 	/*
 	* Update the positions of the springs being being drawn
+	* from the spring graph, draw_positions and draw_rotations
 	*/
 	void UpdateDrawSprings();
 
@@ -34,8 +34,9 @@ void Project_IK::Setup() {
 	animation_path->AddControlPoint(target_position, 0);
 
 	auto path_points = animation_path->GeneratePath();
-	draw_path = std::make_unique<Curve>(gfx_ref, path_points);
-	animation_path->GenerateForwardDiffTable();
+	//The path is edited a few vertices at a time as the target moves
+	draw_path = std::make_unique<Curve>(gfx_ref, path_points, true);
+	animation_path->GenerateArcLengthTable();
 	animation_path->GenerateDefaultVelocityFunction();
 
 	animation_path->loop_time = 15;
@@ -49,6 +50,23 @@ void Project_IK::Setup() {
 	draw_floor->SetScale(1000.0f);
 	draw_floor->SetPosition(dx::XMFLOAT3(0.0f, -505.0f, 200.0f));
 	draw_floor->SetRotation(dx::XMMatrixRotationRollPitchYaw(dx::XMVectorGetX(dx::g_XMHalfPi), 0.0f, 0.0f));
+
+	//Rows of characters behind the model, solved with damped least squares so they share SIMD lanes
+	crowd_models.clear();
+	crowd_offsets.clear();
+	crowd_controllers.clear();
+	for (unsigned int i = 0; i < crowd_size; ++i) {
+		std::unique_ptr<Model> crowd_model = std::make_unique<Model>();
+		crowd_model->LoadModel(gfx_ref, &fbx_ref, TEXT("Max_Red_Body_Diffuse.png"));
+		crowd_model->ik_mode = true;
+		crowd_model->batch_ik = true;
+		crowd_model->show_controls = false;
+		crowd_model->ik_controller->show_controls = false;
+		crowd_model->ik_controller->solver_method = IKController::SolverMethod::DLS;
+		crowd_controllers.push_back(crowd_model->ik_controller.get());
+		crowd_models.push_back(std::move(crowd_model));
+		crowd_offsets.push_back(dx::XMFLOAT3(((i % 4) - 1.5f) * 120.0f, 0.0f, (i / 4 + 1) * 150.0f));
+	}
 }
 
 void Project_IK::Enter() {
@@ -60,11 +78,15 @@ void Project_IK::Update(float dt) {
 	Window& window_ref = p_parent_app->GetWindow();
 	Graphics& gfx_ref = window_ref.Gfx();
 
-	draw_model->controller->animation_path->ReplaceLastPoint(target_position, 0);
+	Path& path_ref = *draw_model->controller->animation_path;
+	path_ref.ReplaceLastPoint(target_position, 0);
 
-	//Regenerate the path
-	auto path_points = draw_model->controller->animation_path->GenerateUnloopedPath();
-	draw_path->UpdateVertices(gfx_ref, path_points);
+	//Upload only the part of the path that moved with the target
+	unsigned int first_vertex[2], vertex_count[2];
+	unsigned int range_count = path_ref.GetDirtyVertexRanges(first_vertex, vertex_count);
+	for (unsigned int i = 0; i < range_count; i++) {
+		draw_path->UpdateVertices(gfx_ref, path_ref.GetPathVertices(), first_vertex[i], vertex_count[i]);
+	}
 
 	ProjectControls();
 	SphereControls();
@@ -76,6 +98,8 @@ void Project_IK::Update(float dt) {
 	target_sphere->SetPosition(sphere_pos);
 
 	draw_model->Update(window_ref.keyboard.isKeyPressed(VK_SPACE) ? 0.0f : dt);
+	if (show_crowd)
+		UpdateCrowd(window_ref.keyboard.isKeyPressed(VK_SPACE) ? 0.0f : dt, sphere_pos);
 	draw_path->Update(dt);
 	target_sphere->Update(dt);
 
@@ -100,10 +124,30 @@ void Project_IK::Update(float dt) {
 	draw_floor->Update(dt);
 }
 
+void Project_IK::UpdateCrowd(float dt, const dx::XMFLOAT3& sphere_pos) {
+	for (unsigned int i = 0; i < crowd_models.size(); ++i) {
+		Model& crowd_model = *crowd_models[i];
+		dx::XMVECTOR offset = dx::XMLoadFloat3(&crowd_offsets[i]);
+		dx::XMStoreFloat3(&crowd_model.position,
+			dx::XMVectorAdd(dx::XMLoadFloat3(&draw_model->position), offset));
+		crowd_model.rotation = draw_model->rotation;
+		crowd_model.ik_controller->target_position =
+			dx::XMVectorAdd(dx::XMLoadFloat3(&sphere_pos), offset);
+		crowd_model.Update(dt);
+	}
+	//Update only sets up the model transforms, the solve is done here for the whole crowd
+	crowd_solver.Solve(crowd_controllers, dt);
+}
+
 void Project_IK::Draw() {
 	Window& window_ref = p_parent_app->GetWindow();
 	draw_floor->Draw(window_ref.Gfx());
 	draw_model->Draw(window_ref.Gfx());
+	if (show_crowd) {
+		for (auto& crowd_model : crowd_models) {
+			crowd_model->Draw(window_ref.Gfx());
+		}
+	}
 	draw_path->Draw(window_ref.Gfx());
 	target_sphere->Draw(window_ref.Gfx());
 
@@ -122,6 +166,7 @@ void Project_IK::ProjectControls() {
 		ImGui::SliderFloat("Sphere X pos", &target_position.x, -300.0f, 300.0f);
 		ImGui::SliderFloat("Sphere Y pos", &target_position.y, -300.0f, 300.0f);
 		ImGui::SliderFloat("Sphere Z pos", &target_position.z, -300.0f, 300.0f);
+		ImGui::Checkbox("Show crowd", &show_crowd);
 	}
 	ImGui::End();
 }
@@ -154,4 +199,7 @@ void Project_IK::Reset() {
 	draw_model->ik_controller->Reset();
 	draw_model->controller->SetActiveAnimation(0);
 	draw_model->controller->animation_path->Reset();
+	for (auto& crowd_model : crowd_models) {
+		crowd_model->ik_controller->Reset();
+	}
 }
\ No newline at end of file
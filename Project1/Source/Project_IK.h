@@ -1,6 +1,7 @@
 #pragma once
 #include "Project.h"
 #include "SolidSphere.h"
+#include "IKBatchSolver.h"
 
 class Project_IK : public Project {
 public:
@@ -36,6 +37,11 @@ public:
 
 	//Resets the simulation to the starting point
 	void Reset();
+
+	/*
+	* Moves the crowd along with the model and solves all of their IK in one batch
+	*/
+	void UpdateCrowd(float dt, const dx::XMFLOAT3& sphere_pos);
 private:
 	std::unique_ptr<Model> draw_model;
 	std::unique_ptr<Curve> draw_path;
@@ -47,5 +53,13 @@ private:
 	dx::XMFLOAT3 target_position;
 	dx::XMFLOAT3 starting_position;
 	float distance_threshold = 10.0f;
+
+	//Copies of the model standing next to it, each reaching for the target at its own offset
+	static const unsigned int crowd_size = 8;
+	std::vector<std::unique_ptr<Model>> crowd_models;
+	std::vector<dx::XMFLOAT3> crowd_offsets;
+	std::vector<IKController*> crowd_controllers;
+	IKBatchSolver crowd_solver;
+	bool show_crowd = false;
 };
 
@@ -1,3 +1,5 @@
+#include <cfloat>
+#include "imgui/imgui.h"
 #include "App.h"
 #include "Project_PathAnimation.h"
 
@@ -48,12 +50,16 @@ void Project_PathAnimation::Setup() {
 
 	animation_path->Scale(2.0f, 2.0f, 2.0f);
 
-	draw_path = std::make_unique<Curve>(gfx_ref, animation_path->GeneratePath());
-	animation_path->GenerateForwardDiffTable();
+	animation_path->GenerateArcLengthTable();
 	animation_path->GenerateDefaultVelocityFunction();
 
 	all_control_points = animation_path->GetAllControlPoints();
 	draw_model->controller->SetAnimationPath(animation_path);
+	//Flattened for the camera on the first update
+	draw_path.reset();
+
+	crowd_path = std::make_unique<SharedPath>(*animation_path);
+	SetupCrowd(gfx_ref, fbx_ref);
 
 	draw_control_point = std::make_unique<SolidSphere>(gfx_ref, 2);
 
@@ -63,9 +69,109 @@ void Project_PathAnimation::Setup() {
 	draw_floor->SetRotation(dx::XMMatrixRotationRollPitchYaw(dx::XMVectorGetX(dx::g_XMHalfPi), 0.0f, 0.0f));
 }
 
+void Project_PathAnimation::UpdateDrawPath(Graphics& gfx) {
+	dx::XMMATRIX view_proj = gfx.GetCamera() * gfx.GetProjection();
+	float screen_width = (float)gfx.GetWidth();
+	float screen_height = (float)gfx.GetHeight();
+	if (draw_path && GetPathScreenMovement(view_proj, screen_width, screen_height) < path_reflatten_pixels)
+		return;
+
+	std::vector<dx::XMFLOAT3> path_points = draw_model->controller->animation_path->GenerateAdaptivePath(
+		path_pixel_error, path_world_error, view_proj, screen_width, screen_height);
+	if (path_points.empty())
+		return;
+	dx::XMStoreFloat4x4(&path_view_proj, view_proj);
+
+	//The buffers can't grow, a new curve gets room for twice the points so it is rarely recreated
+	if (!draw_path || path_points.size() > draw_path->GetVertexCapacity()) {
+		std::vector<dx::XMFLOAT3> capacity_points(path_points.size() * 2, path_points.back());
+		draw_path = std::make_unique<Curve>(gfx, capacity_points);
+	}
+	draw_path->UpdateVertices(gfx, path_points);
+}
+
+float Project_PathAnimation::GetPathScreenMovement(dx::FXMMATRIX view_proj,
+	float screen_width, float screen_height) const {
+	const dx::XMVECTOR half_screen = dx::XMVectorSet(
+		screen_width * 0.5f, screen_height * 0.5f, 0.0f, 0.0f);
+	dx::XMMATRIX last_view_proj = dx::XMLoadFloat4x4(&path_view_proj);
+	float max_movement = 0.0f;
+	for (auto& control_point : all_control_points) {
+		dx::XMVECTOR point = dx::XMLoadFloat3(&control_point);
+		dx::XMVECTOR clip = dx::XMVector3Transform(point, view_proj);
+		dx::XMVECTOR last_clip = dx::XMVector3Transform(point, last_view_proj);
+		float w = dx::XMVectorGetW(clip);
+		float last_w = dx::XMVectorGetW(last_clip);
+		//Moved across the camera plane, the pixel distance is meaningless
+		if ((w <= 0.0f) != (last_w <= 0.0f))
+			return FLT_MAX;
+		if (w <= 0.0f)
+			continue;
+		dx::XMVECTOR movement = dx::XMVectorMultiply(dx::XMVectorSubtract(
+			dx::XMVectorScale(clip, 1.0f / w), dx::XMVectorScale(last_clip, 1.0f / last_w)), half_screen);
+		max_movement = (std::max)(max_movement, dx::XMVectorGetX(dx::XMVector2Length(movement)));
+	}
+	return max_movement;
+}
+
+void Project_PathAnimation::SetupCrowd(Graphics& gfx, FBXLoader& fbx) {
+	crowd_agents.assign(crowd_size, PathAgentState());
+	crowd_samples.resize(crowd_size);
+	crowd_positions.resize(crowd_size);
+	crowd_models.clear();
+	for (unsigned int i = 0; i < crowd_size; ++i) {
+		//Spread along the path with different speeds, so the faster agents have to pass
+		PathAgentState& agent = crowd_agents[i];
+		agent.loop_time = 24.0f + 4.0f * (i % 3);
+		agent.path_time = agent.loop_time * i / crowd_size;
+
+		std::unique_ptr<Model> crowd_model = std::make_unique<Model>();
+		crowd_model->LoadModel(gfx, &fbx, TEXT("Max_Red_Body_Diffuse.png"));
+		crowd_model->external_transform = true;
+		crowd_model->show_controls = false;
+		//Walk animation, paced as AnimationController::SetAnimationPath does
+		crowd_model->controller->SetActiveAnimation(2);
+		crowd_model->controller->active_animation->pace =
+			0.5f * draw_model->controller->animation_path->constant_velocity;
+		crowd_models.push_back(std::move(crowd_model));
+	}
+}
+
+void Project_PathAnimation::UpdateCrowd(float dt) {
+	SharedPath::Update(crowd_agents.data(), crowd_size, dt);
+	crowd_path->EvaluateParallel(crowd_agents.data(), crowd_size, crowd_samples.data());
+	crowd_avoidance.Update(crowd_samples.data(), crowd_size, dt, crowd_positions.data());
+
+	for (unsigned int i = 0; i < crowd_size; ++i) {
+		const PathAgentSample& sample = crowd_samples[i];
+		Model& crowd_model = *crowd_models[i];
+		//The look position is moved sideways with the agent so it keeps facing along the path
+		dx::XMVECTOR position = dx::XMLoadFloat3(&crowd_positions[i]);
+		dx::XMVECTOR avoidance_offset = dx::XMVectorSubtract(position, dx::XMLoadFloat3(&sample.position));
+		crowd_model.SetPathTransform(position,
+			dx::XMVectorAdd(dx::XMLoadFloat3(&sample.look_position), avoidance_offset));
+		crowd_model.controller->animation_speed = sample.velocity / crowd_model.controller->active_animation->pace;
+		crowd_model.Update(dt);
+	}
+}
+
+void Project_PathAnimation::ProjectControls() {
+	if (ImGui::Begin("Project Controls"))
+	{
+		ImGui::Checkbox("Show crowd", &show_crowd);
+		ImGui::SliderFloat("Agent radius", &crowd_avoidance.agent_radius, 5.0f, 60.0f);
+		ImGui::SliderFloat("Time horizon", &crowd_avoidance.time_horizon, 0.1f, 3.0f);
+	}
+	ImGui::End();
+}
+
 void Project_PathAnimation::Update(float dt) {
 	Window& window_ref = p_parent_app->GetWindow();
+	ProjectControls();
+	UpdateDrawPath(window_ref.Gfx());
 	draw_model->Update(window_ref.keyboard.isKeyPressed(VK_SPACE) ? 0.0f : dt);
+	if (show_crowd)
+		UpdateCrowd(window_ref.keyboard.isKeyPressed(VK_SPACE) ? 0.0f : dt);
 	draw_path->Update(dt);
 	draw_floor->Update(dt);
 }
@@ -74,6 +180,11 @@ void Project_PathAnimation::Draw() {
 	Window& window_ref = p_parent_app->GetWindow();
 	draw_floor->Draw(window_ref.Gfx());
 	draw_model->Draw(window_ref.Gfx());
+	if (show_crowd) {
+		for (auto& crowd_model : crowd_models) {
+			crowd_model->Draw(window_ref.Gfx());
+		}
+	}
 	draw_path->Draw(window_ref.Gfx());
 
 	for (auto& control_point : all_control_points) {
@@ -1,5 +1,7 @@
 #pragma once
 #include "Project.h"
+#include "SharedPath.h"
+#include "CrowdAvoidance.h"
 
 class Project_PathAnimation : public Project
 {	
@@ -10,11 +12,44 @@ public:
 	void Update(float dt) override;
 	void Draw() override;
 private:
+	//Re-flattens the path to the screen once the view moved it by path_reflatten_pixels
+	void UpdateDrawPath(Graphics& gfx);
+	//Returns: float - the most any control point moved on screen since the path was flattened
+	float GetPathScreenMovement(dx::FXMMATRIX view_proj, float screen_width, float screen_height) const;
+
+	/*
+	* Creates the crowd models and spreads their agents along the path
+	*/
+	void SetupCrowd(Graphics& gfx, FBXLoader& fbx);
+	/*
+	* Moves the agents along the shared path, steers them around each other
+	* and places their models
+	*/
+	void UpdateCrowd(float dt);
+	void ProjectControls();
+
 	std::unique_ptr<Animation> animation;
 	std::unique_ptr<Model> draw_model;
 	std::unique_ptr<Curve> draw_path;
 	std::unique_ptr<SolidSphere> draw_control_point;
 	std::unique_ptr<DrawPlane> draw_floor;
 	std::vector<dx::XMFLOAT3> all_control_points;
+	//The camera * projection the path was last flattened with
+	dx::XMFLOAT4X4 path_view_proj;
+	//Max distance in pixels between the drawn path and the curve
+	float path_pixel_error = 0.5f;
+	float path_reflatten_pixels = 4.0f;
+	//Max distance in world units where the path crosses the camera plane
+	float path_world_error = 1.0f;
+
+	//Agents following a snapshot of the model's path
+	static const unsigned int crowd_size = 8;
+	std::unique_ptr<SharedPath> crowd_path;
+	std::vector<PathAgentState> crowd_agents;
+	std::vector<PathAgentSample> crowd_samples;
+	std::vector<dx::XMFLOAT3> crowd_positions;
+	CrowdAvoidance crowd_avoidance;
+	std::vector<std::unique_ptr<Model>> crowd_models;
+	bool show_crowd = true;
 };
 
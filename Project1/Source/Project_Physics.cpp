@@ -54,6 +54,7 @@ void Project_Physics::Setup() {
 	physics_system.AddPhysicsObject(obj_vertices);
 	physics_system.AddPhysicsObject(obj_vertices);
 	physics_system.AddPhysicsObject(obj_vertices);
+	physics_system.BuildStickChain();
 }
 
 void Project_Physics::Enter() {
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "RigidBodyStore.h"
+
+namespace dx = DirectX;
+
+unsigned int RigidBodyStore::AddBody(float mass, const dx::XMFLOAT3X3& inv_inertia, const dx::XMFLOAT3& position) {
+	dx::XMFLOAT3X3 identity;
+	dx::XMStoreFloat3x3(&identity, dx::XMMatrixIdentity());
+
+	positions.push_back(position);
+	rotations.push_back(identity);
+	orientations.push_back(Quaternion());
+	back_positions.push_back(position);
+	back_rotations.push_back(identity);
+	back_orientations.push_back(Quaternion());
+	back_momenta.push_back(dx::XMFLOAT3());
+	back_angular_momenta.push_back(dx::XMFLOAT3());
+	previous_positions.push_back(position);
+	previous_rotations.push_back(identity);
+	previous_orientations.push_back(Quaternion());
+	momenta.push_back(dx::XMFLOAT3());
+	angular_momenta.push_back(dx::XMFLOAT3());
+	inv_masses.push_back(1.0f / mass);
+	inv_inertias.push_back(inv_inertia);
+
+	forces.push_back(dx::XMFLOAT3());
+	torques.push_back(dx::XMFLOAT3());
+	velocities.push_back(dx::XMFLOAT3());
+	angular_velocities.push_back(dx::XMFLOAT3());
+	world_inv_inertias.push_back(inv_inertia);
+	return (unsigned int)positions.size() - 1;
+}
+
+size_t RigidBodyStore::Size() const {
+	return positions.size();
+}
+
+void RigidBodyStore::CalculateVelocities() {
+	for (unsigned int i = 0; i < positions.size(); ++i) {
+		CalculateVelocities(i);
+	}
+}
+
+void RigidBodyStore::CalculateVelocities(unsigned int body) {
+	//c'(t) = v(t) = P(t)/M
+	dx::XMStoreFloat3(&velocities[body],
+		dx::XMVectorScale(dx::XMLoadFloat3(&momenta[body]), inv_masses[body]));
+
+	//I-inv(t) = R(t) * Iobj-inv * R(t)-trans
+	dx::XMMATRIX R = dx::XMLoadFloat3x3(&rotations[body]);
+	dx::XMMATRIX I_inv = dx::XMMatrixTranspose(R) * dx::XMLoadFloat3x3(&inv_inertias[body]) * R;
+	dx::XMStoreFloat3x3(&world_inv_inertias[body], I_inv);
+
+	//w(t) = I-inv(t) * L(t)
+	dx::XMStoreFloat3(&angular_velocities[body],
+		dx::XMVector3Transform(dx::XMLoadFloat3(&angular_momenta[body]), I_inv));
+}
+
+void RigidBodyStore::SyncOrientations() {
+	for (size_t i = 0; i < rotations.size(); ++i) {
+		dx::XMVECTOR q = dx::XMQuaternionRotationMatrix(dx::XMLoadFloat3x3(&rotations[i]));
+		orientations[i] = Quaternion(dx::XMQuaternionNormalize(q));
+		q = dx::XMQuaternionRotationMatrix(dx::XMLoadFloat3x3(&previous_rotations[i]));
+		previous_orientations[i] = Quaternion(dx::XMQuaternionNormalize(q));
+	}
+}
+
+void RigidBodyStore::SwapBuffers() {
+	positions.swap(back_positions);
+	rotations.swap(back_rotations);
+	orientations.swap(back_orientations);
+	momenta.swap(back_momenta);
+	angular_momenta.swap(back_angular_momenta);
+}
+
+void RigidBodyStore::SavePrevious() {
+	previous_positions = positions;
+	previous_rotations = rotations;
+	previous_orientations = orientations;
+}
+
+void RigidBodyStore::GetInterpolatedPose(unsigned int body, float alpha, bool use_orientations,
+	dx::XMFLOAT3& position, dx::XMFLOAT3X3& rotation) const {
+	alpha = (std::min)(alpha, 1.0f);
+	dx::XMStoreFloat3(&position, dx::XMVectorLerp(
+		dx::XMLoadFloat3(&previous_positions[body]), dx::XMLoadFloat3(&positions[body]), alpha));
+
+	dx::XMVECTOR q_prev, q_curr;
+	if (use_orientations) {
+		q_prev = previous_orientations[body].toVector();
+		q_curr = orientations[body].toVector();
+	}
+	else {
+		q_prev = dx::XMQuaternionRotationMatrix(dx::XMLoadFloat3x3(&previous_rotations[body]));
+		q_curr = dx::XMQuaternionRotationMatrix(dx::XMLoadFloat3x3(&rotations[body]));
+	}
+
+	//Slerp the rotations so the blend stays a rotation
+	dx::XMVECTOR q = alpha >= 1.0f ? q_curr : dx::XMQuaternionSlerp(q_prev, q_curr, alpha);
+	dx::XMStoreFloat3x3(&rotation, dx::XMMatrixRotationQuaternion(dx::XMQuaternionNormalize(q)));
+}
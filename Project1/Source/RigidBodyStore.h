@@ -0,0 +1,84 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Quaternion.h"
+
+/*
+* State of every rigid body in a PhysicsSystem, one array per quantity.
+* Body i is at index i of every array, so the per step loops walk
+* contiguous memory instead of following PhysicsObject pointers.
+*/
+struct RigidBodyStore
+{
+	//c(t)
+	std::vector<DirectX::XMFLOAT3> positions;
+	//R(t)
+	std::vector<DirectX::XMFLOAT3X3> rotations;
+	//q(t), kept in step with R(t) when the quaternion orientation is integrated
+	std::vector<Quaternion> orientations;
+	//P(t)
+	std::vector<DirectX::XMFLOAT3> momenta;
+	//L(t)
+	std::vector<DirectX::XMFLOAT3> angular_momenta;
+
+	std::vector<float> inv_masses;
+	//Back buffer of the integrated state, written by the integrators during a step
+	//while the forces are calculated from the current state, then swapped with it
+	std::vector<DirectX::XMFLOAT3> back_positions;
+	std::vector<DirectX::XMFLOAT3X3> back_rotations;
+	std::vector<Quaternion> back_orientations;
+	std::vector<DirectX::XMFLOAT3> back_momenta;
+	std::vector<DirectX::XMFLOAT3> back_angular_momenta;
+
+	//c(t), R(t) and q(t) before the last step, for interpolating the rendered state
+	std::vector<DirectX::XMFLOAT3> previous_positions;
+	std::vector<DirectX::XMFLOAT3X3> previous_rotations;
+	std::vector<Quaternion> previous_orientations;
+
+	//Iobj-inv, in body space
+	std::vector<DirectX::XMFLOAT3X3> inv_inertias;
+
+	//Forces and torques from the stick-spring system for the current step
+	std::vector<DirectX::XMFLOAT3> forces;
+	std::vector<DirectX::XMFLOAT3> torques;
+
+	//Calculated once per step from the momentums
+	std::vector<DirectX::XMFLOAT3> velocities;
+	std::vector<DirectX::XMFLOAT3> angular_velocities;
+	//I-inv(t) = R(t)-trans * Iobj-inv * R(t)
+	std::vector<DirectX::XMFLOAT3X3> world_inv_inertias;
+
+	/*
+	* Adds a body at rest with no rotation
+	* Returns: unsigned int - index of the body
+	*/
+	unsigned int AddBody(float mass, const DirectX::XMFLOAT3X3& inv_inertia, const DirectX::XMFLOAT3& position);
+
+	size_t Size() const;
+
+	/*
+	* Calculates the velocities, world inverse inertias and angular velocities
+	* of all bodies from their current state
+	*/
+	void CalculateVelocities();
+	void CalculateVelocities(unsigned int body);
+
+	//Sets the current and previous orientations from the rotations
+	void SyncOrientations();
+
+	//Makes the back buffer the current state
+	void SwapBuffers();
+
+	//Keeps the current positions, rotations and orientations as the previous ones
+	void SavePrevious();
+
+	/*
+	* Blends the previous and current position and rotation of the body,
+	* alpha 0 is the previous state and 1 the current one.
+	* The rotation is slerped between the orientations if use_orientations is set,
+	* otherwise between quaternions of the rotation matrices. The result is rebuilt
+	* from the quaternion for every alpha, so it is always orthonormal.
+	*/
+	void GetInterpolatedPose(unsigned int body, float alpha, bool use_orientations,
+		DirectX::XMFLOAT3& position, DirectX::XMFLOAT3X3& rotation) const;
+};
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <execution>
+#include "SharedPath.h"
+
+SharedPath::SharedPath(Path& path) {
+	path.RefreshDirtySpans();
+	if (path.arc_length_tables.empty())
+		path.GenerateArcLengthTable();
+
+	spans = path.spans;
+	arc_length_tables = path.arc_length_tables;
+	span_length_prefix = path.span_length_prefix;
+	total_length = span_length_prefix.back();
+}
+
+float SharedPath::GetLength() const {
+	return total_length;
+}
+
+int SharedPath::AddVelocityProfile(const VelocityProfile& profile) {
+	if (!(profile.GetTotalDistance() > 0.0f))
+		return -1;
+	velocity_profiles.push_back(profile);
+	return (int)velocity_profiles.size() - 1;
+}
+
+void SharedPath::Update(PathAgentState* agents, unsigned int count, float dt) {
+	for (unsigned int i = 0; i < count; i++) {
+		agents[i].path_time += dt;
+	}
+}
+
+void SharedPath::GetSpanFromDistance(float S, unsigned int& span_indx, float& span_u) const {
+	if (spans.empty()) {
+		span_indx = 0;
+		span_u = 0.0f;
+		return;
+	}
+	if (S >= total_length) {
+		span_indx = spans.size() - 1;
+		span_u = 1.0f;
+		return;
+	}
+
+	//Find the span with prefix[i] <= S < prefix[i+1]
+	auto span_iter = std::upper_bound(span_length_prefix.begin(), span_length_prefix.end(), S);
+	span_indx = (unsigned int)(span_iter - span_length_prefix.begin()) - 1;
+	float span_S = S - span_length_prefix[span_indx];
+
+	//Find Si <= S < Si+1 in the table of the span
+	const float* table = &arc_length_tables[span_indx * (Path::arc_length_samples + 1)];
+	const float* Si_iter = std::upper_bound(table, table + Path::arc_length_samples + 1, span_S);
+	unsigned int Si_indx = (unsigned int)(Si_iter - table) - 1;
+	if (Si_indx >= Path::arc_length_samples) {
+		span_u = 1.0f;
+		return;
+	}
+
+	//Lerp between Ui and Ui+1
+	float Si_range = table[Si_indx + 1] - table[Si_indx];
+	float t_s = Si_range > 0.0f ? (span_S - table[Si_indx]) / Si_range : 0.0f;
+	span_u = (Si_indx + t_s) / Path::arc_length_samples;
+}
+
+float SharedPath::GetNormalizedT(float t, float loop_time) {
+	float normalized_t = t / loop_time;
+	if (t > loop_time)
+		normalized_t -= (int)normalized_t;
+	return normalized_t;
+}
+
+float SharedPath::GetDistanceFromTime(const PathAgentState& agent, float t) const {
+	float normalized_t = GetNormalizedT(t, agent.loop_time);
+	if (agent.velocity_profile < 0)
+		return total_length * (dx::XMScalarSin(dx::XM_PI * normalized_t - dx::XM_PIDIV2) + 1) / 2;
+
+	//Scale the distance of the profile to the length of the path
+	const VelocityProfile& profile = velocity_profiles[agent.velocity_profile];
+	return total_length * profile.GetDistance(normalized_t) / profile.GetTotalDistance();
+}
+
+float SharedPath::GetVelocity(const PathAgentState& agent) const {
+	float normalized_t = GetNormalizedT(agent.path_time, agent.loop_time);
+	if (agent.velocity_profile < 0) {
+		//V(t) = dS/dt of the sin ease in/out
+		return total_length * dx::XM_PIDIV2 / agent.loop_time *
+			dx::XMScalarSin(dx::XM_PI * normalized_t);
+	}
+
+	const VelocityProfile& profile = velocity_profiles[agent.velocity_profile];
+	return total_length / agent.loop_time *
+		profile.GetVelocity(normalized_t) / profile.GetTotalDistance();
+}
+
+void SharedPath::EvaluateBatch(const PathAgentState* agents, unsigned int count,
+	PathAgentSample* out_samples) const {
+	const CubicSpan* sample_spans[batch_size * samples_per_agent];
+	float sample_u[batch_size * samples_per_agent];
+	dx::XMFLOAT3 sample_points[batch_size * samples_per_agent];
+
+	//Resolve the span and u of every point, lanes are ordered agent after agent
+	unsigned int span_indx;
+	for (unsigned int i = 0; i < count; i++) {
+		const PathAgentState& agent = agents[i];
+		for (unsigned int j = 0; j < samples_per_agent; j++) {
+			float S = GetDistanceFromTime(agent, agent.path_time + j * agent.look_ahead_time);
+			GetSpanFromDistance(S, span_indx, sample_u[i * samples_per_agent + j]);
+			sample_spans[i * samples_per_agent + j] = &spans[span_indx];
+		}
+	}
+
+	//One vector holds the current and look ahead points of an agent
+	CubicSpan::EvaluateSpans(sample_spans, sample_u, count * samples_per_agent, sample_points);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const PathAgentState& agent = agents[i];
+		const dx::XMFLOAT3* points = &sample_points[i * samples_per_agent];
+		PathAgentSample& sample = out_samples[i];
+		sample.position = points[0];
+
+		dx::XMVECTOR look_pos = dx::XMVectorAdd(
+			dx::XMVectorAdd(dx::XMLoadFloat3(&points[1]), dx::XMLoadFloat3(&points[2])),
+			dx::XMLoadFloat3(&points[3]));
+		dx::XMStoreFloat3(&sample.look_position,
+			dx::XMVectorScale(look_pos, 1.0f / (samples_per_agent - 1)));
+		sample.velocity = GetVelocity(agent);
+	}
+}
+
+void SharedPath::Evaluate(const PathAgentState* agents, unsigned int count,
+	PathAgentSample* out_samples) const {
+	if (spans.empty()) {
+		std::fill(out_samples, out_samples + count, PathAgentSample());
+		return;
+	}
+	for (unsigned int i = 0; i < count; i += batch_size) {
+		EvaluateBatch(agents + i, (std::min)(batch_size, count - i), out_samples + i);
+	}
+}
+
+void SharedPath::EvaluateParallel(const PathAgentState* agents, unsigned int count,
+	PathAgentSample* out_samples) const {
+	if (spans.empty()) {
+		std::fill(out_samples, out_samples + count, PathAgentSample());
+		return;
+	}
+	std::vector<unsigned int> batch_starts;
+	for (unsigned int i = 0; i < count; i += batch_size) {
+		batch_starts.push_back(i);
+	}
+
+	//Batches write to separate parts of out_samples so they can run on any thread
+	std::for_each(std::execution::par, batch_starts.begin(), batch_starts.end(),
+		[&](unsigned int batch_start) {
+			EvaluateBatch(agents + batch_start,
+				(std::min)(batch_size, count - batch_start), out_samples + batch_start);
+		});
+}
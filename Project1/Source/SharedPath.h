@@ -0,0 +1,106 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "CubicSpan.h"
+#include "Path.h"
+
+namespace dx = DirectX;
+
+//Per agent state, kept apart from the path so many agents can follow it
+struct PathAgentState {
+	float path_time = 0.0f;
+	//The time taken by this agent for 1 complete loop
+	float loop_time = 30.0f;
+	float look_ahead_time = 0.2f;
+	//Index of the speed profile in the table of the path, -1 for the sin ease in/out
+	int velocity_profile = -1;
+};
+
+//Result of evaluating the path for an agent
+struct PathAgentSample {
+	dx::XMFLOAT3 position;
+	//Average of the look ahead points, used as the center of interest
+	dx::XMFLOAT3 look_position;
+	float velocity;
+};
+
+/*
+* Immutable snapshot of a Path used to move any number of agents
+* along the same spline. Holds only the span coefficients and arc length
+* tables, every query is const so it can be shared across threads.
+*/
+class SharedPath
+{
+private:
+	std::vector<CubicSpan> spans;
+	std::vector<float> arc_length_tables;
+	std::vector<float> span_length_prefix;
+	float total_length;
+	//Speed profiles shared by the agents, each over normalized time
+	std::vector<VelocityProfile> velocity_profiles;
+
+	//Number of agents evaluated together by a single task
+	static const unsigned int batch_size = 64;
+	//The current position and 3 look ahead points
+	static const unsigned int samples_per_agent = 4;
+
+	/*
+	* Inverse arc length function for the whole path.
+	* Returns: span 0 and u 0 if the path has no spans, otherwise the span that contains the distance S and the u within that span
+	*/
+	void GetSpanFromDistance(float S, unsigned int& span_indx, float& span_u) const;
+
+	//Converts t to the 0-1 range of a loop, same as Path::GetNormalizedT
+	static float GetNormalizedT(float t, float loop_time);
+
+	/*
+	* Returns the distance travelled by the agent after the given time t
+	* Uses the speed profile of the agent, or sin interpolation
+	* same as Path::GetSinDistanceFromTime if it has none
+	*/
+	float GetDistanceFromTime(const PathAgentState& agent, float t) const;
+
+	//Returns the velocity of the agent at its current time
+	float GetVelocity(const PathAgentState& agent) const;
+
+	//Evaluates at most batch_size agents
+	void EvaluateBatch(const PathAgentState* agents, unsigned int count,
+		PathAgentSample* out_samples) const;
+public:
+	/*
+	* Copies the spans and arc length tables out of the path.
+	* Generates the arc length tables if the path does not have them yet.
+	*/
+	explicit SharedPath(Path& path);
+
+	float GetLength() const;
+
+	/*
+	* Adds a speed profile agents can select with PathAgentState::velocity_profile.
+	* The profile is scaled so that its total distance covers the whole path.
+	* Profiles have to be added before the path is shared across threads.
+	* A profile that covers no distance cannot be scaled and is not added.
+	* Returns: int - index of the profile, -1 if it was not added
+	*/
+	int AddVelocityProfile(const VelocityProfile& profile);
+
+	/*
+	* Advances the time of all the agents
+	*/
+	static void Update(PathAgentState* agents, unsigned int count, float dt);
+
+	/*
+	* Evaluates the position, look ahead position and velocity of every agent.
+	* The four points of an agent are evaluated together with CubicSpan::EvaluateSpans.
+	* Returns: void - the results are written to out_samples
+	*/
+	void Evaluate(const PathAgentState* agents, unsigned int count,
+		PathAgentSample* out_samples) const;
+
+	/*
+	* Same as Evaluate but splits the agents into batches
+	* that are evaluated in parallel.
+	*/
+	void EvaluateParallel(const PathAgentState* agents, unsigned int count,
+		PathAgentSample* out_samples) const;
+};
@@ -0,0 +1,49 @@
+#include <cmath>
+#include <algorithm>
+#include "SpatialHash.h"
+
+SpatialHash::SpatialHash(float _cell_size) : cell_size(_cell_size) {
+}
+
+float SpatialHash::GetCellSize() const {
+	return cell_size;
+}
+
+SpatialHash::cell_key SpatialHash::GetCellKey(int cell_x, int cell_z) const {
+	return ((cell_key)(unsigned int)cell_x << 32) | (unsigned int)cell_z;
+}
+
+SpatialHash::cell_key SpatialHash::GetCellKey(const dx::XMFLOAT3& position) const {
+	return GetCellKey((int)floorf(position.x / cell_size), (int)floorf(position.z / cell_size));
+}
+
+void SpatialHash::RemoveFromCell(unsigned int point_indx) {
+	auto cell_iter = cells.find(point_cells[point_indx]);
+	std::vector<unsigned int>& cell = cell_iter->second;
+	//Order within a cell doesn't matter, swap with the last and pop
+	auto point_iter = std::find(cell.begin(), cell.end(), point_indx);
+	*point_iter = cell.back();
+	cell.pop_back();
+	if (cell.empty())
+		cells.erase(cell_iter);
+}
+
+void SpatialHash::Update(const dx::XMFLOAT3* positions, unsigned int count) {
+	//Drop the points that no longer exist
+	for (unsigned int i = count; i < point_cells.size(); i++) {
+		RemoveFromCell(i);
+	}
+
+	unsigned int prev_count = (std::min)((unsigned int)point_cells.size(), count);
+	point_cells.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		cell_key key = GetCellKey(positions[i]);
+		if (i < prev_count) {
+			if (key == point_cells[i])
+				continue;
+			RemoveFromCell(i);
+		}
+		point_cells[i] = key;
+		cells[key].push_back(i);
+	}
+}
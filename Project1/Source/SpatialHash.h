@@ -0,0 +1,65 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+namespace dx = DirectX;
+
+/*
+* Uniform grid over the XZ plane storing the indices of points in each cell.
+* Points are moved between cells only when they cross a cell boundary,
+* so updating it every frame is cheap when things move slowly.
+*/
+class SpatialHash
+{
+private:
+	typedef unsigned long long cell_key;
+
+	float cell_size;
+	std::unordered_map<cell_key, std::vector<unsigned int>> cells;
+	//The cell each point is currently stored in
+	std::vector<cell_key> point_cells;
+
+	cell_key GetCellKey(int cell_x, int cell_z) const;
+	cell_key GetCellKey(const dx::XMFLOAT3& position) const;
+
+	//Removes the point from the cell it is stored in
+	void RemoveFromCell(unsigned int point_indx);
+public:
+	SpatialHash(float _cell_size);
+
+	float GetCellSize() const;
+
+	/*
+	* Moves the points to their new cells.
+	* Points beyond the previous count are added, any extra are dropped.
+	*/
+	void Update(const dx::XMFLOAT3* positions, unsigned int count);
+
+	/*
+	* Calls func(point_indx) for every point in the cells overlapping
+	* the square of half size radius around the position.
+	* Points can be farther than radius, the caller checks the distance.
+	*/
+	template<class Func>
+	void ForEachNear(const dx::XMFLOAT3& position, float radius, Func func) const;
+};
+
+template<class Func>
+inline void SpatialHash::ForEachNear(const dx::XMFLOAT3& position, float radius, Func func) const {
+	int min_x = (int)floorf((position.x - radius) / cell_size);
+	int max_x = (int)floorf((position.x + radius) / cell_size);
+	int min_z = (int)floorf((position.z - radius) / cell_size);
+	int max_z = (int)floorf((position.z + radius) / cell_size);
+	for (int cell_x = min_x; cell_x <= max_x; cell_x++) {
+		for (int cell_z = min_z; cell_z <= max_z; cell_z++) {
+			auto cell_iter = cells.find(GetCellKey(cell_x, cell_z));
+			if (cell_iter == cells.end())
+				continue;
+			for (unsigned int point_indx : cell_iter->second) {
+				func(point_indx);
+			}
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#include "SpringGraph.h"
+
+namespace dx = DirectX;
+
+unsigned int SpringGraph::AddEdge(EdgeType type, int body_a, const dx::XMFLOAT3& offset_a,
+	int body_b, const dx::XMFLOAT3& offset_b) {
+	types.push_back(type);
+	bodies_a.push_back(body_a);
+	bodies_b.push_back(body_b);
+	offsets_a.push_back(offset_a);
+	offsets_b.push_back(offset_b);
+
+	forces.push_back(dx::XMFLOAT3());
+	torques_a.push_back(dx::XMFLOAT3());
+	torques_b.push_back(dx::XMFLOAT3());
+	body_edges_dirty = true;
+	return (unsigned int)types.size() - 1;
+}
+
+void SpringGraph::Clear() {
+	types.clear();
+	bodies_a.clear();
+	bodies_b.clear();
+	offsets_a.clear();
+	offsets_b.clear();
+	forces.clear();
+	torques_a.clear();
+	torques_b.clear();
+	body_edges_dirty = true;
+}
+
+size_t SpringGraph::Size() const {
+	return types.size();
+}
+
+void SpringGraph::GetCoefficients(unsigned int edge, float spring_coeff, float damper_coeff,
+	float& k, float& d) const {
+	switch (types[edge]) {
+	case EdgeType::SPRING:
+		k = spring_coeff;
+		d = damper_coeff;
+		break;
+	case EdgeType::DAMPER:
+		k = 0.0f;
+		d = damper_coeff;
+		break;
+	case EdgeType::PIN:
+		k = spring_coeff * pin_scale;
+		d = damper_coeff * pin_scale;
+		break;
+	}
+}
+
+void SpringGraph::UpdateBodyEdges(size_t body_count) {
+	if (!body_edges_dirty && body_edge_starts.size() == body_count + 1)
+		return;
+
+	//Count the edges of every body, then place them
+	body_edge_starts.assign(body_count + 1, 0);
+	for (size_t edge = 0; edge < types.size(); ++edge) {
+		if (!IsAnchor(bodies_a[edge]))
+			body_edge_starts[bodies_a[edge] + 1]++;
+		//An edge between two points of the same body is listed once
+		if (!IsAnchor(bodies_b[edge]) && bodies_b[edge] != bodies_a[edge])
+			body_edge_starts[bodies_b[edge] + 1]++;
+	}
+	for (size_t body = 0; body < body_count; ++body) {
+		body_edge_starts[body + 1] += body_edge_starts[body];
+	}
+
+	body_edges.resize(body_edge_starts[body_count]);
+	std::vector<unsigned int> next(body_edge_starts.begin(), body_edge_starts.end() - 1);
+	for (unsigned int edge = 0; edge < types.size(); ++edge) {
+		if (!IsAnchor(bodies_a[edge]))
+			body_edges[next[bodies_a[edge]]++] = edge;
+		if (!IsAnchor(bodies_b[edge]) && bodies_b[edge] != bodies_a[edge])
+			body_edges[next[bodies_b[edge]]++] = edge;
+	}
+	body_edges_dirty = false;
+}
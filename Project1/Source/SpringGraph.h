@@ -0,0 +1,68 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+/*
+* Spring-dampers between points of the bodies of a PhysicsSystem, one array per quantity.
+* An edge pulls its two ends together with f = k * (pb - pa) + d * (pb` - pa`).
+* An end is a body with an offset in the body's local space, or an anchor point
+* of the system with an offset in world space.
+*/
+struct SpringGraph
+{
+	enum class EdgeType {
+		//Spring and damper with the system's coefficients
+		SPRING,
+		//Damper only
+		DAMPER,
+		//Spring and damper pin_scale times stiffer, to hold two points together
+		PIN
+	};
+
+	//Stiffness of the pins relative to the springs
+	float pin_scale = 10.0f;
+
+	std::vector<EdgeType> types;
+	//Body index of each end, or Anchor(index) for an anchor point
+	std::vector<int> bodies_a;
+	std::vector<int> bodies_b;
+	//Attachment points, precomputed when the edge is added
+	std::vector<DirectX::XMFLOAT3> offsets_a;
+	std::vector<DirectX::XMFLOAT3> offsets_b;
+
+	//Force on end a of each edge from the last force pass, end b gets its negation
+	std::vector<DirectX::XMFLOAT3> forces;
+	std::vector<DirectX::XMFLOAT3> torques_a;
+	std::vector<DirectX::XMFLOAT3> torques_b;
+
+	//Edges of body i are body_edges[body_edge_starts[i]] to body_edges[body_edge_starts[i + 1]],
+	//in the order they were added, so gathering the forces does not depend on threading
+	std::vector<unsigned int> body_edge_starts;
+	std::vector<unsigned int> body_edges;
+
+	//Returns: int - the end of an edge that is the anchor point with the index
+	static int Anchor(unsigned int index) { return -1 - (int)index; }
+	static bool IsAnchor(int end) { return end < 0; }
+	static unsigned int AnchorIndex(int end) { return (unsigned int)(-1 - end); }
+
+	/*
+	* Adds an edge between the ends
+	* Returns: unsigned int - index of the edge
+	*/
+	unsigned int AddEdge(EdgeType type, int body_a, const DirectX::XMFLOAT3& offset_a,
+		int body_b, const DirectX::XMFLOAT3& offset_b);
+
+	void Clear();
+
+	size_t Size() const;
+
+	//Gets the spring and damper coefficients of the edge from the system's coefficients
+	void GetCoefficients(unsigned int edge, float spring_coeff, float damper_coeff,
+		float& k, float& d) const;
+
+	//Rebuilds the edges of every body when edges were added or the body count changed
+	void UpdateBodyEdges(size_t body_count);
+
+private:
+	bool body_edges_dirty = true;
+};
@@ -0,0 +1,96 @@
+#include <cmath>
+#include "StackedJacobianSolver.h"
+
+StackedJacobianSolver::StackedJacobianSolver() : effector_count(0), joint_count(0) {
+}
+
+void StackedJacobianSolver::Reset(unsigned int _effector_count, unsigned int _joint_count) {
+	effector_count = _effector_count;
+	joint_count = _joint_count;
+	unsigned int row_count = 3 * effector_count;
+	jacobian.assign(row_count * joint_count, 0.0);
+	damped.resize(row_count * row_count);
+	target.assign(row_count, 0.0);
+	solution.resize(row_count);
+}
+
+void StackedJacobianSolver::SetColumn(unsigned int effector_indx, unsigned int joint_indx, dx::FXMVECTOR column) {
+	dx::XMFLOAT3 value;
+	dx::XMStoreFloat3(&value, column);
+	unsigned int row = 3 * effector_indx;
+	jacobian[row * joint_count + joint_indx] = value.x;
+	jacobian[(row + 1) * joint_count + joint_indx] = value.y;
+	jacobian[(row + 2) * joint_count + joint_indx] = value.z;
+}
+
+void StackedJacobianSolver::SetTarget(unsigned int effector_indx, dx::FXMVECTOR dP) {
+	dx::XMFLOAT3 value;
+	dx::XMStoreFloat3(&value, dP);
+	target[3 * effector_indx] = value.x;
+	target[3 * effector_indx + 1] = value.y;
+	target[3 * effector_indx + 2] = value.z;
+}
+
+bool StackedJacobianSolver::SolveDamped(float damping, double* dQ) {
+	unsigned int row_count = 3 * effector_count;
+
+	//Lower half of J J^T + damping^2 I
+	for (unsigned int row = 0; row < row_count; ++row) {
+		const double* row_values = &jacobian[row * joint_count];
+		for (unsigned int col = 0; col <= row; ++col) {
+			const double* col_values = &jacobian[col * joint_count];
+			double sum = 0.0;
+			for (unsigned int i = 0; i < joint_count; ++i) {
+				sum += row_values[i] * col_values[i];
+			}
+			damped[row * row_count + col] = sum;
+		}
+		damped[row * row_count + row] += (double)damping * damping;
+	}
+
+	//Cholesky factor in place, the matrix is symmetric positive definite when damped
+	for (unsigned int col = 0; col < row_count; ++col) {
+		double diagonal = damped[col * row_count + col];
+		for (unsigned int k = 0; k < col; ++k) {
+			diagonal -= damped[col * row_count + k] * damped[col * row_count + k];
+		}
+		if (diagonal <= 0.0)
+			return false;
+		diagonal = sqrt(diagonal);
+		damped[col * row_count + col] = diagonal;
+
+		for (unsigned int row = col + 1; row < row_count; ++row) {
+			double value = damped[row * row_count + col];
+			for (unsigned int k = 0; k < col; ++k) {
+				value -= damped[row * row_count + k] * damped[col * row_count + k];
+			}
+			damped[row * row_count + col] = value / diagonal;
+		}
+	}
+
+	//L L^T y = dP
+	for (unsigned int row = 0; row < row_count; ++row) {
+		double value = target[row];
+		for (unsigned int k = 0; k < row; ++k) {
+			value -= damped[row * row_count + k] * solution[k];
+		}
+		solution[row] = value / damped[row * row_count + row];
+	}
+	for (int row = row_count - 1; row >= 0; --row) {
+		double value = solution[row];
+		for (unsigned int k = row + 1; k < row_count; ++k) {
+			value -= damped[k * row_count + row] * solution[k];
+		}
+		solution[row] = value / damped[row * row_count + row];
+	}
+
+	//dQ = J^T y
+	for (unsigned int i = 0; i < joint_count; ++i) {
+		double sum = 0.0;
+		for (unsigned int row = 0; row < row_count; ++row) {
+			sum += jacobian[row * joint_count + i] * solution[row];
+		}
+		dQ[i] = sum;
+	}
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+namespace dx = DirectX;
+
+/*
+* Damped least squares IK step for several end effectors at once.
+* Every effector has 3 rows in the stacked Jacobian and every joint of the
+* union of their chains has one column, so a joint shared by several chains
+* gets a single change that serves all of them.
+* The buffers are kept between solves, nothing is allocated while the size is unchanged.
+*/
+class StackedJacobianSolver
+{
+private:
+	unsigned int effector_count;
+	unsigned int joint_count;
+	//Row major, 3 * effector_count rows of joint_count
+	std::vector<double> jacobian;
+	//J J^T + damping^2 I and its Cholesky factor
+	std::vector<double> damped;
+	std::vector<double> target;
+	std::vector<double> solution;
+public:
+	StackedJacobianSolver();
+
+	//Sets the size and clears the Jacobian and targets
+	void Reset(unsigned int _effector_count, unsigned int _joint_count);
+
+	//Sets the change in the effector's position for a rotation of the joint
+	void SetColumn(unsigned int effector_indx, unsigned int joint_indx, dx::FXMVECTOR column);
+
+	//Sets the change the effector should move by
+	void SetTarget(unsigned int effector_indx, dx::FXMVECTOR dP);
+
+	/*
+	* dQ = J^T (J J^T + damping^2 I)^-1 dP
+	* dQ needs space for the joint count
+	* Returns: bool - false if the damped matrix is singular
+	*/
+	bool SolveDamped(float damping, double* dQ);
+};
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include "VelocityProfile.h"
+
+VelocityProfile::VelocityProfile() {
+	Clear();
+}
+
+void VelocityProfile::Clear() {
+	pieces.clear();
+	knot_times.assign(1, 0.0f);
+	knot_distances.assign(1, 0.0f);
+}
+
+unsigned int VelocityProfile::FindPiece(float t) const {
+	//Find ti <= t < ti+1
+	auto knot_iter = std::upper_bound(knot_times.begin(), knot_times.end(), t);
+	unsigned int piece_indx = (unsigned int)(knot_iter - knot_times.begin()) - 1;
+	return (std::min)(piece_indx, (unsigned int)pieces.size() - 1);
+}
+
+float VelocityProfile::PieceVelocity(const Piece& piece, float dt) {
+	return ((piece.c3 * dt + piece.c2) * dt + piece.c1) * dt + piece.c0;
+}
+
+float VelocityProfile::PieceDistance(const Piece& piece, float dt) {
+	//Integral of the velocity polynomial from 0 to dt
+	return (((piece.c3 * 0.25f * dt + piece.c2 / 3.0f) * dt + piece.c1 * 0.5f) * dt + piece.c0) * dt;
+}
+
+float VelocityProfile::GetEndVelocity() const {
+	if (pieces.empty())
+		return 0.0f;
+	unsigned int last = pieces.size() - 1;
+	return PieceVelocity(pieces[last], knot_times[last + 1] - knot_times[last]);
+}
+
+void VelocityProfile::AddPolynomialSegment(float t_end, float c0, float c1, float c2, float c3) {
+	Piece piece = { c0, c1, c2, c3 };
+	float duration = t_end - knot_times.back();
+	float distance = knot_distances.back() + PieceDistance(piece, duration);
+
+	pieces.push_back(piece);
+	knot_times.push_back(t_end);
+	knot_distances.push_back(distance);
+}
+
+void VelocityProfile::AddLinearSegment(float t_end, float velocity) {
+	float start_velocity = GetEndVelocity();
+	float duration = t_end - knot_times.back();
+	// Vi(t) = ((Vi - Vi-1)/(ti - ti-1))(t - ti-1) + Vi-1
+	AddPolynomialSegment(t_end, start_velocity,
+		(velocity - start_velocity) / duration, 0.0f, 0.0f);
+}
+
+void VelocityProfile::AddEaseSegment(float t_end, float velocity) {
+	float start_velocity = GetEndVelocity();
+	float duration = t_end - knot_times.back();
+	float velocity_change = velocity - start_velocity;
+	// V(x) = Vi-1 + (Vi - Vi-1)(3x^2 - 2x^3) with x = dt/duration
+	AddPolynomialSegment(t_end, start_velocity, 0.0f,
+		3.0f * velocity_change / (duration * duration),
+		-2.0f * velocity_change / (duration * duration * duration));
+}
+
+float VelocityProfile::GetDuration() const {
+	return knot_times.back();
+}
+
+float VelocityProfile::GetTotalDistance() const {
+	return knot_distances.back();
+}
+
+float VelocityProfile::GetVelocity(float t) const {
+	if (pieces.empty())
+		return 0.0f;
+
+	t = (std::max)(0.0f, (std::min)(t, GetDuration()));
+	unsigned int piece_indx = FindPiece(t);
+	return PieceVelocity(pieces[piece_indx], t - knot_times[piece_indx]);
+}
+
+float VelocityProfile::GetDistance(float t) const {
+	if (pieces.empty())
+		return 0.0f;
+
+	t = (std::max)(0.0f, (std::min)(t, GetDuration()));
+	unsigned int piece_indx = FindPiece(t);
+	return knot_distances[piece_indx] +
+		PieceDistance(pieces[piece_indx], t - knot_times[piece_indx]);
+}
+
+float VelocityProfile::GetTime(float S) const {
+	if (pieces.empty() || S <= 0.0f)
+		return 0.0f;
+	if (S >= GetTotalDistance())
+		return GetDuration();
+
+	//Find Si <= S < Si+1, the distances never decrease for positive velocities
+	auto knot_iter = std::upper_bound(knot_distances.begin(), knot_distances.end(), S);
+	unsigned int piece_indx = (unsigned int)(knot_iter - knot_distances.begin()) - 1;
+	const Piece& piece = pieces[piece_indx];
+	float piece_S = S - knot_distances[piece_indx];
+	float piece_length = knot_distances[piece_indx + 1] - knot_distances[piece_indx];
+
+	//Start from the linear guess and keep a bracket for bisection
+	const float threshold = 0.00001f;
+	const unsigned int max_iterations = 16;
+	float dt_a = 0.0f;
+	float dt_b = knot_times[piece_indx + 1] - knot_times[piece_indx];
+	float dt = dt_b * (piece_S / piece_length);
+	for (unsigned int i = 0; i < max_iterations; i++) {
+		float error = PieceDistance(piece, dt) - piece_S;
+		if (std::abs(error) < threshold * piece_length)
+			break;
+		if (error > 0.0f)
+			dt_b = dt;
+		else
+			dt_a = dt;
+
+		float velocity = PieceVelocity(piece, dt);
+		float dt_next = velocity > 0.0f ? dt - error / velocity : dt_a;
+		//Bisect when Newton leaves the bracket
+		if (dt_next <= dt_a || dt_next >= dt_b)
+			dt_next = (dt_a + dt_b) * 0.5f;
+		dt = dt_next;
+	}
+	return knot_times[piece_indx] + dt;
+}
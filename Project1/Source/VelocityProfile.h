@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+
+/*
+* Velocity as a function of time built from polynomial pieces.
+* Piece i covers [knot_times[i], knot_times[i+1]] with
+* V(t) = c0 + c1*dt + c2*dt^2 + c3*dt^3 where dt = t - knot_times[i].
+* The distance at every knot is stored when the piece is added,
+* so S(t), V(t) and t(S) are a binary search and one piece evaluation.
+*/
+class VelocityProfile
+{
+private:
+	struct Piece {
+		float c0;
+		float c1;
+		float c2;
+		float c3;
+	};
+
+	//Start and end time of every piece, knot_times[0] = 0
+	std::vector<float> knot_times;
+	//Distance travelled at each knot
+	std::vector<float> knot_distances;
+	std::vector<Piece> pieces;
+
+	//Index of the piece containing t, t must be within the profile
+	unsigned int FindPiece(float t) const;
+
+	//Velocity dt after the start of the piece
+	static float PieceVelocity(const Piece& piece, float dt);
+
+	//Distance travelled dt after the start of the piece
+	static float PieceDistance(const Piece& piece, float dt);
+
+	//Velocity at the end of the profile, 0 if it is empty
+	float GetEndVelocity() const;
+public:
+	VelocityProfile();
+
+	//Removes all the pieces
+	void Clear();
+
+	/*
+	* Adds a piece with a user defined velocity polynomial
+	* V(dt) = c0 + c1*dt + c2*dt^2 + c3*dt^3 lasting until t_end
+	*/
+	void AddPolynomialSegment(float t_end, float c0, float c1, float c2, float c3);
+
+	/*
+	* Adds a piece that changes the velocity linearly from
+	* the current end velocity to velocity at t_end
+	*/
+	void AddLinearSegment(float t_end, float velocity);
+
+	/*
+	* Adds a piece that eases from the current end velocity to velocity
+	* at t_end with zero acceleration at both ends (smoothstep)
+	*/
+	void AddEaseSegment(float t_end, float velocity);
+
+	//Time at the end of the last piece
+	float GetDuration() const;
+
+	//Distance travelled over the whole profile
+	float GetTotalDistance() const;
+
+	/*
+	* Returns the velocity at time t
+	* V(t), t is clamped to the profile
+	*/
+	float GetVelocity(float t) const;
+
+	/*
+	* Returns the distance travelled at time t
+	* S(t), t is clamped to the profile
+	*/
+	float GetDistance(float t) const;
+
+	/*
+	* Returns the time at which the distance S is reached
+	* i.e the inverse t(S). Newton iterations within the piece,
+	* falling back to bisection
+	*/
+	float GetTime(float S) const;
+};
@@ -1,7 +1,11 @@
 #include "App.h"
+#include "IKBenchmark.h"
+#include "PathFlattenCheck.h"
+#include "PhysicsCheck.h"
 #include <stdio.h>
+#include <string.h>
 
-int CALLBACK WinMain(HINSTANCE, HINSTANCE, LPSTR, INT) {
+int CALLBACK WinMain(HINSTANCE, HINSTANCE, LPSTR cmd_line, INT) {
 
 	/* Create a App Class */
 	bool ret_val;
@@ -14,6 +18,15 @@ int CALLBACK WinMain(HINSTANCE, HINSTANCE, LPSTR, INT) {
 	freopen_s(&newstderr, "CONOUT$", "w", stderr);
 
 	printf("opened console");
+
+	//Headless, no window is created
+	if (strstr(cmd_line, "--ik-benchmark"))
+		return IKBenchmark::RunFromCommandLine(cmd_line);
+	if (strstr(cmd_line, "--path-flatten-check"))
+		return PathFlattenCheck::RunFromCommandLine(cmd_line);
+	if (strstr(cmd_line, "--physics-check"))
+		return PhysicsCheck::RunFromCommandLine(cmd_line);
+
 	App app;
 
 	int ret_code = app.Run();